@@ -0,0 +1,330 @@
+#ifndef __async_runner_h__
+#define __async_runner_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+
+#include <dlpack/dlpack.h>
+#include <dmlc/logging.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/ndarray.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+  Asynchronous inference on one graph runtime instance: Submit() returns a
+  future or calls a callback, and a three stage pipeline overlaps the copies
+  with the compute.
+
+    stage thread : host input -> free device input buffer
+    run thread   : bind_input / bind_output to the request's buffers, run()
+    read thread  : device output buffer -> host, future / callback
+
+  With the default two input and two output buffers, request N+1 is staged
+  and request N-1 read back (and its callback run) while request N runs.
+  The buffers are bound to the graph through bind_input / bind_output of
+  graph_runtime_ext.cc, zero copy on the runtime's device, so run() needs
+  no set_input / get_output; an input buffer is free again as soon as its
+  run finished, an output buffer once it has been read back.
+
+  max_in_flight bounds the submitted, unfinished requests: Submit() blocks
+  until one finishes, TrySubmit() returns false instead (backpressure to
+  the caller).
+
+  On accelerators the overlap is between host work and run(); the device
+  copies of the TVM C API go through the same in-order queue as the
+  kernels and wait for it.
+
+ */
+
+struct AsyncRunnerOptions
+{
+    int buffers{ 2 };       // device input and output buffers each
+    int max_in_flight{ 8 }; // submitted, unfinished requests
+};
+
+class AsyncRunner
+{
+public:
+    using Output = std::vector<float>;
+    // Runs on the read thread and must not throw; error is set (and output
+    // empty) if the request failed
+    using Callback = std::function<void(Output output, std::exception_ptr error)>;
+
+    AsyncRunner(tvm::runtime::Module mod, const GraphRuntimePrivateStuff& info, int device_type, int device_id, const AsyncRunnerOptions& opts = AsyncRunnerOptions(), const std::string& input_name = "data")
+        : mod_(mod)
+        , opts_(opts)
+        , input_name_(input_name)
+    {
+        CHECK_GE(opts_.buffers, 1);
+        CHECK_GE(opts_.max_in_flight, 1);
+
+        uint32_t input_eid = info.num_node_entries();
+        for (auto nid : info.input_nodes_)
+        {
+            if (info.nodes_[nid].name == input_name)
+            {
+                input_eid = info.entry_id(nid, 0);
+            }
+        }
+        CHECK_LT(input_eid, info.num_node_entries()) << "no graph input " << input_name;
+        CHECK(parse_dltype(info.attrs_.dltype[input_eid]).code == kDLFloat) << "float32 input expected";
+        const uint32_t output_eid = info.entry_id(info.outputs_.front());
+        CHECK(parse_dltype(info.attrs_.dltype[output_eid]).code == kDLFloat) << "float32 output expected";
+
+        in_size_ = element_count(info.attrs_.shape[input_eid]);
+        out_size_ = element_count(info.attrs_.shape[output_eid]);
+
+        const DLContext ctx{ static_cast<DLDeviceType>(device_type), device_id };
+        for (int i = 0; i < opts_.buffers; i++)
+        {
+            inputs_.push_back(tvm::runtime::NDArray::Empty(info.attrs_.shape[input_eid], DLDataType{ kDLFloat, 32, 1 }, ctx));
+            outputs_.push_back(tvm::runtime::NDArray::Empty(info.attrs_.shape[output_eid], DLDataType{ kDLFloat, 32, 1 }, ctx));
+            free_inputs_.push_back(i);
+            free_outputs_.push_back(i);
+        }
+
+        bind_input_ = mod_.GetFunction("bind_input");
+        bind_output_ = mod_.GetFunction("bind_output");
+        unbind_ = mod_.GetFunction("unbind");
+        run_ = mod_.GetFunction("run");
+        CHECK(bind_input_ != nullptr && bind_output_ != nullptr) << "bind_input requires a runtime created by graph_runtime_ext.cc";
+
+        stage_thread_ = std::thread(&AsyncRunner::StageLoop, this);
+        run_thread_ = std::thread(&AsyncRunner::RunLoop, this);
+        read_thread_ = std::thread(&AsyncRunner::ReadLoop, this);
+    }
+
+    ~AsyncRunner()
+    {
+        Drain();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        stage_thread_.join();
+        run_thread_.join();
+        read_thread_.join();
+        unbind_();
+    }
+
+    AsyncRunner(const AsyncRunner&) = delete;
+    AsyncRunner& operator=(const AsyncRunner&) = delete;
+
+    // Queue one input of input_size() floats (copied), blocks while
+    // max_in_flight requests are unfinished
+    std::future<Output> Submit(const float* input)
+    {
+        auto promise = std::make_shared<std::promise<Output>>();
+        std::future<Output> result = promise->get_future();
+        Enqueue(input, [promise](Output output, std::exception_ptr error) {
+            if (error)
+            {
+                promise->set_exception(error);
+            }
+            else
+            {
+                promise->set_value(std::move(output));
+            }
+        }, true);
+        return result;
+    }
+
+    void Submit(const float* input, Callback callback) { Enqueue(input, std::move(callback), true); }
+
+    // Like Submit, but returns false instead of blocking when max_in_flight
+    // requests are unfinished
+    bool TrySubmit(const float* input, Callback callback) { return Enqueue(input, std::move(callback), false); }
+
+    // Wait until every submitted request has finished
+    void Drain()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return in_flight_ == 0; });
+    }
+
+    std::size_t input_size() const { return in_size_; }
+    std::size_t output_size() const { return out_size_; }
+
+private:
+    struct Request
+    {
+        std::vector<float> input;
+        Callback callback;
+        int in{ -1 };  // input buffer
+        int out{ -1 }; // output buffer
+        std::exception_ptr error;
+    };
+
+    static DLTensor* Tensor(const tvm::runtime::NDArray& array) { return const_cast<DLTensor*>(array.operator->()); }
+
+    bool Enqueue(const float* input, Callback callback, bool block)
+    {
+        Request request;
+        request.input.assign(input, input + in_size_);
+        request.callback = std::move(callback);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (block)
+        {
+            cv_.wait(lock, [this] { return in_flight_ < opts_.max_in_flight; });
+        }
+        else if (in_flight_ >= opts_.max_in_flight)
+        {
+            return false;
+        }
+        in_flight_++;
+        submitted_.push_back(std::move(request));
+        lock.unlock();
+        cv_.notify_all();
+        return true;
+    }
+
+    // Wait for the next request of queue and, unless it failed, a free
+    // buffer of pool; false when stopped
+    bool Take(std::deque<Request>& queue, std::deque<int>* pool, Request& request, int* buffer = nullptr)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return stop_ || (!queue.empty() && (!pool || queue.front().error || !pool->empty())); });
+        if (queue.empty())
+        {
+            return false;
+        }
+        request = std::move(queue.front());
+        queue.pop_front();
+        if (pool && !request.error)
+        {
+            *buffer = pool->front();
+            pool->pop_front();
+        }
+        return true;
+    }
+
+    void Put(std::deque<Request>& queue, Request& request)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue.push_back(std::move(request));
+        }
+        cv_.notify_all();
+    }
+
+    void Release(std::deque<int>& pool, int buffer)
+    {
+        if (buffer >= 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pool.push_back(buffer);
+        }
+        cv_.notify_all();
+    }
+
+    void StageLoop()
+    {
+        Request request;
+        int buffer = -1;
+        while (Take(submitted_, &free_inputs_, request, &buffer))
+        {
+            request.in = buffer;
+            try
+            {
+                CHECK_EQ(TVMArrayCopyFromBytes(Tensor(inputs_[request.in]), request.input.data(), in_size_ * sizeof(float)), 0) << TVMGetLastError();
+            }
+            catch (...)
+            {
+                request.error = std::current_exception();
+                Release(free_inputs_, request.in);
+                request.in = -1;
+            }
+            Put(staged_, request);
+        }
+    }
+
+    void RunLoop()
+    {
+        Request request;
+        int buffer = -1;
+        while (Take(staged_, &free_outputs_, request, &buffer))
+        {
+            if (!request.error)
+            {
+                request.out = buffer;
+                try
+                {
+                    bind_input_(input_name_, Tensor(inputs_[request.in]));
+                    bind_output_(0, Tensor(outputs_[request.out]));
+                    run_();
+                }
+                catch (...)
+                {
+                    request.error = std::current_exception();
+                }
+            }
+            Release(free_inputs_, request.in);
+            request.in = -1;
+            Put(ran_, request);
+        }
+    }
+
+    void ReadLoop()
+    {
+        Request request;
+        while (Take(ran_, nullptr, request))
+        {
+            Output output;
+            if (!request.error)
+            {
+                try
+                {
+                    output.resize(out_size_);
+                    CHECK_EQ(TVMArrayCopyToBytes(Tensor(outputs_[request.out]), output.data(), out_size_ * sizeof(float)), 0) << TVMGetLastError();
+                }
+                catch (...)
+                {
+                    request.error = std::current_exception();
+                    output.clear();
+                }
+            }
+            Release(free_outputs_, request.out);
+
+            request.callback(std::move(output), request.error);
+            request = Request();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                in_flight_--;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    tvm::runtime::Module mod_;
+    AsyncRunnerOptions opts_;
+    std::string input_name_;
+    std::size_t in_size_{ 0 }, out_size_{ 0 };
+
+    tvm::runtime::PackedFunc bind_input_, bind_output_, unbind_, run_;
+    std::vector<tvm::runtime::NDArray> inputs_, outputs_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<int> free_inputs_, free_outputs_;
+    std::deque<Request> submitted_, staged_, ran_;
+    int in_flight_{ 0 };
+    bool stop_{ false };
+
+    std::thread stage_thread_, run_thread_, read_thread_;
+};
+
+#endif // __async_runner_h__
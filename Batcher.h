@@ -0,0 +1,225 @@
+#ifndef __batcher_h__
+#define __batcher_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+
+#include <dlpack/dlpack.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+
+  Dynamic request batching in front of a graph runtime.
+
+  Callers Submit() single samples (e.g. one 3x224x224 image).  A worker
+  thread takes the first queued request, then keeps collecting until either
+  max_batch requests are queued or max_wait has passed since the first one
+  arrived.  The batch is packed into the input of a graph compiled for a
+  fixed batch size (from_mxnet.py --batch N), run once, and the output rows
+  are scattered back to the callers' futures.  Unused slots of a partial
+  batch are zero filled.
+
+  The runtime is only ever touched by the worker thread.
+
+ */
+
+struct BatchingOptions
+{
+    int max_batch{ 0 }; // 0 : the batch size the graph was compiled for
+    std::chrono::microseconds max_wait{ 1000 };
+};
+
+class DynamicBatcher
+{
+public:
+    struct Result
+    {
+        std::vector<float> output;
+        int batch_size{ 0 }; // requests in the batch this one ran in
+    };
+
+    DynamicBatcher(tvm::runtime::Module mod, const GraphRuntimePrivateStuff& info, int device_type, int device_id, const BatchingOptions& opts, const std::string& input_name = "data")
+        : mod_(mod)
+        , opts_(opts)
+    {
+        uint32_t input_eid = info.num_node_entries();
+        for (auto nid : info.input_nodes_)
+        {
+            if (info.nodes_[nid].name == input_name)
+            {
+                input_eid = info.entry_id(nid, 0);
+            }
+        }
+        CHECK_LT(input_eid, info.num_node_entries()) << "no graph input " << input_name;
+
+        const auto& in_shape = info.attrs_.shape[input_eid];
+        const auto& out_shape = info.attrs_.shape[info.entry_id(info.outputs_.front())];
+        CHECK(parse_dltype(info.attrs_.dltype[input_eid]).code == kDLFloat) << "float32 input expected";
+
+        graph_batch_ = static_cast<int>(in_shape.front());
+        CHECK_EQ(out_shape.front(), graph_batch_) << "output batch does not match input batch";
+        if (opts_.max_batch <= 0 || opts_.max_batch > graph_batch_)
+        {
+            opts_.max_batch = graph_batch_;
+        }
+
+        in_sample_ = element_count(in_shape) / graph_batch_;
+        out_sample_ = element_count(out_shape) / graph_batch_;
+        input_.resize(element_count(in_shape));
+        output_.resize(element_count(out_shape));
+
+        TVMArrayAlloc(in_shape.data(), static_cast<int>(in_shape.size()), kDLFloat, 32, 1, device_type, device_id, &x_);
+        TVMArrayAlloc(out_shape.data(), static_cast<int>(out_shape.size()), kDLFloat, 32, 1, device_type, device_id, &y_);
+
+        input_name_ = input_name;
+        set_input_ = mod_.GetFunction("set_input");
+        run_ = mod_.GetFunction("run");
+        get_output_ = mod_.GetFunction("get_output");
+
+        worker_ = std::thread(&DynamicBatcher::Worker, this);
+    }
+
+    ~DynamicBatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+
+        TVMArrayFree(x_);
+        TVMArrayFree(y_);
+    }
+
+    DynamicBatcher(const DynamicBatcher&) = delete;
+    DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+    // Queue one sample of sample_size() floats, the data is copied
+    std::future<Result> Submit(const float* sample)
+    {
+        Request request;
+        request.input.assign(sample, sample + in_sample_);
+        request.enqueued = Clock::now();
+        std::future<Result> result = request.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(request));
+        }
+        cv_.notify_one();
+        return result;
+    }
+
+    int graph_batch() const { return graph_batch_; }
+    int max_batch() const { return opts_.max_batch; }
+    std::size_t sample_size() const { return in_sample_; }
+    std::size_t output_size() const { return out_sample_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request
+    {
+        std::vector<float> input;
+        std::promise<Result> promise;
+        Clock::time_point enqueued;
+    };
+
+    void Worker()
+    {
+        std::vector<Request> batch;
+        batch.reserve(opts_.max_batch);
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (stop_ && queue_.empty())
+                {
+                    return;
+                }
+
+                // Deadline starts with the oldest request, which may have
+                // waited through the previous batch already
+                const auto deadline = queue_.front().enqueued + opts_.max_wait;
+                cv_.wait_until(lock, deadline, [this] {
+                    return stop_ || static_cast<int>(queue_.size()) >= opts_.max_batch;
+                });
+
+                const std::size_t n = std::min<std::size_t>(queue_.size(), opts_.max_batch);
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+            }
+
+            Run(batch);
+            batch.clear();
+        }
+    }
+
+    void Run(std::vector<Request>& batch)
+    {
+        try
+        {
+            const std::size_t n = batch.size();
+            for (std::size_t i = 0; i < n; i++)
+            {
+                std::memcpy(&input_[i * in_sample_], batch[i].input.data(), in_sample_ * sizeof(float));
+            }
+            std::fill(input_.begin() + n * in_sample_, input_.end(), 0.f);
+
+            TVMArrayCopyFromBytes(x_, input_.data(), input_.size() * sizeof(float));
+            set_input_(input_name_, x_);
+            run_();
+            get_output_(0, y_);
+            TVMArrayCopyToBytes(y_, output_.data(), output_.size() * sizeof(float));
+
+            for (std::size_t i = 0; i < n; i++)
+            {
+                Result result;
+                result.output.assign(output_.begin() + i * out_sample_, output_.begin() + (i + 1) * out_sample_);
+                result.batch_size = static_cast<int>(n);
+                batch[i].promise.set_value(std::move(result));
+            }
+        }
+        catch (...)
+        {
+            for (auto& request : batch)
+            {
+                request.promise.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    tvm::runtime::Module mod_;
+    tvm::runtime::PackedFunc set_input_, run_, get_output_;
+    std::string input_name_;
+    BatchingOptions opts_;
+
+    int graph_batch_{ 1 };
+    std::size_t in_sample_{ 0 }, out_sample_{ 0 };
+    std::vector<float> input_, output_; // host staging for a full batch
+    DLTensor* x_{ nullptr };
+    DLTensor* y_{ nullptr };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Request> queue_;
+    bool stop_{ false };
+    std::thread worker_;
+};
+
+#endif // __batcher_h__
@@ -0,0 +1,114 @@
+#ifndef __benchmark_h__
+#define __benchmark_h__
+
+#include <dmlc/json.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+
+  Latency statistics for the benchmark mode of tvm_deploy_gpu_sample.
+
+  Timings are collected per iteration (in seconds) and reduced here to
+  the usual percentile summary.  Everything is reported in milliseconds
+  except throughput, which is inferences per second over the timed
+  iterations.
+
+ */
+
+struct LatencyStats
+{
+    std::size_t count{ 0 };
+    double total{ 0.0 }; // seconds
+    double mean{ 0.0 };
+    double stddev{ 0.0 };
+    double min{ 0.0 };
+    double p50{ 0.0 };
+    double p90{ 0.0 };
+    double p99{ 0.0 };
+    double max{ 0.0 };
+    double throughput{ 0.0 }; // inferences per second
+
+    // Nearest rank percentile, p in [0, 100], expects sorted input
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+        {
+            return 0.0;
+        }
+
+        std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * sorted.size()));
+        rank = std::max<std::size_t>(rank, 1);
+        return sorted[std::min(rank, sorted.size()) - 1];
+    }
+
+    // Samples are in seconds, batch is the number of inferences per sample
+    static LatencyStats compute(std::vector<double> samples, int batch = 1)
+    {
+        LatencyStats stats;
+        if (samples.empty())
+        {
+            return stats;
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        const double n = static_cast<double>(samples.size());
+        stats.count = samples.size();
+        stats.total = std::accumulate(samples.begin(), samples.end(), 0.0);
+
+        double mean = stats.total / n;
+        double sq = 0.0;
+        for (auto s : samples)
+        {
+            sq += (s - mean) * (s - mean);
+        }
+
+        constexpr double ms = 1e3;
+        stats.mean = mean * ms;
+        stats.stddev = std::sqrt(sq / n) * ms;
+        stats.min = samples.front() * ms;
+        stats.p50 = percentile(samples, 50.0) * ms;
+        stats.p90 = percentile(samples, 90.0) * ms;
+        stats.p99 = percentile(samples, 99.0) * ms;
+        stats.max = samples.back() * ms;
+        stats.throughput = (stats.total > 0.0) ? (n * batch / stats.total) : 0.0;
+        return stats;
+    }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("count", count);
+        writer->WriteObjectKeyValue("mean_ms", mean);
+        writer->WriteObjectKeyValue("stddev_ms", stddev);
+        writer->WriteObjectKeyValue("min_ms", min);
+        writer->WriteObjectKeyValue("p50_ms", p50);
+        writer->WriteObjectKeyValue("p90_ms", p90);
+        writer->WriteObjectKeyValue("p99_ms", p99);
+        writer->WriteObjectKeyValue("max_ms", max);
+        writer->WriteObjectKeyValue("throughput", throughput);
+        writer->EndObject();
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const LatencyStats& stats)
+{
+    os << "count: " << stats.count
+       << " mean: " << stats.mean
+       << " stddev: " << stats.stddev
+       << " min: " << stats.min
+       << " p50: " << stats.p50
+       << " p90: " << stats.p90
+       << " p99: " << stats.p99
+       << " max: " << stats.max
+       << " (ms) throughput: " << stats.throughput << " (1/s)";
+    return os;
+}
+
+#endif // __benchmark_h__
@@ -0,0 +1,44 @@
+#ifndef __benchmark_args_h__
+#define __benchmark_args_h__
+
+#include <dmlc/logging.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+
+  Command line helpers shared by the benchmark tools (tvm_*_bench,
+  tvm_load_gen, tvm_cost_model): comma separated sweep lists and the
+  float32 input file written by from_mxnet.py.
+
+ */
+
+// "1,2,4,8" -> { 1, 2, 4, 8 }, values below minimum are raised to it
+inline std::vector<int> parse_list(const std::string& value, int minimum = 1)
+{
+    std::vector<int> values;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+        {
+            values.push_back(std::max(std::atoi(item.c_str()), minimum));
+        }
+    }
+    return values;
+}
+
+// Fill input (sized by the caller to the graph input) from a raw float32 file
+inline void read_input_file(const std::string& filename, std::vector<float>& input)
+{
+    std::ifstream data_fin(filename, std::ios::binary);
+    CHECK(data_fin.read(reinterpret_cast<char*>(input.data()), input.size() * sizeof(float))) << "Failed to read input file " << filename;
+}
+
+#endif // __benchmark_args_h__
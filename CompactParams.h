@@ -0,0 +1,388 @@
+#ifndef __compact_params_h__
+#define __compact_params_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+
+#include <dlpack/dlpack.h>
+#include <dmlc/logging.h>
+#include <tvm/runtime/c_runtime_api.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/ndarray.h>
+#include <tvm/runtime/packed_func.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) // plain -m32 has no SSE2
+#include <immintrin.h>
+#define TCT_PARAMS_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define TCT_PARAMS_NEON 1
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+
+  Compact parameter file: the weights of from_mxnet.params stored as fp16,
+  bf16 or int8 with one scale per index of the first axis (the output
+  channel, or output channel block for NCHWc kernels), written by
+  from_mxnet.py --param-format and expanded to fp32 at load time straight
+  into the runtime's parameter tensors (CPU) or through one staging buffer.
+
+    magic "TCTPARM1", uint32 version, uint32 tensor count
+    per tensor: uint32 name length, name, uint32 encoding, uint32 ndim,
+                int64 shape[ndim], uint64 payload bytes, payload
+    payload    : fp32 / fp16 / bf16 values, or for int8
+                 float scale[shape[0]] followed by int8 values
+
+  Little endian.  Tensors where quantization would not save anything (e.g.
+  one value per channel biases) stay fp32 in an int8 file.
+
+  The expansion loops use F16C (checked at run time) or SSE2 on x86 and
+  NEON on aarch64, with a scalar fallback, so they are vectorized in Debug
+  builds too.
+
+ */
+
+namespace compact_params
+{
+    constexpr char kMagic[8] = { 'T', 'C', 'T', 'P', 'A', 'R', 'M', '1' };
+    constexpr uint32_t kVersion = 1;
+
+    enum class Encoding : uint32_t
+    {
+        Float32 = 0,
+        Float16 = 1,
+        BFloat16 = 2,
+        Int8 = 3
+    };
+
+    inline const char* encoding_name(Encoding encoding)
+    {
+        switch (encoding)
+        {
+            case Encoding::Float32: return "fp32";
+            case Encoding::Float16: return "fp16";
+            case Encoding::BFloat16: return "bf16";
+            case Encoding::Int8: return "int8";
+        }
+        return "";
+    }
+
+    struct Tensor
+    {
+        std::string name;
+        Encoding encoding{ Encoding::Float32 };
+        std::vector<int64_t> shape;
+        const char* payload{ nullptr };
+        uint64_t payload_bytes{ 0 };
+    };
+
+    inline bool is_compact(const char* data, std::size_t size)
+    {
+        return size >= sizeof(kMagic) && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+    }
+
+    // Index of a mapped compact file, the payloads point into data
+    inline std::vector<Tensor> parse(const char* data, std::size_t size)
+    {
+        const char* ptr = data;
+        const char* end = data + size;
+        auto read = [&](void* out, std::size_t nbytes) {
+            CHECK_LE(nbytes, static_cast<std::size_t>(end - ptr)) << "corrupt compact parameter file";
+            std::memcpy(out, ptr, nbytes);
+            ptr += nbytes;
+        };
+
+        CHECK(is_compact(data, size)) << "not a compact parameter file";
+        ptr += sizeof(kMagic);
+        uint32_t version = 0, count = 0;
+        read(&version, sizeof(version));
+        CHECK_EQ(version, kVersion) << "unsupported compact parameter file version";
+        read(&count, sizeof(count));
+
+        std::vector<Tensor> tensors(count);
+        for (auto& t : tensors)
+        {
+            uint32_t length = 0, encoding = 0, ndim = 0;
+            read(&length, sizeof(length));
+            CHECK_LE(length, static_cast<std::size_t>(end - ptr)) << "corrupt compact parameter file";
+            t.name.assign(ptr, length);
+            ptr += length;
+
+            read(&encoding, sizeof(encoding));
+            CHECK_LE(encoding, static_cast<uint32_t>(Encoding::Int8)) << "unknown parameter encoding " << encoding;
+            t.encoding = static_cast<Encoding>(encoding);
+
+            read(&ndim, sizeof(ndim));
+            CHECK_LE(ndim, 8u) << "corrupt compact parameter file";
+            t.shape.resize(ndim);
+            read(t.shape.data(), ndim * sizeof(int64_t));
+
+            read(&t.payload_bytes, sizeof(t.payload_bytes));
+            CHECK_LE(t.payload_bytes, static_cast<uint64_t>(end - ptr)) << "corrupt compact parameter file";
+            t.payload = ptr;
+            ptr += t.payload_bytes;
+        }
+        return tensors;
+    }
+
+    inline float half_to_float(uint16_t h)
+    {
+        const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+        uint32_t exponent = (h >> 10) & 0x1fu;
+        uint32_t mantissa = h & 0x3ffu;
+        uint32_t bits = sign;
+        if (exponent == 0x1f)
+        {
+            bits |= 0x7f800000u | (mantissa << 13); // inf, nan
+        }
+        else if (exponent != 0)
+        {
+            bits |= ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else if (mantissa != 0) // subnormal
+        {
+            exponent = 113;
+            while ((mantissa & 0x400u) == 0)
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits |= (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+#if TCT_PARAMS_X86
+    __attribute__((target("avx,f16c"))) inline std::size_t half_to_float_f16c(const uint16_t* src, float* dst, std::size_t n)
+    {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+        }
+        return i;
+    }
+#endif
+
+    inline void half_to_float(const uint16_t* src, float* dst, std::size_t n)
+    {
+        std::size_t i = 0;
+#if TCT_PARAMS_X86
+        static const bool f16c = __builtin_cpu_supports("f16c");
+        if (f16c)
+        {
+            i = half_to_float_f16c(src, dst, n);
+        }
+#elif TCT_PARAMS_NEON
+        for (; i + 4 <= n; i += 4)
+        {
+            vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            dst[i] = half_to_float(src[i]);
+        }
+    }
+
+    // bf16 is the upper half of an fp32
+    inline void bfloat16_to_float(const uint16_t* src, float* dst, std::size_t n)
+    {
+        std::size_t i = 0;
+#if TCT_PARAMS_X86
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(zero, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(zero, v));
+        }
+#elif TCT_PARAMS_NEON
+        for (; i + 4 <= n; i += 4)
+        {
+            vst1q_u32(reinterpret_cast<uint32_t*>(dst + i), vshll_n_u16(vld1_u16(src + i), 16));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            const uint32_t bits = static_cast<uint32_t>(src[i]) << 16;
+            std::memcpy(dst + i, &bits, sizeof(bits));
+        }
+    }
+
+    inline void int8_to_float(const int8_t* src, float scale, float* dst, std::size_t n)
+    {
+        std::size_t i = 0;
+#if TCT_PARAMS_X86
+        const __m128 s = _mm_set1_ps(scale);
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            // sign extend 8 -> 16 -> 32 bits (SSE2 has no pmovsx)
+            const __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+            const __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+            const __m128i parts[4] = { _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16), _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16),
+                                       _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16), _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16) };
+            for (int k = 0; k < 4; k++)
+            {
+                _mm_storeu_ps(dst + i + 4 * k, _mm_mul_ps(_mm_cvtepi32_ps(parts[k]), s));
+            }
+        }
+#elif TCT_PARAMS_NEON
+        for (; i + 8 <= n; i += 8)
+        {
+            const int16x8_t v = vmovl_s8(vld1_s8(src + i));
+            vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+            vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            dst[i] = src[i] * scale;
+        }
+    }
+
+    // Expand t into element_count(t.shape) floats
+    inline void expand(const Tensor& t, float* dst)
+    {
+        const std::size_t n = element_count(t.shape);
+        switch (t.encoding)
+        {
+            case Encoding::Float32:
+                CHECK_EQ(t.payload_bytes, n * sizeof(float)) << "corrupt tensor " << t.name;
+                std::memcpy(dst, t.payload, n * sizeof(float));
+                break;
+            case Encoding::Float16:
+            case Encoding::BFloat16:
+            {
+                CHECK_EQ(t.payload_bytes, n * sizeof(uint16_t)) << "corrupt tensor " << t.name;
+                std::vector<uint16_t> aligned; // the payload is only 2 byte aligned by chance
+                const uint16_t* src = reinterpret_cast<const uint16_t*>(t.payload);
+                if (reinterpret_cast<uintptr_t>(src) % alignof(uint16_t))
+                {
+                    aligned.resize(n);
+                    std::memcpy(aligned.data(), t.payload, n * sizeof(uint16_t));
+                    src = aligned.data();
+                }
+                if (t.encoding == Encoding::Float16)
+                {
+                    half_to_float(src, dst, n);
+                }
+                else
+                {
+                    bfloat16_to_float(src, dst, n);
+                }
+                break;
+            }
+            case Encoding::Int8:
+            {
+                CHECK(!t.shape.empty() && t.shape[0] > 0) << "int8 tensor without channels " << t.name;
+                const std::size_t channels = static_cast<std::size_t>(t.shape[0]);
+                const std::size_t per_channel = n / channels;
+                CHECK_EQ(t.payload_bytes, channels * sizeof(float) + n) << "corrupt tensor " << t.name;
+                std::vector<float> scales(channels);
+                std::memcpy(scales.data(), t.payload, channels * sizeof(float));
+                const int8_t* values = reinterpret_cast<const int8_t*>(t.payload + channels * sizeof(float));
+                for (std::size_t c = 0; c < channels; c++)
+                {
+                    int8_to_float(values + c * per_channel, scales[c], dst + c * per_channel, per_channel);
+                }
+                break;
+            }
+        }
+    }
+
+    inline std::vector<std::string> tensor_names(const char* data, std::size_t size)
+    {
+        std::vector<std::string> names;
+        for (const auto& t : parse(data, size))
+        {
+            names.push_back(t.name);
+        }
+        return names;
+    }
+}
+
+struct CompactParamStats
+{
+    std::size_t file_bytes{ 0 };
+    std::size_t float32_bytes{ 0 }; // size of the expanded parameters
+    std::size_t tensors[4]{ 0, 0, 0, 0 }; // per compact_params::Encoding
+    double expand_s{ 0.0 };
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        using compact_params::Encoding;
+        using compact_params::encoding_name;
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("file_bytes", file_bytes);
+        writer->WriteObjectKeyValue("float32_bytes", float32_bytes);
+        for (auto e : { Encoding::Float32, Encoding::Float16, Encoding::BFloat16, Encoding::Int8 })
+        {
+            writer->WriteObjectKeyValue(std::string(encoding_name(e)) + "_tensors", tensors[static_cast<int>(e)]);
+        }
+        writer->WriteObjectKeyValue("expand_s", expand_s);
+        writer->EndObject();
+    }
+};
+
+// Expand a mapped compact parameter file into the parameter inputs of mod
+inline CompactParamStats load_compact_params(tvm::runtime::Module& mod, const GraphRuntimePrivateStuff& info, const char* data, std::size_t size)
+{
+    auto tic = std::chrono::high_resolution_clock::now();
+
+    CompactParamStats stats;
+    stats.file_bytes = size;
+
+    tvm::runtime::PackedFunc get_input = mod.GetFunction("get_input");
+    CHECK(get_input != nullptr) << "graph runtime without get_input";
+
+    std::vector<float> staging;
+    for (const auto& t : compact_params::parse(data, size))
+    {
+        int index = -1;
+        for (std::size_t i = 0; i < info.input_nodes_.size(); i++)
+        {
+            if (info.nodes_[info.input_nodes_[i]].name == t.name)
+            {
+                index = static_cast<int>(i);
+            }
+        }
+        CHECK_GE(index, 0) << "parameter " << t.name << " is not a graph input";
+
+        const uint32_t eid = info.entry_id(info.input_nodes_[index], 0);
+        CHECK(info.attrs_.shape[eid] == t.shape) << "shape mismatch for parameter " << t.name;
+        CHECK(parse_dltype(info.attrs_.dltype[eid]).code == kDLFloat && parse_dltype(info.attrs_.dltype[eid]).bits == 32) << "float32 parameter expected: " << t.name;
+
+        tvm::runtime::NDArray param = get_input(index);
+        DLTensor* tensor = const_cast<DLTensor*>(param.operator->());
+        const std::size_t n = element_count(t.shape);
+        if (tensor->ctx.device_type == kDLCPU)
+        {
+            compact_params::expand(t, reinterpret_cast<float*>(static_cast<char*>(tensor->data) + tensor->byte_offset));
+        }
+        else
+        {
+            staging.resize(n);
+            compact_params::expand(t, staging.data());
+            TVMArrayCopyFromBytes(tensor, staging.data(), n * sizeof(float));
+        }
+
+        stats.float32_bytes += n * sizeof(float);
+        stats.tensors[static_cast<int>(t.encoding)]++;
+    }
+
+    stats.expand_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tic).count();
+    return stats;
+}
+
+#endif // __compact_params_h__
@@ -0,0 +1,338 @@
+#ifndef __cost_model_h__
+#define __cost_model_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+
+#include <dmlc/json.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+  Static cost model of a compiled graph and a roofline view of the
+  measured per node times.
+
+  The graph only keeps the fused kernel name and the shapes of its entries,
+  so the op is recognized from func_name and the work is derived from the
+  shapes:
+
+    conv2d, dense  2 * output elements * (weight elements / output channels),
+                   which holds for NCHW, NCHWc, depthwise and grouped
+                   convolutions and for dense (output channels = units)
+    pooling        one op per input element
+    softmax        5 ops per element (max, subtract, exp, sum, divide)
+    elementwise    one op per output element and fused elementwise op
+                   (add, relu, multiply, ...), also added to the above
+    copies         layout_transform, flatten, reshape, ...: no ops
+
+  Memory traffic is the compulsory traffic: every input entry (weights
+  included) read once and every output written once.  Cache misses and
+  re-reads only add to it, so the achieved bandwidth is a lower bound.
+
+  With a machine peak (GFLOP/s and GB/s) the roofline bounds every node by
+  min(peak GFLOP/s, intensity * peak GB/s): nodes left of the ridge point
+  (intensity < peak GFLOP/s / peak GB/s) are memory bound, the others are
+  compute bound, and the achieved fraction of that bound shows how much a
+  better schedule could still gain.
+
+ */
+
+enum class OpKind
+{
+    Conv2d,
+    Dense,
+    Pool,
+    Softmax,
+    Elementwise,
+    Copy
+};
+
+inline const char* op_kind_name(OpKind kind)
+{
+    switch (kind)
+    {
+        case OpKind::Conv2d: return "conv2d";
+        case OpKind::Dense: return "dense";
+        case OpKind::Pool: return "pool";
+        case OpKind::Softmax: return "softmax";
+        case OpKind::Elementwise: return "elemwise";
+        case OpKind::Copy: return "copy";
+    }
+    return "";
+}
+
+struct OpCost
+{
+    uint32_t node_id{ 0 };
+    std::string name;
+    std::string func_name;
+    OpKind kind{ OpKind::Elementwise };
+    double flops{ 0.0 };
+    double bytes{ 0.0 }; // compulsory memory traffic
+
+    double intensity() const { return (bytes > 0.0) ? (flops / bytes) : 0.0; }
+};
+
+// Sustained machine limits, see measure_machine_peak()
+struct MachinePeak
+{
+    double gflops{ 0.0 };
+    double gbs{ 0.0 };
+
+    double ridge() const { return (gbs > 0.0) ? (gflops / gbs) : 0.0; }
+
+    // Roofline bound in GFLOP/s at the given intensity (flop / byte)
+    double attainable(double intensity) const { return std::min(gflops, intensity * gbs); }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("gflops", gflops);
+        writer->WriteObjectKeyValue("gbs", gbs);
+        writer->WriteObjectKeyValue("ridge_flop_per_byte", ridge());
+        writer->EndObject();
+    }
+};
+
+namespace cost_model
+{
+    inline std::vector<std::string> tokens(const std::string& func_name)
+    {
+        std::vector<std::string> result;
+        std::stringstream ss(func_name);
+        std::string token;
+        while (std::getline(ss, token, '_'))
+        {
+            if (!token.empty())
+            {
+                result.push_back(token);
+            }
+        }
+        return result;
+    }
+
+    inline bool has_token(const std::vector<std::string>& tokens, const char* name)
+    {
+        return std::find(tokens.begin(), tokens.end(), name) != tokens.end();
+    }
+
+    // Fused elementwise ops in a kernel name
+    inline int elementwise_ops(const std::vector<std::string>& tokens)
+    {
+        static const std::set<std::string> ops{ "add", "sub", "subtract", "mul", "multiply", "div", "divide", "relu", "clip", "exp", "log", "sqrt", "rsqrt", "negative", "tanh", "sigmoid", "maximum", "minimum" };
+        int count = 0;
+        for (const auto& token : tokens)
+        {
+            count += static_cast<int>(ops.count(token));
+        }
+        return count;
+    }
+
+    inline OpKind classify(const std::string& func_name, const std::vector<std::string>& tokens)
+    {
+        if (func_name.find("conv2d") != std::string::npos)
+        {
+            return OpKind::Conv2d;
+        }
+        if (has_token(tokens, "dense"))
+        {
+            return OpKind::Dense;
+        }
+        if (func_name.find("pool") != std::string::npos)
+        {
+            return OpKind::Pool;
+        }
+        if (func_name.find("softmax") != std::string::npos)
+        {
+            return OpKind::Softmax;
+        }
+        for (const char* copy : { "layout", "flatten", "reshape", "transpose", "concatenate", "copy", "nop", "squeeze", "expand" })
+        {
+            if (func_name.find(copy) != std::string::npos && elementwise_ops(tokens) == 0)
+            {
+                return OpKind::Copy;
+            }
+        }
+        return OpKind::Elementwise;
+    }
+}
+
+inline std::vector<OpCost> estimate_costs(const GraphRuntimePrivateStuff& info)
+{
+    using namespace cost_model;
+
+    std::vector<OpCost> costs;
+    for (uint32_t nid = 0; nid < info.nodes_.size(); nid++)
+    {
+        const auto& node = info.nodes_[nid];
+        if (node.op_type == "null")
+        {
+            continue;
+        }
+
+        OpCost cost;
+        cost.node_id = nid;
+        cost.name = node.name;
+        cost.func_name = node.param.func_name;
+        if (cost.func_name == "__nop")
+        {
+            cost.kind = OpKind::Copy; // in place, no kernel
+            costs.push_back(cost);
+            continue;
+        }
+
+        const auto t = tokens(cost.func_name);
+        cost.kind = classify(cost.func_name, t);
+
+        std::vector<double> in_elems;
+        for (const auto& e : node.inputs)
+        {
+            const uint32_t eid = info.entry_id(e);
+            in_elems.push_back(static_cast<double>(element_count(info.attrs_.shape[eid])));
+            cost.bytes += byte_size(parse_dltype(info.attrs_.dltype[eid]), info.attrs_.shape[eid]);
+        }
+
+        double out_elems = 0.0;
+        for (uint32_t index = 0; index < node.param.num_outputs; index++)
+        {
+            const uint32_t eid = info.entry_id(nid, index);
+            out_elems += static_cast<double>(element_count(info.attrs_.shape[eid]));
+            cost.bytes += byte_size(parse_dltype(info.attrs_.dltype[eid]), info.attrs_.shape[eid]);
+        }
+
+        const double total_in = std::accumulate(in_elems.begin(), in_elems.end(), 0.0);
+        const auto& out_shape = info.attrs_.shape[info.entry_id(nid, 0)];
+        switch (cost.kind)
+        {
+            case OpKind::Conv2d:
+            case OpKind::Dense:
+            {
+                // Output channels: everything but batch and spatial dimensions
+                double channels = static_cast<double>(out_shape.back());
+                if (cost.kind == OpKind::Conv2d && out_shape.size() >= 4)
+                {
+                    channels = out_elems / static_cast<double>(out_shape[0] * out_shape[2] * out_shape[3]);
+                }
+                const double weights = (in_elems.size() > 1) ? in_elems[1] : 0.0;
+                cost.flops = 2.0 * out_elems * weights / std::max(channels, 1.0);
+                cost.flops += out_elems * elementwise_ops(t);
+                break;
+            }
+            case OpKind::Pool:
+                cost.flops = total_in + out_elems * elementwise_ops(t);
+                break;
+            case OpKind::Softmax:
+                cost.flops = 5.0 * out_elems;
+                break;
+            case OpKind::Elementwise:
+                cost.flops = out_elems * std::max(elementwise_ops(t), 1);
+                break;
+            case OpKind::Copy:
+                break;
+        }
+        costs.push_back(cost);
+    }
+    return costs;
+}
+
+namespace cost_model
+{
+    // Independent multiply-add chains, enough to fill the FMA pipelines
+    // once vectorized (-O3, see CMakeLists.txt)
+    inline double fma_kernel(long iterations)
+    {
+        constexpr int kChains = 64;
+        float acc[kChains];
+        for (int j = 0; j < kChains; j++)
+        {
+            acc[j] = static_cast<float>(j);
+        }
+        const float m = 0.999999f, c = 1e-6f;
+        for (long i = 0; i < iterations; i++)
+        {
+            for (int j = 0; j < kChains; j++)
+            {
+                acc[j] = acc[j] * m + c;
+            }
+        }
+        double sum = 0.0;
+        for (int j = 0; j < kChains; j++)
+        {
+            sum += acc[j];
+        }
+        return sum; // stored by the caller, so the loop is not removed
+    }
+
+    // STREAM triad, 3 * n * sizeof(float) bytes moved
+    inline void triad(float* a, const float* b, const float* c, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            a[i] = b[i] + 3.f * c[i];
+        }
+    }
+
+    // Best of repeats of f() run on threads threads, in seconds
+    template <typename F>
+    double best_time(int threads, int repeats, F f)
+    {
+        using Clock = std::chrono::high_resolution_clock;
+        double best = 0.0;
+        for (int r = 0; r < repeats; r++)
+        {
+            auto tic = Clock::now();
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++)
+            {
+                workers.emplace_back(f, t);
+            }
+            for (auto& w : workers)
+            {
+                w.join();
+            }
+            const double elapsed = std::chrono::duration<double>(Clock::now() - tic).count();
+            best = (r == 0) ? elapsed : std::min(best, elapsed);
+        }
+        return best;
+    }
+}
+
+// Sustained single precision GFLOP/s and triad GB/s with threads threads:
+// a practical peak of this build and machine, below the datasheet numbers
+inline MachinePeak measure_machine_peak(int threads)
+{
+    using namespace cost_model;
+    threads = std::max(threads, 1);
+
+    MachinePeak peak;
+
+    constexpr long kIterations = 1 << 22;
+    std::vector<double> sink(threads);
+    const double flop_time = best_time(threads, 3, [&](int t) { sink[t] = fma_kernel(kIterations); });
+    peak.gflops = 2.0 * 64 * kIterations * threads / flop_time * 1e-9;
+
+    // 3 arrays of 64 MiB in total (at least 4 MiB per thread), well beyond
+    // the last level cache
+    const std::size_t n = std::max((std::size_t(64) << 20) / threads, std::size_t(4) << 20) / sizeof(float);
+    std::vector<std::vector<float>> a(threads), b(threads), c(threads);
+    for (int t = 0; t < threads; t++)
+    {
+        a[t].assign(n, 0.f);
+        b[t].assign(n, 1.f);
+        c[t].assign(n, 2.f);
+    }
+    const double stream_time = best_time(threads, 5, [&](int t) { triad(a[t].data(), b[t].data(), c[t].data(), n); });
+    peak.gbs = 3.0 * n * sizeof(float) * threads / stream_time * 1e-9;
+    return peak;
+}
+
+#endif // __cost_model_h__
@@ -0,0 +1,222 @@
+#ifndef __dag_executor_h__
+#define __dag_executor_h__
+
+#include "ExecutionDag.h"
+#include "ThreadConfig.h"
+
+#include <dmlc/logging.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+
+  Work stealing executor for an ExecutionDag (ExecutionDag.h): Run() calls
+  the task of every operator once all its predecessors have finished, on a
+  fixed set of worker threads.
+
+  Each worker keeps the operators it made ready in a deque of its own and
+  takes the newest first, so a chain of operators stays on one thread with
+  its data in that core's cache; an idle worker steals the oldest operator
+  of another worker, typically the start of another branch.  During a run
+  idle workers poll (yielding the core), between runs they sleep.
+
+  Every worker launches its operators' parallel loops on a TVM thread pool
+  of its own, threads_per_worker threads (set_worker_pools in
+  ThreadConfig.h); the operators' workspace pools are per thread as well.
+
+ */
+
+class DagExecutor
+{
+public:
+    DagExecutor(const ExecutionDag& dag, int workers, int threads_per_worker = 1)
+        : dag_(dag)
+        , pending_(new std::atomic<uint32_t>[dag.num_predecessors.size()])
+    {
+        CHECK_GE(workers, 1);
+        set_worker_pools(threads_per_worker);
+
+        for (int w = 0; w < workers; w++)
+        {
+            queues_.emplace_back(new Queue());
+        }
+        for (int w = 0; w < workers; w++)
+        {
+            threads_.emplace_back(&DagExecutor::Worker, this, w);
+        }
+    }
+
+    ~DagExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        start_cv_.notify_all();
+        for (auto& t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    DagExecutor(const DagExecutor&) = delete;
+    DagExecutor& operator=(const DagExecutor&) = delete;
+
+    // Run tasks[nid] for every operator of the DAG, rethrows the first error
+    void Run(const std::vector<std::function<void()>>& tasks)
+    {
+        if (dag_.ops.empty())
+        {
+            return;
+        }
+
+        tasks_ = &tasks;
+        error_ = nullptr;
+        for (auto nid : dag_.ops)
+        {
+            pending_[nid].store(dag_.num_predecessors[nid], std::memory_order_relaxed);
+        }
+        remaining_.store(dag_.ops.size());
+        for (std::size_t i = 0; i < dag_.roots.size(); i++)
+        {
+            Push(static_cast<int>(i % queues_.size()), dag_.roots[i]);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        generation_++;
+        start_cv_.notify_all();
+        done_cv_.wait(lock, [this] { return remaining_.load() == 0; });
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    int workers() const { return static_cast<int>(queues_.size()); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> ready;
+    };
+
+    void Push(int w, uint32_t nid)
+    {
+        std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+        queues_[w]->ready.push_back(nid);
+    }
+
+    // Newest of the own queue, else the oldest of another one
+    bool Pop(int w, uint32_t& nid)
+    {
+        {
+            Queue& own = *queues_[w];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.ready.empty())
+            {
+                nid = own.ready.back();
+                own.ready.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t k = 1; k < queues_.size(); k++)
+        {
+            Queue& victim = *queues_[(w + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.ready.empty())
+            {
+                nid = victim.ready.front();
+                victim.ready.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Execute(int w, uint32_t nid)
+    {
+        try
+        {
+            const auto& task = (*tasks_)[nid];
+            if (task)
+            {
+                task();
+            }
+        }
+        catch (...)
+        {
+            // The run still completes, its results are not used
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = error_ ? error_ : std::current_exception();
+        }
+
+        for (auto next : dag_.successors[nid])
+        {
+            if (pending_[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                Push(w, next);
+            }
+        }
+        if (remaining_.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_cv_.notify_all();
+        }
+    }
+
+    void Worker(int w)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_)
+                {
+                    return;
+                }
+                seen = generation_;
+            }
+
+            uint32_t nid = 0;
+            while (remaining_.load() > 0)
+            {
+                if (Pop(w, nid))
+                {
+                    Execute(w, nid);
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    const ExecutionDag& dag_;
+    std::unique_ptr<std::atomic<uint32_t>[]> pending_; // per node, unfinished predecessors
+    std::vector<std::unique_ptr<Queue>> queues_;       // per worker
+    std::vector<std::thread> threads_;
+
+    const std::vector<std::function<void()>>* tasks_{ nullptr };
+    std::atomic<std::size_t> remaining_{ 0 };
+    std::exception_ptr error_;
+
+    std::mutex mutex_;
+    std::condition_variable start_cv_, done_cv_;
+    uint64_t generation_{ 0 };
+    bool stop_{ false };
+};
+
+#endif // __dag_executor_h__
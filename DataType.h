@@ -0,0 +1,83 @@
+#ifndef __data_type_h__
+#define __data_type_h__
+
+#include <dlpack/dlpack.h>
+#include <dmlc/logging.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*
+
+  Helpers for the dltype strings and shapes found in the graph attrs_.
+
+ */
+
+// Parse TVM dltype strings ("float32", "int8", "uint8x4", ...)
+inline DLDataType parse_dltype(const std::string& s)
+{
+    DLDataType t;
+    t.lanes = 1;
+    const char* scan = s.c_str();
+    if (s.compare(0, 5, "float") == 0)
+    {
+        t.code = kDLFloat;
+        scan += 5;
+    }
+    else if (s.compare(0, 4, "uint") == 0)
+    {
+        t.code = kDLUInt;
+        scan += 4;
+    }
+    else if (s.compare(0, 3, "int") == 0)
+    {
+        t.code = kDLInt;
+        scan += 3;
+    }
+    else
+    {
+        LOG(FATAL) << "unsupported dltype " << s;
+    }
+
+    char* end = nullptr;
+    t.bits = static_cast<uint8_t>(std::strtoul(scan, &end, 10));
+    if (end == scan)
+    {
+        t.bits = 32;
+    }
+    if (*end == 'x')
+    {
+        t.lanes = static_cast<uint16_t>(std::strtoul(end + 1, nullptr, 10));
+    }
+    return t;
+}
+
+inline std::string dltype_string(DLDataType t)
+{
+    std::string s = (t.code == kDLFloat) ? "float" : ((t.code == kDLUInt) ? "uint" : "int");
+    s += std::to_string(t.bits);
+    if (t.lanes > 1)
+    {
+        s += "x" + std::to_string(t.lanes);
+    }
+    return s;
+}
+
+inline std::size_t element_count(const std::vector<int64_t>& shape)
+{
+    std::size_t total = 1;
+    for (auto d : shape)
+    {
+        total *= static_cast<std::size_t>(d);
+    }
+    return total;
+}
+
+inline std::size_t byte_size(DLDataType t, const std::vector<int64_t>& shape)
+{
+    return element_count(shape) * ((t.bits * t.lanes + 7) / 8);
+}
+
+#endif // __data_type_h__
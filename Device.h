@@ -0,0 +1,23 @@
+#ifndef __device_h__
+#define __device_h__
+
+#include <dlpack/dlpack.h>
+
+// The TVM device for the configured TVM_<KIND>_RUNTIME back-end (see CMakeLists.txt)
+#if defined(TVM_OPENCL_RUNTIME)
+constexpr int kDeviceType = kDLOpenCL;
+#elif defined(TVM_OPENGL_RUNTIME)
+constexpr int kDeviceType = 11; // kDLOpenGL;
+#elif defined(TVM_VULKAN_RUNTIME)
+constexpr int kDeviceType = kDLVulkan;
+#elif defined(TVM_METAL_RUNTIME)
+constexpr int kDeviceType = kDLMetal;
+#elif defined(TVM_CUDA_RUNTIME)
+constexpr int kDeviceType = kDLGPU;
+#elif defined(TVM_CPU_RUNTIME)
+constexpr int kDeviceType = kDLCPU;
+#else
+#  error Must define a valid TVM_<KIND>_RUNTIME flag, see CMakeLists.txt
+#endif
+
+#endif // __device_h__
@@ -0,0 +1,159 @@
+#ifndef __execution_dag_h__
+#define __execution_dag_h__
+
+#include "GraphRuntime.h"
+
+#include <dmlc/json.h>
+#include <dmlc/logging.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*
+
+  The operator dependency DAG of a graph, for running independent branches
+  concurrently (DagExecutor.h) with the results of the sequential run.
+
+  An operator waits for
+  - the producers of its inputs and its control_deps,
+  - and, because the memory planner lets entries share a storage_id when
+    their lifetimes do not overlap in node order, for the previous writer of
+    every storage it writes and for every reader of that storage since
+    (write after write, write after read).
+
+  So every storage sees its writes and reads in node order, and the
+  parallel run computes exactly what GraphRuntime::Run computes.  Variables
+  are not operators; __nop (in place) nodes are, they read and write the
+  storage they alias.
+
+  critical_path is the number of operators on the longest dependency chain
+  and width the most operators on one level (operators with the same
+  longest distance from a root); operators / critical_path is the average
+  parallelism available to an inter-op scheduler.
+
+ */
+
+struct ExecutionDag
+{
+    std::vector<uint32_t> ops;                     // operator node ids, in node order
+    std::vector<std::vector<uint32_t>> successors; // per node
+    std::vector<uint32_t> num_predecessors;        // per node
+    std::vector<uint32_t> roots;                   // operators without predecessors
+    std::size_t edges{ 0 };
+    uint32_t critical_path{ 0 };
+    uint32_t width{ 0 };
+
+    double parallelism() const { return critical_path ? static_cast<double>(ops.size()) / critical_path : 0.0; }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("ops", ops.size());
+        writer->WriteObjectKeyValue("edges", edges);
+        writer->WriteObjectKeyValue("roots", roots.size());
+        writer->WriteObjectKeyValue("critical_path", critical_path);
+        writer->WriteObjectKeyValue("width", width);
+        writer->WriteObjectKeyValue("parallelism", parallelism());
+        writer->EndObject();
+    }
+};
+
+inline ExecutionDag build_execution_dag(const GraphRuntimePrivateStuff& info)
+{
+    const uint32_t num_nodes = static_cast<uint32_t>(info.nodes_.size());
+    constexpr uint32_t kNone = ~0U;
+
+    std::size_t num_storage = 0;
+    for (int sid : info.attrs_.storage_id)
+    {
+        CHECK_GE(sid, 0) << "Do not support runtime shape op";
+        num_storage = std::max(num_storage, static_cast<std::size_t>(sid) + 1);
+    }
+    std::vector<uint32_t> last_writer(num_storage, kNone);
+    std::vector<std::vector<uint32_t>> readers(num_storage); // since the last write
+
+    ExecutionDag dag;
+    std::vector<std::vector<uint32_t>> predecessors(num_nodes);
+    for (uint32_t nid = 0; nid < num_nodes; nid++)
+    {
+        const auto& node = info.nodes_[nid];
+        if (node.op_type == "null")
+        {
+            continue;
+        }
+        dag.ops.push_back(nid);
+
+        auto& preds = predecessors[nid];
+        for (auto dep : node.control_deps)
+        {
+            if (info.nodes_[dep].op_type != "null")
+            {
+                preds.push_back(dep);
+            }
+        }
+        for (const auto& e : node.inputs)
+        {
+            if (info.nodes_[e.node_id].op_type != "null")
+            {
+                preds.push_back(e.node_id);
+            }
+
+            const uint32_t sid = static_cast<uint32_t>(info.attrs_.storage_id[info.entry_id(e)]);
+            if (last_writer[sid] != kNone)
+            {
+                preds.push_back(last_writer[sid]);
+            }
+            readers[sid].push_back(nid);
+        }
+        for (uint32_t index = 0; index < node.param.num_outputs; index++)
+        {
+            const uint32_t sid = static_cast<uint32_t>(info.attrs_.storage_id[info.entry_id(nid, index)]);
+            if (last_writer[sid] != kNone)
+            {
+                preds.push_back(last_writer[sid]);
+            }
+            preds.insert(preds.end(), readers[sid].begin(), readers[sid].end());
+            readers[sid].clear();
+            last_writer[sid] = nid;
+        }
+
+        std::sort(preds.begin(), preds.end());
+        preds.erase(std::unique(preds.begin(), preds.end()), preds.end());
+        preds.erase(std::remove(preds.begin(), preds.end(), nid), preds.end());
+    }
+
+    dag.successors.assign(num_nodes, {});
+    dag.num_predecessors.assign(num_nodes, 0);
+    std::vector<uint32_t> level(num_nodes, 0);
+    for (auto nid : dag.ops)
+    {
+        // Predecessors come first in node order, so their levels are final
+        for (auto pred : predecessors[nid])
+        {
+            dag.successors[pred].push_back(nid);
+            level[nid] = std::max(level[nid], level[pred] + 1);
+        }
+        dag.num_predecessors[nid] = static_cast<uint32_t>(predecessors[nid].size());
+        dag.edges += predecessors[nid].size();
+        if (predecessors[nid].empty())
+        {
+            dag.roots.push_back(nid);
+        }
+    }
+
+    std::vector<uint32_t> per_level;
+    for (auto nid : dag.ops)
+    {
+        if (level[nid] >= per_level.size())
+        {
+            per_level.resize(level[nid] + 1, 0);
+        }
+        per_level[level[nid]]++;
+    }
+    dag.critical_path = static_cast<uint32_t>(per_level.size());
+    dag.width = per_level.empty() ? 0 : *std::max_element(per_level.begin(), per_level.end());
+    return dag;
+}
+
+#endif // __execution_dag_h__
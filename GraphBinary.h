@@ -0,0 +1,381 @@
+#ifndef __graph_binary_h__
+#define __graph_binary_h__
+
+#include "GraphRuntime.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+
+  Precompiled binary graph format.
+
+  Holds exactly what GraphRuntimePrivateStuff::Load extracts from the graph
+  JSON, as flat arrays, so loading is a handful of memcpy calls out of a
+  mapped file with no tokenizing at all:
+
+    magic "TCTGRPH1", uint32 version
+    nodes    : op_type[], name[], func_name[] (strings), num_inputs[],
+               num_outputs[], flatten_data[], input_ptr[n + 1],
+               control_ptr[n + 1]
+    inputs   : node_id[], index[], version[]   (indexed by input_ptr)
+    control  : node ids                        (indexed by control_ptr)
+    arg_nodes[], node_row_ptr[]
+    heads    : node_id[], index[], version[]
+    attrs    : storage_num_not_alloctaed, storage_id[], device_index[],
+               dltype[] (strings), shape_ptr[e + 1], dims[]
+
+  Every array is a uint64 element count followed by the raw elements,
+  strings are a uint32 length followed by the characters.  Native endian.
+
+ */
+
+namespace graph_binary
+{
+    constexpr char kMagic[8] = { 'T', 'C', 'T', 'G', 'R', 'P', 'H', '1' };
+    constexpr uint32_t kVersion = 1;
+
+    class Writer
+    {
+    public:
+        explicit Writer(std::ostream& os)
+            : os_(os)
+        {
+        }
+
+        template <typename T>
+        void array(const std::vector<T>& v)
+        {
+            const uint64_t n = v.size();
+            os_.write(reinterpret_cast<const char*>(&n), sizeof(n));
+            os_.write(reinterpret_cast<const char*>(v.data()), n * sizeof(T));
+        }
+
+        void strings(const std::vector<std::string>& v)
+        {
+            const uint64_t n = v.size();
+            os_.write(reinterpret_cast<const char*>(&n), sizeof(n));
+            for (const auto& s : v)
+            {
+                const uint32_t length = static_cast<uint32_t>(s.size());
+                os_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                os_.write(s.data(), length);
+            }
+        }
+
+        template <typename T>
+        void value(const T& v)
+        {
+            os_.write(reinterpret_cast<const char*>(&v), sizeof(v));
+        }
+
+    private:
+        std::ostream& os_;
+    };
+
+    class Reader
+    {
+    public:
+        Reader(const char* data, std::size_t size)
+            : ptr_(data)
+            , end_(data + size)
+        {
+        }
+
+        template <typename T>
+        void array(std::vector<T>& v)
+        {
+            uint64_t n = 0;
+            read(&n, sizeof(n));
+            CHECK_LE(n, static_cast<uint64_t>(end_ - ptr_) / sizeof(T)) << "corrupt binary graph";
+            v.resize(n);
+            if (n)
+            {
+                read(v.data(), n * sizeof(T));
+            }
+        }
+
+        void strings(std::vector<std::string>& v)
+        {
+            uint64_t n = 0;
+            read(&n, sizeof(n));
+            CHECK_LE(n, static_cast<uint64_t>(end_ - ptr_)) << "corrupt binary graph";
+            v.resize(n);
+            for (auto& s : v)
+            {
+                uint32_t length = 0;
+                read(&length, sizeof(length));
+                CHECK_LE(length, static_cast<std::size_t>(end_ - ptr_)) << "corrupt binary graph";
+                s.assign(ptr_, length);
+                ptr_ += length;
+            }
+        }
+
+        template <typename T>
+        void value(T& v)
+        {
+            read(&v, sizeof(v));
+        }
+
+    private:
+        void read(void* out, std::size_t nbytes)
+        {
+            CHECK_LE(nbytes, static_cast<std::size_t>(end_ - ptr_)) << "corrupt binary graph";
+            std::memcpy(out, ptr_, nbytes);
+            ptr_ += nbytes;
+        }
+
+        const char* ptr_;
+        const char* end_;
+    };
+
+    struct Entries
+    {
+        std::vector<uint32_t> node_id, index, version;
+
+        void push_back(const GraphRuntimePrivateStuff::NodeEntry& e)
+        {
+            node_id.push_back(e.node_id);
+            index.push_back(e.index);
+            version.push_back(e.version);
+        }
+
+        GraphRuntimePrivateStuff::NodeEntry operator[](std::size_t i) const
+        {
+            GraphRuntimePrivateStuff::NodeEntry e;
+            e.node_id = node_id[i];
+            e.index = index[i];
+            e.version = version[i];
+            return e;
+        }
+
+        void Save(Writer& w) const
+        {
+            w.array(node_id);
+            w.array(index);
+            w.array(version);
+        }
+
+        void Load(Reader& r)
+        {
+            r.array(node_id);
+            r.array(index);
+            r.array(version);
+            CHECK(index.size() == node_id.size() && version.size() == node_id.size()) << "corrupt binary graph";
+        }
+    };
+
+    // Offsets delimiting the rows of an array of n elements: start at 0,
+    // never decrease and end at n, so every row is inside the array
+    inline void check_offsets(const std::vector<uint32_t>& ptr, std::size_t n)
+    {
+        CHECK(!ptr.empty() && ptr.front() == 0 && ptr.back() == n) << "corrupt binary graph";
+        for (std::size_t i = 1; i < ptr.size(); i++)
+        {
+            CHECK_LE(ptr[i - 1], ptr[i]) << "corrupt binary graph";
+        }
+    }
+
+    // Node ids, node entries and storage ids of a loaded graph in range, the
+    // runtime indexes its arrays with them unchecked
+    inline void check_graph(const GraphRuntimePrivateStuff& info)
+    {
+        const std::size_t n = info.nodes_.size();
+        check_offsets(info.node_row_ptr_, info.node_row_ptr_.empty() ? 0 : info.node_row_ptr_.back());
+        CHECK_EQ(info.node_row_ptr_.size(), n + 1) << "corrupt binary graph";
+        const std::size_t entries = info.node_row_ptr_.back();
+
+        auto check_entry = [&](const GraphRuntimePrivateStuff::NodeEntry& e) {
+            CHECK(e.node_id < n && e.index < info.node_row_ptr_[e.node_id + 1] - info.node_row_ptr_[e.node_id]) << "corrupt binary graph";
+        };
+        for (const auto& node : info.nodes_)
+        {
+            for (const auto& e : node.inputs)
+            {
+                check_entry(e);
+            }
+            for (auto dep : node.control_deps)
+            {
+                CHECK_LT(dep, n) << "corrupt binary graph";
+            }
+        }
+        for (const auto& e : info.outputs_)
+        {
+            check_entry(e);
+        }
+        for (auto nid : info.input_nodes_)
+        {
+            CHECK_LT(nid, n) << "corrupt binary graph";
+        }
+
+        CHECK(info.attrs_.storage_id.size() == entries && info.attrs_.dltype.size() == entries && info.attrs_.shape.size() == entries) << "corrupt binary graph";
+        CHECK(info.attrs_.device_index.empty() || info.attrs_.device_index.size() == entries) << "corrupt binary graph";
+        for (auto sid : info.attrs_.storage_id)
+        {
+            CHECK(sid >= 0 && static_cast<std::size_t>(sid) < entries) << "corrupt binary graph";
+        }
+    }
+}
+
+inline bool is_binary_graph(const char* data, std::size_t size)
+{
+    return size >= sizeof(graph_binary::kMagic) && std::memcmp(data, graph_binary::kMagic, sizeof(graph_binary::kMagic)) == 0;
+}
+
+inline bool save_graph_binary(const GraphRuntimePrivateStuff& info, const std::string& filename)
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+    {
+        return false;
+    }
+
+    const std::size_t n = info.nodes_.size();
+    std::vector<std::string> op_type(n), name(n), func_name(n);
+    std::vector<uint32_t> num_inputs(n), num_outputs(n), flatten_data(n);
+    std::vector<uint32_t> input_ptr(1, 0), control_ptr(1, 0), control;
+    graph_binary::Entries inputs, heads;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        const auto& node = info.nodes_[i];
+        op_type[i] = node.op_type;
+        name[i] = node.name;
+        const bool is_op = (node.op_type != "null");
+        func_name[i] = is_op ? node.param.func_name : std::string();
+        num_inputs[i] = is_op ? node.param.num_inputs : 0;
+        num_outputs[i] = is_op ? node.param.num_outputs : 1;
+        flatten_data[i] = is_op ? node.param.flatten_data : 0;
+        for (const auto& e : node.inputs)
+        {
+            inputs.push_back(e);
+        }
+        input_ptr.push_back(static_cast<uint32_t>(inputs.node_id.size()));
+        control.insert(control.end(), node.control_deps.begin(), node.control_deps.end());
+        control_ptr.push_back(static_cast<uint32_t>(control.size()));
+    }
+
+    for (const auto& e : info.outputs_)
+    {
+        heads.push_back(e);
+    }
+
+    std::vector<uint32_t> shape_ptr(1, 0);
+    std::vector<int64_t> dims;
+    for (const auto& shape : info.attrs_.shape)
+    {
+        dims.insert(dims.end(), shape.begin(), shape.end());
+        shape_ptr.push_back(static_cast<uint32_t>(dims.size()));
+    }
+
+    graph_binary::Writer w(ofs);
+    ofs.write(graph_binary::kMagic, sizeof(graph_binary::kMagic));
+    w.value(graph_binary::kVersion);
+
+    w.strings(op_type);
+    w.strings(name);
+    w.strings(func_name);
+    w.array(num_inputs);
+    w.array(num_outputs);
+    w.array(flatten_data);
+    w.array(input_ptr);
+    w.array(control_ptr);
+    inputs.Save(w);
+    w.array(control);
+
+    w.array(info.input_nodes_);
+    w.array(info.node_row_ptr_);
+    heads.Save(w);
+
+    w.value(static_cast<uint64_t>(info.attrs_.storage_num_not_alloctaed));
+    w.array(info.attrs_.storage_id);
+    w.array(info.attrs_.device_index);
+    w.strings(info.attrs_.dltype);
+    w.array(shape_ptr);
+    w.array(dims);
+
+    return static_cast<bool>(ofs);
+}
+
+inline void load_graph_binary(const char* data, std::size_t size, GraphRuntimePrivateStuff& info)
+{
+    CHECK(is_binary_graph(data, size)) << "not a binary graph";
+
+    graph_binary::Reader r(data + sizeof(graph_binary::kMagic), size - sizeof(graph_binary::kMagic));
+    uint32_t version = 0;
+    r.value(version);
+    CHECK_EQ(version, graph_binary::kVersion) << "unsupported binary graph version " << version;
+
+    std::vector<std::string> op_type, name, func_name;
+    std::vector<uint32_t> num_inputs, num_outputs, flatten_data, input_ptr, control_ptr, control;
+    graph_binary::Entries inputs, heads;
+    r.strings(op_type);
+    r.strings(name);
+    r.strings(func_name);
+    r.array(num_inputs);
+    r.array(num_outputs);
+    r.array(flatten_data);
+    r.array(input_ptr);
+    r.array(control_ptr);
+    inputs.Load(r);
+    r.array(control);
+
+    const std::size_t n = op_type.size();
+    CHECK(name.size() == n && func_name.size() == n && num_inputs.size() == n && num_outputs.size() == n
+        && flatten_data.size() == n && input_ptr.size() == n + 1 && control_ptr.size() == n + 1)
+        << "corrupt binary graph";
+    graph_binary::check_offsets(input_ptr, inputs.node_id.size());
+    graph_binary::check_offsets(control_ptr, control.size());
+
+    info.nodes_.resize(n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        auto& node = info.nodes_[i];
+        node.op_type = op_type[i];
+        node.name = name[i];
+        node.param.func_name = func_name[i];
+        node.param.num_inputs = num_inputs[i];
+        node.param.num_outputs = num_outputs[i];
+        node.param.flatten_data = flatten_data[i];
+        node.inputs.clear();
+        for (uint32_t k = input_ptr[i]; k < input_ptr[i + 1]; k++)
+        {
+            node.inputs.push_back(inputs[k]);
+        }
+        node.control_deps.assign(control.begin() + control_ptr[i], control.begin() + control_ptr[i + 1]);
+    }
+
+    r.array(info.input_nodes_);
+    r.array(info.node_row_ptr_);
+    heads.Load(r);
+    info.outputs_.clear();
+    for (std::size_t i = 0; i < heads.node_id.size(); i++)
+    {
+        info.outputs_.push_back(heads[i]);
+    }
+
+    uint64_t not_allocated = 0;
+    std::vector<uint32_t> shape_ptr;
+    std::vector<int64_t> dims;
+    r.value(not_allocated);
+    info.attrs_.storage_num_not_alloctaed = static_cast<std::size_t>(not_allocated);
+    r.array(info.attrs_.storage_id);
+    r.array(info.attrs_.device_index);
+    r.strings(info.attrs_.dltype);
+    r.array(shape_ptr);
+    r.array(dims);
+
+    graph_binary::check_offsets(shape_ptr, dims.size());
+    info.attrs_.shape.resize(shape_ptr.size() - 1);
+    for (std::size_t i = 0; i + 1 < shape_ptr.size(); i++)
+    {
+        info.attrs_.shape[i].assign(dims.begin() + shape_ptr[i], dims.begin() + shape_ptr[i + 1]);
+    }
+
+    graph_binary::check_graph(info);
+}
+
+#endif // __graph_binary_h__
@@ -2,6 +2,7 @@
 #define __graph_runtime_h__
 
 #include <dmlc/json.h>
+#include <tvm/runtime/module.h>
 #include <tvm/runtime/ndarray.h>
 
 using tvm::runtime::NDArray;
@@ -73,6 +74,16 @@ struct GraphRuntimePrivateStuff
                 version = 0;
             }
         }
+
+        // JSON Writer
+        void Save(dmlc::JSONWriter* writer) const
+        {
+            writer->BeginArray(false);
+            writer->WriteArrayItem(node_id);
+            writer->WriteArrayItem(index);
+            writer->WriteArrayItem(version);
+            writer->EndArray();
+        }
     };
 
     // Node
@@ -160,6 +171,29 @@ struct GraphRuntimePrivateStuff
             }
             CHECK_EQ(bitmask, 1 | 2 | 4) << "invalid format";
         }
+
+        // JSON Writer
+        void Save(dmlc::JSONWriter* writer) const
+        {
+            writer->BeginObject();
+            writer->WriteObjectKeyValue("op", op_type);
+            writer->WriteObjectKeyValue("name", name);
+            if (op_type != "null")
+            {
+                std::map<std::string, std::string> attrs;
+                attrs["func_name"] = param.func_name;
+                attrs["num_inputs"] = std::to_string(param.num_inputs);
+                attrs["num_outputs"] = std::to_string(param.num_outputs);
+                attrs["flatten_data"] = std::to_string(param.flatten_data);
+                writer->WriteObjectKeyValue("attrs", attrs);
+            }
+            writer->WriteObjectKeyValue("inputs", inputs);
+            if (!control_deps.empty())
+            {
+                writer->WriteObjectKeyValue("control_deps", control_deps);
+            }
+            writer->EndObject();
+        }
     };
 
     struct GraphAttr
@@ -247,6 +281,26 @@ struct GraphRuntimePrivateStuff
             }
             CHECK_EQ(bitmask, 1 | 2 | 4) << "invalid format";
         }
+
+        // JSON Writer, the [type, value] pairs that Load() expects
+        template <typename T>
+        static void SaveTyped(dmlc::JSONWriter* writer, const std::string& key, const std::string& type, const T& value)
+        {
+            writer->WriteObjectKeyValue(key, std::make_pair(type, value));
+        }
+
+        void Save(dmlc::JSONWriter* writer) const
+        {
+            writer->BeginObject();
+            SaveTyped(writer, "dltype", "list_str", dltype);
+            SaveTyped(writer, "storage_id", "list_int", storage_id);
+            SaveTyped(writer, "shape", "list_shape", shape);
+            if (!device_index.empty())
+            {
+                SaveTyped(writer, "device_index", "list_int", device_index);
+            }
+            writer->EndObject();
+        }
     };
 
     // The graph attribute fields.
@@ -290,6 +344,18 @@ struct GraphRuntimePrivateStuff
         CHECK_EQ(bitmask, 1 | 2 | 4 | 8 | 16) << "invalid format";
     }
 
+    // JSON Writer, produces a graph the stock graph runtime can load
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("nodes", nodes_);
+        writer->WriteObjectKeyValue("arg_nodes", input_nodes_);
+        writer->WriteObjectKeyValue("node_row_ptr", node_row_ptr_);
+        writer->WriteObjectKeyValue("heads", outputs_);
+        writer->WriteObjectKeyValue("attrs", attrs_);
+        writer->EndObject();
+    }
+
     // Get node entry index.
     uint32_t entry_id(uint32_t nid, uint32_t index) const
     {
@@ -0,0 +1,71 @@
+#ifndef __host_tensor_h__
+#define __host_tensor_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+
+#include <dlpack/dlpack.h>
+#include <dmlc/logging.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*
+
+  Caller owned host memory exposed as a DLTensor, for the bind_input /
+  bind_output functions of the graph runtime (graph_runtime_ext.cc).
+
+  The buffer is 64 byte aligned, like the runtime's own allocations
+  (kAllocAlignment), so on CPU devices it is bound zero copy and the
+  operators read / write it directly.  The owner must keep it alive while
+  it is bound.
+
+ */
+
+class HostTensor
+{
+public:
+    static constexpr std::size_t kAlignment = 64;
+
+    HostTensor(const std::vector<int64_t>& shape, DLDataType dtype)
+        : shape_(shape)
+        , bytes_(byte_size(dtype, shape))
+    {
+        CHECK_EQ(posix_memalign(&data_, kAlignment, bytes_ ? bytes_ : kAlignment), 0) << "Failed to allocate " << bytes_ << " bytes";
+
+        tensor_.data = data_;
+        tensor_.ctx = DLContext{ kDLCPU, 0 };
+        tensor_.ndim = static_cast<int>(shape_.size());
+        tensor_.dtype = dtype;
+        tensor_.shape = shape_.data();
+        tensor_.strides = nullptr;
+        tensor_.byte_offset = 0;
+    }
+
+    // Shaped like graph entry eid
+    HostTensor(const GraphRuntimePrivateStuff& info, uint32_t eid)
+        : HostTensor(info.attrs_.shape[eid], parse_dltype(info.attrs_.dltype[eid]))
+    {
+    }
+
+    ~HostTensor() { std::free(data_); }
+
+    HostTensor(const HostTensor&) = delete;
+    HostTensor& operator=(const HostTensor&) = delete;
+
+    DLTensor* tensor() { return &tensor_; }
+    std::size_t bytes() const { return bytes_; }
+
+    template <typename T>
+    T* data() { return static_cast<T*>(data_); }
+
+private:
+    std::vector<int64_t> shape_;
+    std::size_t bytes_;
+    void* data_{ nullptr };
+    DLTensor tensor_;
+};
+
+#endif // __host_tensor_h__
@@ -0,0 +1,209 @@
+#ifndef __image_source_h__
+#define __image_source_h__
+
+#include "Preprocess.h"
+
+#include <dmlc/logging.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+
+  8 bit image input for the preprocessing stage (Preprocess.h).
+
+  Supported inputs, no codec dependencies:
+
+    *.ppm        binary PPM (P6, maxval 255), RGB
+    *.rgb *.bgr  headerless interleaved 8 bit pixels, the size is given
+                 by the caller (raw camera / decoder output)
+
+  An ImageSource walks a single file, every supported file of a directory
+  (sorted by name), or a stream of concatenated PPM images ("-" : stdin),
+  e.g. the output of a decoder or capture process piped into the sample.
+
+ */
+
+struct Image
+{
+    std::string name;
+    int width{ 0 };
+    int height{ 0 };
+    PixelFormat format{ PixelFormat::RGB8 };
+    std::vector<uint8_t> pixels;
+
+    ImageView view() const
+    {
+        ImageView v;
+        v.data = pixels.data();
+        v.width = width;
+        v.height = height;
+        v.format = format;
+        return v;
+    }
+};
+
+namespace image_source
+{
+    inline bool has_suffix(const std::string& s, const std::string& suffix)
+    {
+        return s.size() >= suffix.size() && std::equal(suffix.rbegin(), suffix.rend(), s.rbegin(), [](char a, char b) {
+                   return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+               });
+    }
+
+    // Next PPM header field, skipping white space and comments
+    inline bool read_field(std::istream& is, int& value)
+    {
+        while (is)
+        {
+            const int c = is.peek();
+            if (c == '#')
+            {
+                std::string comment;
+                std::getline(is, comment);
+            }
+            else if (c != EOF && std::isspace(c))
+            {
+                is.get();
+            }
+            else
+            {
+                break;
+            }
+        }
+        return static_cast<bool>(is >> value);
+    }
+}
+
+// Read the next image of a (possibly multi image) PPM stream, false at the end
+inline bool read_ppm(std::istream& is, Image& image)
+{
+    char magic[2] = {};
+    is >> std::ws;
+    if (!is.read(magic, 2))
+    {
+        return false;
+    }
+    CHECK(magic[0] == 'P' && magic[1] == '6') << "only binary PPM (P6) is supported: " << image.name;
+
+    int maxval = 0;
+    CHECK(image_source::read_field(is, image.width) && image_source::read_field(is, image.height) && image_source::read_field(is, maxval))
+        << "corrupt PPM header: " << image.name;
+    CHECK(image.width > 0 && image.height > 0) << "corrupt PPM header: " << image.name;
+    CHECK_EQ(maxval, 255) << "only 8 bit PPM is supported: " << image.name;
+    is.get(); // single white space before the pixels
+
+    image.format = PixelFormat::RGB8;
+    image.pixels.resize(static_cast<std::size_t>(image.width) * image.height * 3);
+    CHECK(is.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size())) << "truncated PPM: " << image.name;
+    return true;
+}
+
+inline bool read_raw(const std::string& filename, int width, int height, PixelFormat format, Image& image)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+    {
+        return false;
+    }
+
+    image.name = filename;
+    image.width = width;
+    image.height = height;
+    image.format = format;
+    image.pixels.resize(static_cast<std::size_t>(width) * height * bytes_per_pixel(format));
+    return static_cast<bool>(ifs.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size()));
+}
+
+class ImageSource
+{
+public:
+    // path : image file, directory or "-" for a PPM stream on stdin.
+    // raw_width / raw_height : size of headerless .rgb / .bgr files.
+    explicit ImageSource(const std::string& path, int raw_width = 224, int raw_height = 224)
+        : raw_width_(raw_width)
+        , raw_height_(raw_height)
+    {
+        struct stat st;
+        if (path == "-")
+        {
+            stream_ = &std::cin;
+        }
+        else if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            DIR* dir = opendir(path.c_str());
+            CHECK(dir) << "Failed to open directory " << path;
+            while (dirent* entry = readdir(dir))
+            {
+                const std::string name = entry->d_name;
+                if (supported(name))
+                {
+                    files_.push_back(path + "/" + name);
+                }
+            }
+            closedir(dir);
+            std::sort(files_.begin(), files_.end());
+        }
+        else
+        {
+            CHECK(supported(path)) << "unsupported image file " << path << " (.ppm, .rgb or .bgr)";
+            files_.push_back(path);
+        }
+    }
+
+    static bool supported(const std::string& name)
+    {
+        using image_source::has_suffix;
+        return has_suffix(name, ".ppm") || has_suffix(name, ".rgb") || has_suffix(name, ".bgr");
+    }
+
+    // Next image, false when the source is exhausted
+    bool next(Image& image)
+    {
+        if (stream_)
+        {
+            image.name = "stdin:" + std::to_string(count_++);
+            return read_ppm(*stream_, image);
+        }
+
+        if (index_ >= files_.size())
+        {
+            return false;
+        }
+
+        const std::string& file = files_[index_++];
+        count_++;
+        if (image_source::has_suffix(file, ".ppm"))
+        {
+            std::ifstream ifs(file, std::ios::binary);
+            CHECK(ifs) << "Failed to read image " << file;
+            image.name = file;
+            CHECK(read_ppm(ifs, image)) << "empty PPM file " << file;
+            return true;
+        }
+
+        const PixelFormat format = image_source::has_suffix(file, ".bgr") ? PixelFormat::BGR8 : PixelFormat::RGB8;
+        CHECK(read_raw(file, raw_width_, raw_height_, format, image)) << "Failed to read " << raw_width_ << "x" << raw_height_ << " raw image " << file;
+        return true;
+    }
+
+private:
+    int raw_width_;
+    int raw_height_;
+    std::istream* stream_{ nullptr };
+    std::vector<std::string> files_;
+    std::size_t index_{ 0 };
+    std::size_t count_{ 0 };
+};
+
+#endif // __image_source_h__
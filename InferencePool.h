@@ -0,0 +1,218 @@
+#ifndef __inference_pool_h__
+#define __inference_pool_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+#include "RequestQueue.h"
+#include "ThreadConfig.h"
+
+#include <dlpack/dlpack.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/packed_func.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+  Multi-instance inference pool.
+
+  Each worker thread owns one graph runtime instance; the instances are
+  created from one loaded operator library and share a single copy of the
+  weights (create_shared_graph_runtime in ModelLoader.h).  Requests go
+  through a lock free RequestQueue, so submitting never blocks on a worker
+  (only on a full queue); results come back as a future or through a
+  callback run on the worker thread.
+
+  Every worker runs on a TVM thread pool of its own, threads_per_worker
+  threads (set_worker_pools in ThreadConfig.h); with pin enabled, worker w
+  is bound to cores [w * threads_per_worker, (w + 1) * threads_per_worker)
+  and its pool inherits that mask.
+
+ */
+
+struct InferencePoolOptions
+{
+    int workers{ 1 };
+    int threads_per_worker{ 1 };
+    bool pin{ false };
+    std::size_t queue_capacity{ 1024 };
+    WaitOptions wait; // idle workers: spin / yield before sleeping
+};
+
+class InferencePool
+{
+public:
+    // instances[w] is used by worker w, at least opts.workers are needed
+    InferencePool(const std::vector<tvm::runtime::Module>& instances, const GraphRuntimePrivateStuff& info, int device_type, int device_id, const InferencePoolOptions& opts, const std::string& input_name = "data")
+        : opts_(opts)
+        , queue_(opts.queue_capacity, opts.wait)
+        , input_name_(input_name)
+        , device_type_(device_type)
+        , device_id_(device_id)
+    {
+        CHECK_GE(opts_.workers, 1);
+        CHECK_LE(static_cast<std::size_t>(opts_.workers), instances.size()) << "not enough runtime instances";
+
+        uint32_t input_eid = info.num_node_entries();
+        for (auto nid : info.input_nodes_)
+        {
+            if (info.nodes_[nid].name == input_name)
+            {
+                input_eid = info.entry_id(nid, 0);
+            }
+        }
+        CHECK_LT(input_eid, info.num_node_entries()) << "no graph input " << input_name;
+        CHECK(parse_dltype(info.attrs_.dltype[input_eid]).code == kDLFloat) << "float32 input expected";
+
+        in_shape_ = info.attrs_.shape[input_eid];
+        out_shape_ = info.attrs_.shape[info.entry_id(info.outputs_.front())];
+        in_size_ = element_count(in_shape_);
+        out_size_ = element_count(out_shape_);
+
+        set_worker_pools(opts_.threads_per_worker);
+
+        for (int w = 0; w < opts_.workers; w++)
+        {
+            workers_.emplace_back(&InferencePool::Worker, this, w, instances[w]);
+        }
+    }
+
+    ~InferencePool()
+    {
+        queue_.close();
+        for (auto& t : workers_)
+        {
+            t.join();
+        }
+    }
+
+    InferencePool(const InferencePool&) = delete;
+    InferencePool& operator=(const InferencePool&) = delete;
+
+    // Runs on the worker thread and must not throw; error is set (and
+    // output empty) if the request failed
+    using Callback = std::function<void(std::vector<float> output, std::exception_ptr error)>;
+
+    // Queue one input of input_size() floats, the data is copied
+    std::future<std::vector<float>> Submit(const float* input)
+    {
+        auto promise = std::make_shared<std::promise<std::vector<float>>>();
+        std::future<std::vector<float>> result = promise->get_future();
+        Submit(input, [promise](std::vector<float> output, std::exception_ptr error) {
+            if (error)
+            {
+                promise->set_exception(error);
+            }
+            else
+            {
+                promise->set_value(std::move(output));
+            }
+        });
+        return result;
+    }
+
+    void Submit(const float* input, Callback done)
+    {
+        Request request;
+        request.input.assign(input, input + in_size_);
+        request.done = std::move(done);
+        queue_.push(std::move(request));
+    }
+
+    int workers() const { return opts_.workers; }
+    int threads_per_worker() const { return opts_.threads_per_worker; }
+    std::size_t input_size() const { return in_size_; }
+    std::size_t output_size() const { return out_size_; }
+
+private:
+    struct Request
+    {
+        std::vector<float> input;
+        Callback done;
+    };
+
+    void Pin(int w)
+    {
+#if defined(__linux__)
+        const int cores = static_cast<int>(std::thread::hardware_concurrency());
+        if (cores <= 0)
+        {
+            return;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int i = 0; i < opts_.threads_per_worker; i++)
+        {
+            CPU_SET((w * opts_.threads_per_worker + i) % cores, &set);
+        }
+        sched_setaffinity(0, sizeof(set), &set); // best effort
+#endif
+    }
+
+    void Worker(int w, tvm::runtime::Module mod)
+    {
+        if (opts_.pin)
+        {
+            Pin(w);
+        }
+
+        tvm::runtime::PackedFunc set_input = mod.GetFunction("set_input");
+        tvm::runtime::PackedFunc run = mod.GetFunction("run");
+        tvm::runtime::PackedFunc get_output = mod.GetFunction("get_output");
+
+        DLTensor* x = nullptr;
+        DLTensor* y = nullptr;
+        TVMArrayAlloc(in_shape_.data(), static_cast<int>(in_shape_.size()), kDLFloat, 32, 1, device_type_, device_id_, &x);
+        TVMArrayAlloc(out_shape_.data(), static_cast<int>(out_shape_.size()), kDLFloat, 32, 1, device_type_, device_id_, &y);
+
+        Request request;
+        while (queue_.pop(request))
+        {
+            try
+            {
+                TVMArrayCopyFromBytes(x, request.input.data(), in_size_ * sizeof(float));
+                set_input(input_name_, x);
+                run();
+                get_output(0, y);
+
+                std::vector<float> output(out_size_);
+                TVMArrayCopyToBytes(y, output.data(), out_size_ * sizeof(float));
+                request.done(std::move(output), nullptr);
+            }
+            catch (...)
+            {
+                request.done(std::vector<float>(), std::current_exception());
+            }
+            request = Request();
+        }
+
+        TVMArrayFree(x);
+        TVMArrayFree(y);
+    }
+
+    InferencePoolOptions opts_;
+    RequestQueue<Request> queue_;
+    std::string input_name_;
+    int device_type_{ 0 };
+    int device_id_{ 0 };
+
+    std::vector<int64_t> in_shape_, out_shape_;
+    std::size_t in_size_{ 0 }, out_size_{ 0 };
+
+    std::vector<std::thread> workers_;
+};
+
+#endif // __inference_pool_h__
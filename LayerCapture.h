@@ -0,0 +1,388 @@
+#ifndef __layer_capture_h__
+#define __layer_capture_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+#include "LayerDump.h"
+#include "LayerFingerprint.h"
+
+#include <dlpack/dlpack.h>
+#include <dmlc/json.h>
+#include <dmlc/logging.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/ndarray.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+  Sampled layer capture: the outputs of selected layers of selected
+  requests go into binary layer dumps (LayerDump.h), one file per request.
+
+  Layers are chosen by node id, id range or name pattern ("0-10,42,conv*"),
+  requests by every Nth and / or a random fraction.  A captured request runs
+  through the runtime's run_capture (graph_runtime_ext.cc), which hands
+  every selected output over right after its node ran; it is copied into a
+  device buffer of a fixed pool of capture slots, before a later node can
+  reuse the storage.  The device to host copies and the file writes happen
+  on a background thread.  When every slot is still being written, the
+  request runs without capture and counts as dropped, so capturing never
+  waits for the disk.
+
+  With fingerprint set, the background thread writes a fingerprint file
+  (LayerFingerprint.h) per request instead of a full dump: a few numbers
+  per layer, cheap enough to keep sampling in production.
+
+ */
+
+struct LayerCaptureOptions
+{
+    std::string layers{ "all" }; // "all", "none" or node ids, ranges and name patterns
+    int every{ 0 };              // capture every Nth request, 0 : off
+    double sample{ 0.0 };        // probability to capture a request
+    int buffers{ 2 };            // capture slots, captures in flight
+    std::string prefix{ "tvm_layers" };
+    unsigned seed{ 1 };
+    bool fingerprint{ false }; // fingerprints (LayerFingerprint.h) instead of full dumps
+    double quantum{ 1e-4 };    // fingerprint hash bucket width
+
+    // File extension of the captures
+    const char* extension() const { return fingerprint ? ".fp" : ".bin"; }
+
+    bool sampling() const { return every > 0 || sample > 0.0; }
+};
+
+struct LayerCaptureStats
+{
+    std::size_t captured{ 0 };
+    std::size_t dropped{ 0 }; // no free slot
+    std::size_t failed{ 0 };  // files not written
+    std::size_t bytes{ 0 };
+    double write_s{ 0.0 }; // background thread: device to host copies and writes
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("captured", captured);
+        writer->WriteObjectKeyValue("dropped", dropped);
+        writer->WriteObjectKeyValue("failed", failed);
+        writer->WriteObjectKeyValue("bytes", bytes);
+        writer->WriteObjectKeyValue("write_s", write_s);
+        writer->EndObject();
+    }
+};
+
+namespace layer_capture
+{
+    // Glob match with '*' and '?'
+    inline bool match(const char* pattern, const char* name)
+    {
+        for (; *pattern; ++pattern, ++name)
+        {
+            if (*pattern == '*')
+            {
+                for (; *name; ++name)
+                {
+                    if (match(pattern + 1, name))
+                    {
+                        return true;
+                    }
+                }
+                return match(pattern + 1, name);
+            }
+            if (!*name || (*pattern != '?' && *pattern != *name))
+            {
+                return false;
+            }
+        }
+        return !*name;
+    }
+
+    inline bool is_range(const std::string& item)
+    {
+        return !item.empty() && item.find_first_not_of("0123456789-") == std::string::npos && std::isdigit(static_cast<unsigned char>(item[0]));
+    }
+}
+
+// Sorted node ids selected by spec, see LayerCaptureOptions::layers
+inline std::vector<uint32_t> select_layers(const GraphRuntimePrivateStuff& info, const std::string& spec)
+{
+    const uint32_t count = static_cast<uint32_t>(info.nodes_.size());
+    std::vector<bool> selected(count, spec == "all");
+    if (spec != "all" && spec != "none")
+    {
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (layer_capture::is_range(item))
+            {
+                const std::size_t dash = item.find('-');
+                const uint32_t first = static_cast<uint32_t>(std::atoi(item.substr(0, dash).c_str()));
+                const uint32_t last = (dash == std::string::npos) ? first : static_cast<uint32_t>(std::atoi(item.substr(dash + 1).c_str()));
+                CHECK(first <= last && last < count) << "invalid layer range " << item << ", the graph has " << count << " nodes";
+                std::fill(selected.begin() + first, selected.begin() + last + 1, true);
+            }
+            else if (!item.empty())
+            {
+                for (uint32_t nid = 0; nid < count; nid++)
+                {
+                    selected[nid] = selected[nid] || layer_capture::match(item.c_str(), info.nodes_[nid].name.c_str());
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> nodes;
+    for (uint32_t nid = 0; nid < count; nid++)
+    {
+        if (selected[nid])
+        {
+            nodes.push_back(nid);
+        }
+    }
+    return nodes;
+}
+
+class LayerCapture
+{
+public:
+    LayerCapture(const GraphRuntimePrivateStuff& info, const LayerCaptureOptions& opts, int device_type, int device_id)
+        : opts_(opts)
+        , nodes_(select_layers(info, opts.layers))
+        , rng_(opts.seed)
+    {
+        // Every slot gets a device buffer per captured output, allocated once
+        const DLContext ctx{ static_cast<DLDeviceType>(device_type), device_id };
+        slots_.resize(std::max(opts.buffers, 1));
+        for (auto nid : nodes_)
+        {
+            const auto& node = info.nodes_[nid];
+            const uint32_t num_outputs = (node.op_type == "null") ? 1 : node.param.num_outputs;
+            for (uint32_t index = 0; index < num_outputs; index++)
+            {
+                Layer layer;
+                layer.node_id = nid;
+                layer.entry_id = info.entry_id(nid, index);
+                layer.name = (num_outputs > 1) ? (node.name + ":" + std::to_string(index)) : node.name;
+                layer.dtype = parse_dltype(info.attrs_.dltype[layer.entry_id]);
+                layer.shape = info.attrs_.shape[layer.entry_id];
+                layer.nbytes = byte_size(layer.dtype, layer.shape);
+                layers_.push_back(layer);
+            }
+        }
+        for (auto& slot : slots_)
+        {
+            for (const auto& layer : layers_)
+            {
+                slot.tensors.push_back(tvm::runtime::NDArray::Empty(layer.shape, layer.dtype, ctx));
+            }
+            free_.push_back(&slot);
+        }
+
+        writer_ = std::thread([this] { this->WriteLoop(); });
+    }
+
+    ~LayerCapture()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        writer_.join();
+    }
+
+    LayerCapture(const LayerCapture&) = delete;
+    LayerCapture& operator=(const LayerCapture&) = delete;
+
+    // Whether request should be captured, by opts.every and opts.sample
+    bool Sampled(uint64_t request)
+    {
+        if (opts_.every > 0 && request % static_cast<uint64_t>(opts_.every) == 0)
+        {
+            return true;
+        }
+        return opts_.sample > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < opts_.sample;
+    }
+
+    // Run mod once, capturing the selected layers into filename.  Without a
+    // free slot it is a plain run and false is returned.
+    bool Run(tvm::runtime::Module& mod, const std::string& filename)
+    {
+        Slot* slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (free_.empty())
+            {
+                stats_.dropped++;
+            }
+            else
+            {
+                slot = free_.front();
+                free_.pop_front();
+            }
+        }
+        if (!slot)
+        {
+            mod.GetFunction("run")();
+            return false;
+        }
+
+        std::size_t next = 0;
+        tvm::runtime::PackedFunc callback([this, slot, &next](tvm::runtime::TVMArgs args, tvm::runtime::TVMRetValue* rv) {
+            CHECK_LT(next, layers_.size()) << "unexpected layer";
+            CHECK_EQ(layers_[next].node_id, static_cast<uint32_t>(args[0].operator int())) << "unexpected layer";
+            DLTensor* tensor = args[2];
+            slot->tensors[next++].CopyFrom(tensor);
+        });
+        tvm::runtime::PackedFunc run_capture = mod.GetFunction("run_capture");
+        CHECK(run_capture != nullptr) << "run_capture requires a runtime created by graph_runtime_ext.cc";
+        run_capture(static_cast<void*>(&nodes_), callback);
+        CHECK_EQ(next, layers_.size()) << "missing layers";
+
+        slot->filename = filename;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(slot);
+        }
+        cv_.notify_all();
+        return true;
+    }
+
+    // Wait until every queued capture is written
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return queue_.empty() && free_.size() == slots_.size(); });
+    }
+
+    const std::vector<uint32_t>& nodes() const { return nodes_; }
+
+    LayerCaptureStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Layer
+    {
+        uint32_t node_id;
+        uint32_t entry_id;
+        std::string name;
+        DLDataType dtype;
+        std::vector<int64_t> shape;
+        std::size_t nbytes;
+    };
+
+    struct Slot
+    {
+        std::string filename;
+        std::vector<tvm::runtime::NDArray> tensors; // per layer
+    };
+
+    void WriteLoop()
+    {
+        std::vector<char> host;
+        for (;;)
+        {
+            Slot* slot = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return;
+                }
+                slot = queue_.front();
+                queue_.pop_front();
+            }
+
+            auto tic = std::chrono::high_resolution_clock::now();
+            std::size_t bytes = 0;
+            const bool written = opts_.fingerprint ? WriteFingerprints(*slot, host, bytes) : WriteDump(*slot, host, bytes);
+            const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tic).count();
+            if (!written)
+            {
+                LOG(WARNING) << "Failed to write layer capture " << slot->filename;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stats_.captured += written ? 1 : 0;
+                stats_.failed += written ? 0 : 1;
+                stats_.bytes += written ? bytes : 0;
+                stats_.write_s += elapsed;
+                free_.push_back(slot);
+            }
+            cv_.notify_all();
+        }
+    }
+
+    bool WriteDump(const Slot& slot, std::vector<char>& host, std::size_t& bytes)
+    {
+        LayerDumpWriter dump(slot.filename);
+        std::size_t dumped = 0;
+        for (std::size_t i = 0; i < layers_.size() && dump.good(); i++)
+        {
+            const Layer& layer = layers_[i];
+            host.resize(layer.nbytes);
+            TVMArrayCopyToBytes(const_cast<DLTensor*>(slot.tensors[i].operator->()), host.data(), layer.nbytes);
+            dump.Write(layer.node_id, layer.entry_id, layer.name, layer.dtype, layer.shape, host.data(), layer.nbytes);
+            dumped += layer.nbytes;
+        }
+
+        // Only a closed file (index written, flushed) counts
+        if (!dump.Close())
+        {
+            return false;
+        }
+        bytes += dumped;
+        return true;
+    }
+
+    bool WriteFingerprints(const Slot& slot, std::vector<char>& host, std::size_t& bytes)
+    {
+        std::vector<LayerFingerprint> fingerprints;
+        fingerprints.reserve(layers_.size());
+        for (std::size_t i = 0; i < layers_.size(); i++)
+        {
+            const Layer& layer = layers_[i];
+            host.resize(layer.nbytes);
+            TVMArrayCopyToBytes(const_cast<DLTensor*>(slot.tensors[i].operator->()), host.data(), layer.nbytes);
+            fingerprints.push_back(fingerprint_layer(layer.node_id, layer.entry_id, layer.name, layer.dtype, host.data(), layer.nbytes, opts_.quantum));
+            bytes += layer.nbytes;
+        }
+        return save_fingerprints(slot.filename, opts_.quantum, fingerprints);
+    }
+
+    LayerCaptureOptions opts_;
+    std::vector<uint32_t> nodes_;
+    std::vector<Layer> layers_;
+    std::vector<Slot> slots_;
+    std::mt19937 rng_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Slot*> free_;
+    std::deque<Slot*> queue_; // captured, to be written
+    LayerCaptureStats stats_;
+    bool stop_{ false };
+    std::thread writer_;
+};
+
+#endif // __layer_capture_h__
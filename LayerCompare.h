@@ -0,0 +1,291 @@
+#ifndef __layer_compare_h__
+#define __layer_compare_h__
+
+#include "LayerDump.h"
+
+#include <dmlc/json.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <thread>
+#include <vector>
+
+/*
+
+  Numerical comparison of two layer dumps (see LayerDump.h).
+
+  Layers are matched by entry id and compared element wise.  The float32
+  kernel keeps its maxima and counts in kLanes independent accumulators and
+  computes the ULP distance in a second pass, so GCC vectorizes both loops
+  at -O3 without -ffast-math (CMakeLists.txt builds tvm_layer_compare with
+  -O3 in every configuration).  Layers are distributed over a small pool of
+  std::threads.
+
+  An element diverges when |a - b| > atol + rtol * |b| or when only one side
+  is NaN.  "b" is the reference dump.  max_ulp leaves out the elements that
+  are NaN on either side (they are counted in nan_a / nan_b), and +0 / -0
+  are 0 ULP apart.  Other dtypes are compared bitwise as a whole, without an
+  element index.
+
+ */
+
+struct LayerTolerance
+{
+    double atol{ 1e-5 };
+    double rtol{ 0.1 };
+};
+
+struct LayerDiff
+{
+    uint32_t node_id{ 0 };
+    uint32_t entry_id{ 0 };
+    std::string name;
+    std::size_t size{ 0 };
+    double max_abs{ 0.0 };
+    double max_rel{ 0.0 };
+    uint64_t max_ulp{ 0 };
+    uint64_t mismatches{ 0 };
+    int64_t first_mismatch{ -1 }; // element index
+    uint64_t nan_a{ 0 }, nan_b{ 0 };
+    uint64_t inf_a{ 0 }, inf_b{ 0 };
+    bool comparable{ true }; // shape and dtype agree
+    bool exact{ false };     // bitwise comparison (non float32 dtypes)
+
+    bool diverged() const { return !comparable || mismatches > 0; }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("node_id", node_id);
+        writer->WriteObjectKeyValue("entry_id", entry_id);
+        writer->WriteObjectKeyValue("name", name);
+        writer->WriteObjectKeyValue("size", size);
+        writer->WriteObjectKeyValue("comparable", static_cast<int>(comparable));
+        writer->WriteObjectKeyValue("max_abs", max_abs);
+        writer->WriteObjectKeyValue("max_rel", max_rel);
+        writer->WriteObjectKeyValue("max_ulp", max_ulp);
+        writer->WriteObjectKeyValue("mismatches", mismatches);
+        writer->WriteObjectKeyValue("first_mismatch", first_mismatch);
+        writer->WriteObjectKeyValue("nan_a", nan_a);
+        writer->WriteObjectKeyValue("nan_b", nan_b);
+        writer->WriteObjectKeyValue("inf_a", inf_a);
+        writer->WriteObjectKeyValue("inf_b", inf_b);
+        writer->EndObject();
+    }
+};
+
+namespace layer_compare
+{
+    // Map float bits onto a monotonic integer line so ULP distance is a
+    // subtraction; sign and magnitude, so +0 and -0 both map to 0
+    inline int32_t ordered(float f)
+    {
+        int32_t i;
+        std::memcpy(&i, &f, sizeof(i));
+        const int32_t magnitude = i & 0x7fffffff;
+        return (i < 0) ? -magnitude : magnitude;
+    }
+
+    // Whether x is accepted against the reference y.  NaN compares false, so
+    // NaN is only accepted on both sides, x == y covers matching infinities
+    // (inf - inf is NaN).
+    inline int32_t accepted(float x, float y, float atol, float rtol)
+    {
+        return (std::fabs(x - y) <= atol + rtol * std::fabs(y)) | ((x != x) & (y != y)) | (x == y);
+    }
+
+    // ULP distance of x and y, 0 when either is NaN (counted separately)
+    inline uint32_t ulp_distance(float x, float y)
+    {
+        const int32_t ox = ordered(x), oy = ordered(y);
+        const uint32_t d = static_cast<uint32_t>(ox) - static_cast<uint32_t>(oy); // fits, |ox - oy| < 2^32
+        const uint32_t ulp = (ox >= oy) ? d : 0u - d;
+        return ((x != x) | (y != y)) ? 0u : ulp;
+    }
+
+    inline void compare_float32(const float* a, const float* b, std::size_t n, const LayerTolerance& tol, LayerDiff& diff)
+    {
+        constexpr std::size_t kBlock = 1024;
+        constexpr std::size_t kLanes = 8;
+
+        const float atol = static_cast<float>(tol.atol);
+        const float rtol = static_cast<float>(tol.rtol);
+        const float inf = std::numeric_limits<float>::infinity();
+
+        float max_abs = 0.f, max_rel = 0.f;
+        uint32_t max_ulp = 0;
+        uint64_t mismatches = 0, nan_a = 0, nan_b = 0, inf_a = 0, inf_b = 0;
+
+        for (std::size_t start = 0; start < n; start += kBlock)
+        {
+            const std::size_t end = std::min(n, start + kBlock);
+
+            // Per lane partial results, lane l takes the elements i % kLanes == l.
+            // A single float max accumulator does not vectorize (max with NaN is
+            // not associative, GCC wants -ffast-math), kLanes independent ones do.
+            float lane_abs[kLanes] = {}, lane_rel[kLanes] = {};
+            int32_t lane_bad[kLanes] = {}, lane_nan_a[kLanes] = {}, lane_nan_b[kLanes] = {}, lane_inf_a[kLanes] = {}, lane_inf_b[kLanes] = {};
+            uint32_t lane_ulp[kLanes] = {};
+
+            auto stats = [&](std::size_t i, std::size_t l) {
+                const float x = a[i], y = b[i];
+                const float d = std::fabs(x - y);
+                const float ok_d = (d == d) ? d : 0.f;
+                lane_abs[l] = std::max(lane_abs[l], ok_d);
+                lane_rel[l] = std::max(lane_rel[l], ok_d / (std::fabs(y) + 1e-6f));
+                lane_bad[l] += accepted(x, y, atol, rtol) ^ 1;
+                lane_nan_a[l] += (x != x);
+                lane_nan_b[l] += (y != y);
+                lane_inf_a[l] += (std::fabs(x) == inf);
+                lane_inf_b[l] += (std::fabs(y) == inf);
+            };
+            auto ulps = [&](std::size_t i, std::size_t l) { lane_ulp[l] = std::max(lane_ulp[l], ulp_distance(a[i], b[i])); };
+
+            // Errors and counts, then the ULP distance in a pass of its own (its
+            // integer compares and selects would keep the first pass scalar)
+            std::size_t i = start;
+            for (; i + kLanes <= end; i += kLanes)
+            {
+                for (std::size_t l = 0; l < kLanes; l++)
+                {
+                    stats(i + l, l);
+                }
+            }
+            for (std::size_t l = 0; i + l < end; l++)
+            {
+                stats(i + l, l);
+            }
+
+            for (i = start; i + kLanes <= end; i += kLanes)
+            {
+                for (std::size_t l = 0; l < kLanes; l++)
+                {
+                    ulps(i + l, l);
+                }
+            }
+            for (std::size_t l = 0; i + l < end; l++)
+            {
+                ulps(i + l, l);
+            }
+
+            uint32_t block_bad = 0;
+            for (std::size_t l = 0; l < kLanes; l++)
+            {
+                max_abs = std::max(max_abs, lane_abs[l]);
+                max_rel = std::max(max_rel, lane_rel[l]);
+                max_ulp = std::max(max_ulp, lane_ulp[l]);
+                block_bad += lane_bad[l];
+                nan_a += lane_nan_a[l];
+                nan_b += lane_nan_b[l];
+                inf_a += lane_inf_a[l];
+                inf_b += lane_inf_b[l];
+            }
+            mismatches += block_bad;
+
+            if (block_bad && diff.first_mismatch < 0)
+            {
+                for (i = start; i < end; i++)
+                {
+                    if (!accepted(a[i], b[i], atol, rtol))
+                    {
+                        diff.first_mismatch = static_cast<int64_t>(i);
+                        break;
+                    }
+                }
+            }
+        }
+
+        diff.max_abs = max_abs;
+        diff.max_rel = max_rel;
+        diff.max_ulp = max_ulp;
+        diff.mismatches = mismatches;
+        diff.nan_a = nan_a;
+        diff.nan_b = nan_b;
+        diff.inf_a = inf_a;
+        diff.inf_b = inf_b;
+    }
+
+    inline LayerDiff compare(const LayerDumpReader::Record& a, const LayerDumpReader::Record& b, const LayerTolerance& tol)
+    {
+        LayerDiff diff;
+        diff.node_id = b.node_id;
+        diff.entry_id = b.entry_id;
+        diff.name = b.name;
+        diff.size = b.size();
+
+        const bool same_dtype = (a.dtype.code == b.dtype.code) && (a.dtype.bits == b.dtype.bits) && (a.dtype.lanes == b.dtype.lanes);
+        if (!same_dtype || (a.shape != b.shape) || (a.nbytes != b.nbytes))
+        {
+            diff.comparable = false;
+            return diff;
+        }
+
+        if (b.dtype.code == kDLFloat && b.dtype.bits == 32)
+        {
+            const float* x = reinterpret_cast<const float*>(a.data);
+            const float* y = reinterpret_cast<const float*>(b.data);
+            compare_float32(x, y, b.nbytes / sizeof(float), tol, diff);
+        }
+        else
+        {
+            diff.exact = true;
+            diff.mismatches = (std::memcmp(a.data, b.data, b.nbytes) != 0) ? 1 : 0;
+        }
+        return diff;
+    }
+}
+
+// Compare all layers present in both dumps, in parallel.  The result is
+// sorted by node id, i.e. in topological order of the graph nodes_.
+inline std::vector<LayerDiff> compare_layers(const LayerDumpReader& a, const LayerDumpReader& b, const LayerTolerance& tol, int threads)
+{
+    std::map<uint32_t, const LayerDumpReader::Record*> by_entry;
+    for (const auto& ra : a.records())
+    {
+        by_entry[ra.entry_id] = &ra;
+    }
+
+    std::vector<std::pair<const LayerDumpReader::Record*, const LayerDumpReader::Record*>> pairs;
+    for (const auto& rb : b.records())
+    {
+        auto iter = by_entry.find(rb.entry_id);
+        if (iter != by_entry.end())
+        {
+            pairs.emplace_back(iter->second, &rb);
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end(), [](const decltype(pairs)::value_type& x, const decltype(pairs)::value_type& y) {
+        return x.second->node_id < y.second->node_id || (x.second->node_id == y.second->node_id && x.second->entry_id < y.second->entry_id);
+    });
+
+    std::vector<LayerDiff> diffs(pairs.size());
+    std::atomic<std::size_t> next{ 0 };
+    auto worker = [&]() {
+        for (std::size_t i = next++; i < pairs.size(); i = next++)
+        {
+            diffs[i] = layer_compare::compare(*pairs[i].first, *pairs[i].second, tol);
+        }
+    };
+
+    threads = std::max(1, std::min<int>(threads, static_cast<int>(pairs.size())));
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool)
+    {
+        t.join();
+    }
+
+    return diffs;
+}
+
+#endif // __layer_compare_h__
@@ -0,0 +1,334 @@
+#ifndef __layer_dump_h__
+#define __layer_dump_h__
+
+#include "DataType.h"
+#include "MappedFile.h"
+
+#include <dlpack/dlpack.h>
+#include <dmlc/logging.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+
+  Binary layer dump container.
+
+  One file holds every captured layer of a run:
+
+    Header  : magic "TCTLAYR1", uint32 version, uint32 count, uint64 index_offset
+    Payload : raw tensor bytes, each record aligned to kAlignment
+    Index   : count records of
+              uint32 node_id, uint32 entry_id, DLDataType dtype,
+              uint32 ndim, int64 shape[ndim], uint64 offset, uint64 nbytes,
+              uint32 name_length, char name[name_length]
+
+  The index is written last, so layers can be streamed out as they are
+  captured.  All fields are native (little) endian.  LayerDumpReader maps the
+  file and hands out pointers straight into the mapping, so nothing is parsed
+  or copied per element.
+
+ */
+
+namespace layer_dump
+{
+    constexpr char kMagic[8] = { 'T', 'C', 'T', 'L', 'A', 'Y', 'R', '1' };
+    constexpr uint32_t kVersion = 1;
+    constexpr uint64_t kAlignment = 64;
+    // Index record with ndim and name_length 0
+    constexpr std::size_t kMinRecordBytes = 4 + 4 + sizeof(DLDataType) + 4 + 8 + 8 + 4;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t index_offset;
+    };
+}
+
+class LayerDumpWriter
+{
+public:
+    explicit LayerDumpWriter(const std::string& filename)
+        : ofs_(filename, std::ios::binary)
+    {
+        if (ofs_)
+        {
+            // Placeholder, patched with count and index_offset in Close()
+            layer_dump::Header header{};
+            std::memcpy(header.magic, layer_dump::kMagic, sizeof(header.magic));
+            header.version = layer_dump::kVersion;
+            write(&header, sizeof(header));
+        }
+    }
+
+    ~LayerDumpWriter()
+    {
+        Close();
+    }
+
+    bool good() const { return static_cast<bool>(ofs_); }
+
+    void Write(uint32_t node_id, uint32_t entry_id, const std::string& name, DLDataType dtype, const std::vector<int64_t>& shape, const void* data, std::size_t nbytes)
+    {
+        CHECK(!closed_) << "layer dump already closed";
+
+        pad();
+
+        Record record;
+        record.node_id = node_id;
+        record.entry_id = entry_id;
+        record.dtype = dtype;
+        record.shape = shape;
+        record.offset = offset_;
+        record.nbytes = nbytes;
+        record.name = name;
+        records_.push_back(record);
+
+        write(data, nbytes);
+    }
+
+    // Write the index and the header; false if anything failed, the flush
+    // on close included
+    bool Close()
+    {
+        if (closed_ || !ofs_)
+        {
+            closed_ = true;
+            return static_cast<bool>(ofs_);
+        }
+        closed_ = true;
+
+        pad();
+        const uint64_t index_offset = offset_;
+        for (const auto& r : records_)
+        {
+            const uint32_t ndim = static_cast<uint32_t>(r.shape.size());
+            const uint32_t name_length = static_cast<uint32_t>(r.name.size());
+            write(&r.node_id, sizeof(r.node_id));
+            write(&r.entry_id, sizeof(r.entry_id));
+            write(&r.dtype, sizeof(r.dtype));
+            write(&ndim, sizeof(ndim));
+            write(r.shape.data(), ndim * sizeof(int64_t));
+            write(&r.offset, sizeof(r.offset));
+            write(&r.nbytes, sizeof(r.nbytes));
+            write(&name_length, sizeof(name_length));
+            write(r.name.data(), name_length);
+        }
+
+        layer_dump::Header header{};
+        std::memcpy(header.magic, layer_dump::kMagic, sizeof(header.magic));
+        header.version = layer_dump::kVersion;
+        header.count = static_cast<uint32_t>(records_.size());
+        header.index_offset = index_offset;
+        ofs_.seekp(0, std::ios::beg);
+        ofs_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs_.close();
+        return static_cast<bool>(ofs_);
+    }
+
+private:
+    struct Record
+    {
+        uint32_t node_id;
+        uint32_t entry_id;
+        DLDataType dtype;
+        std::vector<int64_t> shape;
+        uint64_t offset;
+        uint64_t nbytes;
+        std::string name;
+    };
+
+    void write(const void* data, std::size_t nbytes)
+    {
+        ofs_.write(static_cast<const char*>(data), nbytes);
+        offset_ += nbytes;
+    }
+
+    void pad()
+    {
+        static const char zeros[layer_dump::kAlignment] = {};
+        const uint64_t rem = offset_ % layer_dump::kAlignment;
+        if (rem)
+        {
+            write(zeros, layer_dump::kAlignment - rem);
+        }
+    }
+
+    std::ofstream ofs_;
+    std::vector<Record> records_;
+    uint64_t offset_{ 0 };
+    bool closed_{ false };
+};
+
+class LayerDumpReader
+{
+public:
+    struct Record
+    {
+        uint32_t node_id;
+        uint32_t entry_id;
+        DLDataType dtype;
+        std::vector<int64_t> shape;
+        std::string name;
+        const char* data; // points into the mapping
+        std::size_t nbytes;
+
+        std::size_t size() const { return element_count(shape); }
+    };
+
+    LayerDumpReader() = default;
+
+    explicit LayerDumpReader(const std::string& filename)
+    {
+        open(filename);
+    }
+
+    bool open(const std::string& filename)
+    {
+        records_.clear();
+        if (!file_.open(filename))
+        {
+            return false;
+        }
+
+        layer_dump::Header header;
+        CHECK_GE(file_.size(), sizeof(header)) << "truncated layer dump " << filename;
+        std::memcpy(&header, file_.data(), sizeof(header));
+        CHECK(std::memcmp(header.magic, layer_dump::kMagic, sizeof(header.magic)) == 0) << "not a layer dump " << filename;
+        CHECK_EQ(header.version, layer_dump::kVersion) << "unsupported layer dump version " << header.version;
+        CHECK_LE(header.index_offset, file_.size()) << "truncated layer dump " << filename;
+
+        const char* ptr = file_.data() + header.index_offset;
+        const char* end = file_.data() + file_.size();
+        // Counts come from the file, check them against its size before allocating
+        CHECK_LE(header.count, (file_.size() - header.index_offset) / layer_dump::kMinRecordBytes) << "corrupt layer dump " << filename;
+        records_.resize(header.count);
+        for (auto& r : records_)
+        {
+            uint32_t ndim = 0, name_length = 0;
+            uint64_t offset = 0, nbytes = 0;
+            read(ptr, end, &r.node_id, sizeof(r.node_id));
+            read(ptr, end, &r.entry_id, sizeof(r.entry_id));
+            read(ptr, end, &r.dtype, sizeof(r.dtype));
+            read(ptr, end, &ndim, sizeof(ndim));
+            CHECK_LE(ndim, static_cast<std::size_t>(end - ptr) / sizeof(int64_t)) << "corrupt layer dump index";
+            r.shape.resize(ndim);
+            read(ptr, end, r.shape.data(), ndim * sizeof(int64_t));
+            read(ptr, end, &offset, sizeof(offset));
+            read(ptr, end, &nbytes, sizeof(nbytes));
+            read(ptr, end, &name_length, sizeof(name_length));
+            CHECK_LE(name_length, static_cast<std::size_t>(end - ptr)) << "corrupt layer dump index";
+            r.name.assign(ptr, name_length);
+            ptr += name_length;
+
+            CHECK(offset <= header.index_offset && nbytes <= header.index_offset - offset) << "corrupt layer dump record " << r.name;
+            r.data = file_.data() + offset;
+            r.nbytes = static_cast<std::size_t>(nbytes);
+        }
+        return true;
+    }
+
+    const std::vector<Record>& records() const { return records_; }
+    std::size_t size() const { return records_.size(); }
+    const Record& operator[](std::size_t i) const { return records_[i]; }
+
+private:
+    static void read(const char*& ptr, const char* end, void* out, std::size_t nbytes)
+    {
+        CHECK_LE(nbytes, static_cast<std::size_t>(end - ptr)) << "corrupt layer dump index";
+        std::memcpy(out, ptr, nbytes);
+        ptr += nbytes;
+    }
+
+    MappedFile file_;
+    std::vector<Record> records_;
+};
+
+// Iterator for N dimensional array
+inline void iterate(int dimensions, int64_t* ordinates, const int64_t* maximums)
+{
+    for (int d = dimensions - 1; d >= 0; d--)
+    {
+        if ((ordinates[d] + 1) < maximums[d])
+        {
+            ordinates[d]++;
+            break;
+        }
+
+        ordinates[d] = 0;
+    }
+}
+
+template <typename T>
+void print_values(const LayerDumpReader::Record& record, std::ostream& os)
+{
+    const int ndim = static_cast<int>(record.shape.size());
+
+    std::string shape;
+    for (int d = 0; d < ndim; d++)
+    {
+        shape += std::to_string(record.shape[d]);
+        if (d < ndim - 1)
+        {
+            shape += ", ";
+        }
+    }
+
+    const T* values = reinterpret_cast<const T*>(record.data);
+    const std::size_t count = record.nbytes / sizeof(T);
+
+    std::vector<int64_t> ord(ndim, 0);
+    for (std::size_t k = 0; k < count; k++)
+    {
+        os << "value[";
+        for (int d = 0; d < ndim; d++)
+        {
+            os << ord[d];
+            if (d < ndim - 1)
+            {
+                os << ", ";
+            }
+        }
+        os << "] = {" << shape << "} = " << +values[k] << '\n';
+        iterate(ndim, ord.data(), record.shape.data());
+    }
+}
+
+// Print a layer in flat diff friendly 'value[i,j,k...] = {shape} = value' format:
+inline void print(const LayerDumpReader::Record& record, std::ostream& os)
+{
+    const auto& t = record.dtype;
+    if (t.code == kDLFloat && t.bits == 32)
+    {
+        print_values<float>(record, os);
+    }
+    else if (t.code == kDLFloat && t.bits == 64)
+    {
+        print_values<double>(record, os);
+    }
+    else if (t.code == kDLInt && t.bits == 32)
+    {
+        print_values<int32_t>(record, os);
+    }
+    else if (t.code == kDLInt && t.bits == 8)
+    {
+        print_values<int8_t>(record, os);
+    }
+    else if (t.code == kDLUInt && t.bits == 8)
+    {
+        print_values<uint8_t>(record, os);
+    }
+    else
+    {
+        LOG(FATAL) << "no text conversion for " << dltype_string(t) << " layer " << record.name;
+    }
+}
+
+#endif // __layer_dump_h__
@@ -0,0 +1,358 @@
+#ifndef __layer_fingerprint_h__
+#define __layer_fingerprint_h__
+
+#include "DataType.h"
+
+#include <dlpack/dlpack.h>
+#include <dmlc/json.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+
+  Per layer fingerprints: a few numbers per layer instead of every element,
+  so two runs or two back-ends can be compared in milliseconds and full
+  dumps (LayerDump.h) taken only for the layers that diverge.
+
+  A float32 layer gives min, max, mean, L2 norm, NaN and Inf counts (NaN
+  and Inf excluded from the others) and a tolerance bucketed hash: every
+  element is rounded to a multiple of the quantum, hashed with its index,
+  and the element hashes are summed.  Per block of the layer, the
+  statistics are one pass over per lane accumulators, which GCC vectorizes
+  at -O3 (as the comparison kernel of LayerCompare.h, not in the Debug
+  builds of build-host.sh / build-android.sh); the hash is a second, scalar
+  pass over the block while it is still in cache.  Equal hashes mean equal
+  layers within the quantum; a value close to a bucket boundary can still
+  flip a hash, which the min / max / mean / L2 deltas tell apart from a
+  real divergence.  Other dtypes hash their raw bytes.
+
+  File format, native (little) endian:
+
+    Header  : magic "TCTFPRT1", uint32 version, uint32 count, double quantum
+    Records : uint32 node_id, uint32 entry_id, DLDataType dtype,
+              uint64 size, double min, max, mean, l2, uint64 nan, inf, hash,
+              uint32 name_length, char name[name_length]
+
+ */
+
+struct LayerFingerprint
+{
+    uint32_t node_id{ 0 };
+    uint32_t entry_id{ 0 };
+    std::string name;
+    DLDataType dtype{ kDLFloat, 32, 1 };
+    uint64_t size{ 0 }; // elements
+    double min{ 0.0 };
+    double max{ 0.0 };
+    double mean{ 0.0 };
+    double l2{ 0.0 };
+    uint64_t nan{ 0 };
+    uint64_t inf{ 0 };
+    uint64_t hash{ 0 };
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("node_id", node_id);
+        writer->WriteObjectKeyValue("entry_id", entry_id);
+        writer->WriteObjectKeyValue("name", name);
+        writer->WriteObjectKeyValue("size", size);
+        writer->WriteObjectKeyValue("min", min);
+        writer->WriteObjectKeyValue("max", max);
+        writer->WriteObjectKeyValue("mean", mean);
+        writer->WriteObjectKeyValue("l2", l2);
+        writer->WriteObjectKeyValue("nan", nan);
+        writer->WriteObjectKeyValue("inf", inf);
+        writer->WriteObjectKeyValue("hash", hash);
+        writer->EndObject();
+    }
+};
+
+namespace layer_fingerprint
+{
+    constexpr char kMagic[8] = { 'T', 'C', 'T', 'F', 'P', 'R', 'T', '1' };
+    constexpr uint32_t kVersion = 1;
+
+    // splitmix64 finalizer
+    inline uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // x if keep is 1, +0 if keep is 0, by masking the bits
+    inline float zero_unless(float x, int32_t keep)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        bits &= 0u - static_cast<uint32_t>(keep);
+        std::memcpy(&x, &bits, sizeof(x));
+        return x;
+    }
+
+    inline void compute_float32(const float* data, std::size_t n, double quantum, LayerFingerprint& fp)
+    {
+        constexpr std::size_t kBlock = 1024;
+        constexpr std::size_t kLanes = 8;
+        const float inv_quantum = static_cast<float>(1.0 / quantum);
+        const float kInf = std::numeric_limits<float>::infinity();
+        const float kBucketLimit = 9.0e18f; // buckets stay in int64 range
+
+        float lo = kInf, hi = -kInf;
+        double sum = 0.0, sum_sq = 0.0;
+        uint64_t nan = 0, inf = 0, hash = 0;
+        for (std::size_t start = 0; start < n; start += kBlock)
+        {
+            const std::size_t end = std::min(n, start + kBlock);
+
+            // Statistics pass.  Lane l reduces the elements i % kLanes == l:
+            // float sums and min / max are not associative, so one accumulator
+            // each stays scalar without -ffast-math, kLanes of them vectorize.
+            // Float partials over at most kBlock values bound the rounding
+            // error, each block is folded into the double totals.
+            float lane_lo[kLanes], lane_hi[kLanes], lane_sum[kLanes] = {}, lane_sq[kLanes] = {};
+            int32_t lane_nan[kLanes] = {}, lane_inf[kLanes] = {};
+            std::fill(lane_lo, lane_lo + kLanes, kInf);
+            std::fill(lane_hi, lane_hi + kLanes, -kInf);
+
+            // No selects: GCC turns them back into branches here (it moves
+            // the square into the finite branch), which stops the vectorizer
+            auto stats = [&](std::size_t i, std::size_t l) {
+                const float x = data[i];
+                const int32_t is_nan = (x != x);
+                const int32_t is_inf = (std::fabs(x) == kInf);
+                const float finite = zero_unless(x, (is_nan | is_inf) ^ 1);
+
+                // x - x is NaN for NaN and +-Inf (not folded to 0 unless built
+                // with -ffinite-math-only), and std::min / std::max keep their
+                // first argument against NaN
+                const float finite_or_nan = x + (x - x);
+                lane_lo[l] = std::min(lane_lo[l], finite_or_nan);
+                lane_hi[l] = std::max(lane_hi[l], finite_or_nan);
+                lane_sum[l] += finite;
+                lane_sq[l] += finite * finite;
+                lane_nan[l] += is_nan;
+                lane_inf[l] += is_inf;
+            };
+
+            std::size_t i = start;
+            for (; i + kLanes <= end; i += kLanes)
+            {
+                for (std::size_t l = 0; l < kLanes; l++)
+                {
+                    stats(i + l, l);
+                }
+            }
+            for (std::size_t l = 0; i + l < end; l++)
+            {
+                stats(i + l, l);
+            }
+
+            float block_sum = 0.f, block_sq = 0.f;
+            for (std::size_t l = 0; l < kLanes; l++)
+            {
+                lo = std::min(lo, lane_lo[l]);
+                hi = std::max(hi, lane_hi[l]);
+                block_sum += lane_sum[l];
+                block_sq += lane_sq[l];
+                nan += lane_nan[l];
+                inf += lane_inf[l];
+            }
+            sum += block_sum;
+            sum_sq += block_sq;
+
+            // Hash pass, scalar: the rounding to int64 buckets and the 64 bit
+            // multiplies of mix() have no SSE / NEON form.  NaN and +-Inf get
+            // buckets of their own beyond the finite range.
+            for (i = start; i < end; i++)
+            {
+                const float x = data[i];
+                const bool is_nan = (x != x);
+                const bool is_inf = (std::fabs(x) == kInf);
+                const float scaled = std::max(std::min(std::round(x * inv_quantum), kBucketLimit), -kBucketLimit);
+                const int64_t bucket = is_nan ? INT64_MIN : (is_inf ? ((x > 0.f) ? INT64_MAX : INT64_MIN + 1) : static_cast<int64_t>(scaled));
+                hash += mix(static_cast<uint64_t>(bucket) ^ (static_cast<uint64_t>(i) * 0x9e3779b97f4a7c15ULL));
+            }
+        }
+
+        const uint64_t finite = n - nan - inf;
+        fp.min = finite ? lo : 0.0;
+        fp.max = finite ? hi : 0.0;
+        fp.mean = finite ? sum / finite : 0.0;
+        fp.l2 = std::sqrt(sum_sq);
+        fp.nan = nan;
+        fp.inf = inf;
+        fp.hash = hash;
+    }
+
+    // FNV-1a over raw bytes
+    inline uint64_t hash_bytes(const void* data, std::size_t nbytes)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (std::size_t i = 0; i < nbytes; i++)
+        {
+            h = (h ^ p[i]) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    template <typename T>
+    void write(std::ofstream& ofs, const T& value)
+    {
+        ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool read(std::ifstream& ifs, T& value)
+    {
+        return static_cast<bool>(ifs.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+}
+
+inline LayerFingerprint fingerprint_layer(uint32_t node_id, uint32_t entry_id, const std::string& name, DLDataType dtype, const void* data, std::size_t nbytes, double quantum)
+{
+    LayerFingerprint fp;
+    fp.node_id = node_id;
+    fp.entry_id = entry_id;
+    fp.name = name;
+    fp.dtype = dtype;
+    fp.size = nbytes / std::max<std::size_t>((dtype.bits * dtype.lanes + 7) / 8, 1);
+    if (dtype.code == kDLFloat && dtype.bits == 32 && dtype.lanes == 1)
+    {
+        layer_fingerprint::compute_float32(static_cast<const float*>(data), fp.size, quantum, fp);
+    }
+    else
+    {
+        fp.hash = layer_fingerprint::hash_bytes(data, nbytes);
+    }
+    return fp;
+}
+
+inline bool is_fingerprint_file(const std::string& filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    char magic[8] = {};
+    return ifs.read(magic, sizeof(magic)) && std::memcmp(magic, layer_fingerprint::kMagic, sizeof(magic)) == 0;
+}
+
+inline bool save_fingerprints(const std::string& filename, double quantum, const std::vector<LayerFingerprint>& layers)
+{
+    using namespace layer_fingerprint;
+
+    std::ofstream ofs(filename, std::ios::binary);
+    ofs.write(kMagic, sizeof(kMagic));
+    write(ofs, kVersion);
+    write(ofs, static_cast<uint32_t>(layers.size()));
+    write(ofs, quantum);
+    for (const auto& fp : layers)
+    {
+        write(ofs, fp.node_id);
+        write(ofs, fp.entry_id);
+        write(ofs, fp.dtype);
+        write(ofs, fp.size);
+        write(ofs, fp.min);
+        write(ofs, fp.max);
+        write(ofs, fp.mean);
+        write(ofs, fp.l2);
+        write(ofs, fp.nan);
+        write(ofs, fp.inf);
+        write(ofs, fp.hash);
+        write(ofs, static_cast<uint32_t>(fp.name.size()));
+        ofs.write(fp.name.data(), fp.name.size());
+    }
+    return static_cast<bool>(ofs);
+}
+
+inline bool load_fingerprints(const std::string& filename, double& quantum, std::vector<LayerFingerprint>& layers)
+{
+    using namespace layer_fingerprint;
+
+    std::ifstream ifs(filename, std::ios::binary);
+    char magic[8] = {};
+    uint32_t version = 0, count = 0;
+    if (!ifs.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(magic)) != 0 || !read(ifs, version) || version != kVersion || !read(ifs, count) || !read(ifs, quantum))
+    {
+        return false;
+    }
+
+    layers.assign(count, LayerFingerprint());
+    for (auto& fp : layers)
+    {
+        uint32_t name_length = 0;
+        if (!(read(ifs, fp.node_id) && read(ifs, fp.entry_id) && read(ifs, fp.dtype) && read(ifs, fp.size) && read(ifs, fp.min) && read(ifs, fp.max) && read(ifs, fp.mean) && read(ifs, fp.l2) && read(ifs, fp.nan) && read(ifs, fp.inf) && read(ifs, fp.hash) && read(ifs, name_length)))
+        {
+            return false;
+        }
+        fp.name.resize(name_length);
+        if (name_length && !ifs.read(&fp.name[0], name_length))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct FingerprintDiff
+{
+    LayerFingerprint a, b; // b : reference
+
+    bool comparable() const { return a.size == b.size && a.dtype.code == b.dtype.code && a.dtype.bits == b.dtype.bits && a.dtype.lanes == b.dtype.lanes; }
+    bool diverged() const { return !comparable() || a.hash != b.hash || a.nan != b.nan || a.inf != b.inf; }
+
+    // Largest difference of min, max and mean: below the quantum a hash
+    // mismatch is most likely a value on a bucket boundary
+    double max_stat_diff() const { return std::max(std::fabs(a.mean - b.mean), std::max(std::fabs(a.min - b.min), std::fabs(a.max - b.max))); }
+    double l2_rel_diff() const { return std::fabs(a.l2 - b.l2) / std::max(b.l2, 1e-12); }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("node_id", b.node_id);
+        writer->WriteObjectKeyValue("entry_id", b.entry_id);
+        writer->WriteObjectKeyValue("name", b.name);
+        writer->WriteObjectKeyValue("diverged", static_cast<int>(diverged()));
+        writer->WriteObjectKeyValue("max_stat_diff", max_stat_diff());
+        writer->WriteObjectKeyValue("l2_rel_diff", l2_rel_diff());
+        writer->WriteObjectKeyValue("test", a);
+        writer->WriteObjectKeyValue("reference", b);
+        writer->EndObject();
+    }
+};
+
+// Layers present in both, matched by entry id, sorted by node id
+inline std::vector<FingerprintDiff> compare_fingerprints(const std::vector<LayerFingerprint>& a, const std::vector<LayerFingerprint>& b)
+{
+    std::map<uint32_t, const LayerFingerprint*> by_entry;
+    for (const auto& fp : a)
+    {
+        by_entry[fp.entry_id] = &fp;
+    }
+
+    std::vector<FingerprintDiff> diffs;
+    for (const auto& fp : b)
+    {
+        auto it = by_entry.find(fp.entry_id);
+        if (it != by_entry.end())
+        {
+            diffs.push_back({ *it->second, fp });
+        }
+    }
+    std::sort(diffs.begin(), diffs.end(), [](const FingerprintDiff& x, const FingerprintDiff& y) {
+        return x.b.node_id < y.b.node_id || (x.b.node_id == y.b.node_id && x.b.entry_id < y.b.entry_id);
+    });
+    return diffs;
+}
+
+#endif // __layer_fingerprint_h__
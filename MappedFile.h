@@ -0,0 +1,126 @@
+#ifndef __mapped_file_h__
+#define __mapped_file_h__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+/*
+
+  Minimal read-only memory mapped file (POSIX, Linux and Android).
+
+  The mapping is private and read only, so its pages are shared with the
+  page cache rather than copied.  Touched pages still count toward the
+  process RSS (as file backed pages the kernel can drop and read back).
+  Empty files are "open" with a null data pointer and zero size.
+
+ */
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& filename)
+    {
+        open(filename);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other)
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other)
+    {
+        if (this != &other)
+        {
+            close();
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            std::swap(open_, other.open_);
+        }
+        return *this;
+    }
+
+    bool open(const std::string& filename)
+    {
+        close();
+
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0)
+        {
+            void* ptr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED)
+            {
+                ::close(fd);
+                size_ = 0;
+                return false;
+            }
+            data_ = static_cast<const char*>(ptr);
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+        open_ = true;
+        return true;
+    }
+
+    void close()
+    {
+        if (data_)
+        {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        open_ = false;
+    }
+
+    // Hint the expected access pattern, e.g. MADV_SEQUENTIAL or MADV_WILLNEED
+    void advise(int advice) const
+    {
+        if (data_)
+        {
+            ::madvise(const_cast<char*>(data_), size_, advice);
+        }
+    }
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool is_open() const { return open_; }
+    explicit operator bool() const { return open_; }
+
+private:
+    const char* data_{ nullptr };
+    std::size_t size_{ 0 };
+    bool open_{ false };
+};
+
+#endif // __mapped_file_h__
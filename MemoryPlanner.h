@@ -0,0 +1,444 @@
+#ifndef __memory_planner_h__
+#define __memory_planner_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+
+#include <dmlc/json.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+
+  Offline storage planner for the graph runtime.
+
+  The graph runtime allocates one pool entry per storage_id, sized to the
+  largest entry mapped to it (see GraphRuntime::SetupStorage), and never
+  looks at liveness.  Here we recompute tensor liveness from nodes_ and
+  assign storage ids again so that the sum of the pool entries gets smaller.
+
+  - Entries of "null" nodes (inputs and parameters) keep dedicated storage,
+    they are written once and read by every run.
+  - "__nop" ops (e.g. reshape/flatten) do not copy: their output aliases
+    their first input, so both are planned as one tensor.
+  - Graph outputs stay alive until the end of the run.
+  - An op reads its inputs while writing its outputs, so a tensor whose last
+    use is node t can only be reused by tensors produced after t.
+
+  Two strategies are available: greedy by size (largest tensors first, each
+  placed in the smallest compatible existing object) and best fit in
+  topological order with a free list (closest to nnvm's PlanMemory).  Sizes
+  are rounded up to the given alignment.
+
+ */
+
+struct MemoryPlan
+{
+    std::string strategy;
+    /*! \brief Storage id per node entry. */
+    std::vector<int> storage_id;
+    /*! \brief Pool entry per storage id (size in bytes, device type). */
+    std::vector<GraphRuntimePrivateStuff::PoolEntry> pool;
+
+    std::size_t total() const
+    {
+        std::size_t bytes = 0;
+        for (const auto& e : pool)
+        {
+            bytes += e.size;
+        }
+        return bytes;
+    }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("strategy", strategy);
+        writer->WriteObjectKeyValue("total_bytes", total());
+        writer->WriteObjectKeyValue("pool_entries", pool.size());
+        writer->EndObject();
+    }
+};
+
+class MemoryPlanner
+{
+public:
+    explicit MemoryPlanner(const GraphRuntimePrivateStuff& info, std::size_t alignment = 64)
+        : info_(info)
+        , alignment_(std::max<std::size_t>(alignment, 1))
+    {
+        Analyze();
+    }
+
+    // The storage assignment of the graph as compiled, sized like SetupStorage()
+    MemoryPlan Current() const
+    {
+        MemoryPlan plan;
+        plan.strategy = "current";
+        plan.storage_id = info_.attrs_.storage_id;
+        for (std::size_t eid = 0; eid < plan.storage_id.size(); eid++)
+        {
+            const int sid = plan.storage_id[eid];
+            CHECK_GE(sid, 0) << "Do not support runtime shape op";
+            if (static_cast<std::size_t>(sid) >= plan.pool.size())
+            {
+                plan.pool.resize(sid + 1, GraphRuntimePrivateStuff::PoolEntry(0, -1));
+            }
+            auto& entry = plan.pool[sid];
+            entry.size = std::max(entry.size, (entry_bytes_[eid] + 3) / 4 * 4);
+            entry.device_type = entry_device_[eid];
+        }
+        return plan;
+    }
+
+    // Largest tensors first, each into the smallest object free over its lifetime
+    MemoryPlan GreedyBySize() const
+    {
+        MemoryPlan plan = Begin("greedy_by_size");
+
+        std::vector<std::size_t> order;
+        for (std::size_t t = 0; t < tensors_.size(); t++)
+        {
+            if (!tensors_[t].fixed)
+            {
+                order.push_back(t);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            return tensors_[a].bytes > tensors_[b].bytes;
+        });
+
+        // Lifetimes already placed in each object
+        std::vector<std::vector<std::size_t>> placed(plan.pool.size());
+        for (auto t : order)
+        {
+            const Tensor& tensor = tensors_[t];
+            int best = -1;
+            for (std::size_t sid = num_fixed_; sid < plan.pool.size(); sid++)
+            {
+                if (plan.pool[sid].device_type != tensor.device)
+                {
+                    continue;
+                }
+
+                bool overlap = false;
+                for (auto other : placed[sid])
+                {
+                    if (Overlaps(tensor, tensors_[other]))
+                    {
+                        overlap = true;
+                        break;
+                    }
+                }
+
+                if (!overlap && (best < 0 || plan.pool[sid].size < plan.pool[best].size))
+                {
+                    best = static_cast<int>(sid);
+                }
+            }
+
+            if (best < 0)
+            {
+                best = static_cast<int>(plan.pool.size());
+                plan.pool.push_back(GraphRuntimePrivateStuff::PoolEntry(0, tensor.device));
+                placed.emplace_back();
+            }
+
+            Assign(plan, t, best);
+            placed[best].push_back(t);
+        }
+        return plan;
+    }
+
+    // Topological order with a free list: reuse the smallest free object that
+    // fits, else grow the largest free one, else allocate a new one
+    MemoryPlan BestFit() const
+    {
+        MemoryPlan plan = Begin("best_fit");
+
+        const uint32_t num_nodes = static_cast<uint32_t>(info_.nodes_.size());
+        std::vector<std::vector<std::size_t>> defined(num_nodes + 1), released(num_nodes + 1);
+        for (std::size_t t = 0; t < tensors_.size(); t++)
+        {
+            if (!tensors_[t].fixed)
+            {
+                defined[tensors_[t].first].push_back(t);
+                released[tensors_[t].last].push_back(t);
+            }
+        }
+
+        std::vector<int> tensor_sid(tensors_.size(), -1);
+        std::vector<int> free_list;
+        for (uint32_t nid = 0; nid <= num_nodes; nid++)
+        {
+            for (auto t : defined[nid])
+            {
+                const Tensor& tensor = tensors_[t];
+                int fit = -1, largest = -1;
+                for (std::size_t k = 0; k < free_list.size(); k++)
+                {
+                    const auto& entry = plan.pool[free_list[k]];
+                    if (entry.device_type != tensor.device)
+                    {
+                        continue;
+                    }
+                    if (entry.size >= tensor.bytes && (fit < 0 || entry.size < plan.pool[free_list[fit]].size))
+                    {
+                        fit = static_cast<int>(k);
+                    }
+                    if (largest < 0 || entry.size > plan.pool[free_list[largest]].size)
+                    {
+                        largest = static_cast<int>(k);
+                    }
+                }
+
+                int sid;
+                const int pick = (fit >= 0) ? fit : largest;
+                if (pick >= 0)
+                {
+                    sid = free_list[pick];
+                    free_list.erase(free_list.begin() + pick);
+                }
+                else
+                {
+                    sid = static_cast<int>(plan.pool.size());
+                    plan.pool.push_back(GraphRuntimePrivateStuff::PoolEntry(0, tensor.device));
+                }
+
+                Assign(plan, t, sid);
+                tensor_sid[t] = sid;
+            }
+
+            // Release after allocation: inputs are still read while outputs are written
+            for (auto t : released[nid])
+            {
+                free_list.push_back(tensor_sid[t]);
+            }
+        }
+        return plan;
+    }
+
+    // The better of both strategies
+    MemoryPlan Best() const
+    {
+        MemoryPlan greedy = GreedyBySize();
+        MemoryPlan best_fit = BestFit();
+        return (best_fit.total() < greedy.total()) ? best_fit : greedy;
+    }
+
+    // Peak of the bytes that are live at the same time, i.e. what a perfect
+    // (offset based) allocator would need.  No storage_id assignment can go
+    // below this.
+    std::size_t LowerBound() const
+    {
+        const uint32_t num_nodes = static_cast<uint32_t>(info_.nodes_.size());
+        std::vector<int64_t> delta(num_nodes + 2, 0);
+        for (const auto& tensor : tensors_)
+        {
+            if (!tensor.fixed)
+            {
+                delta[tensor.first] += static_cast<int64_t>(tensor.bytes);
+                delta[tensor.last + 1] -= static_cast<int64_t>(tensor.bytes);
+            }
+        }
+
+        int64_t live = 0, peak = 0;
+        for (auto d : delta)
+        {
+            live += d;
+            peak = std::max(peak, live);
+        }
+        return fixed_bytes_ + static_cast<std::size_t>(peak);
+    }
+
+    // No two tensors with overlapping lifetimes may share a storage id
+    bool Validate(const MemoryPlan& plan) const
+    {
+        std::vector<std::vector<std::size_t>> by_sid(plan.pool.size());
+        for (std::size_t t = 0; t < tensors_.size(); t++)
+        {
+            const int sid = plan.storage_id[tensors_[t].entries.front()];
+            for (auto eid : tensors_[t].entries)
+            {
+                if (plan.storage_id[eid] != sid || plan.pool[sid].size < entry_bytes_[eid])
+                {
+                    return false;
+                }
+            }
+
+            for (auto other : by_sid[sid])
+            {
+                if (tensors_[t].fixed || tensors_[other].fixed || Overlaps(tensors_[t], tensors_[other]))
+                {
+                    return false;
+                }
+            }
+            by_sid[sid].push_back(t);
+        }
+        return true;
+    }
+
+    // Rewrite attrs_.storage_id of a graph with the plan
+    static void Apply(const MemoryPlan& plan, GraphRuntimePrivateStuff& info)
+    {
+        CHECK_EQ(plan.storage_id.size(), info.attrs_.storage_id.size());
+        info.attrs_.storage_id = plan.storage_id;
+    }
+
+    /*! \brief Bytes held by inputs and parameters (never shared). */
+    std::size_t fixed_bytes() const { return fixed_bytes_; }
+    /*! \brief Bytes of all planned (activation) tensors, without sharing. */
+    std::size_t activation_bytes() const { return activation_bytes_; }
+    std::size_t num_tensors() const { return tensors_.size(); }
+
+private:
+    struct Tensor
+    {
+        std::size_t bytes{ 0 }; // aligned
+        uint32_t first{ 0 };    // producing node
+        uint32_t last{ 0 };     // last consuming node (num_nodes: graph output)
+        int device{ 0 };
+        bool fixed{ false };
+        std::vector<uint32_t> entries;
+    };
+
+    static bool Overlaps(const Tensor& a, const Tensor& b)
+    {
+        return a.first <= b.last && b.first <= a.last;
+    }
+
+    void Analyze()
+    {
+        const auto& attrs = info_.attrs_;
+        const uint32_t num_entries = info_.num_node_entries();
+        const uint32_t num_nodes = static_cast<uint32_t>(info_.nodes_.size());
+        CHECK_EQ(attrs.shape.size(), num_entries);
+        CHECK_EQ(attrs.dltype.size(), num_entries);
+
+        entry_bytes_.resize(num_entries);
+        entry_device_.resize(num_entries);
+        for (uint32_t eid = 0; eid < num_entries; eid++)
+        {
+            entry_bytes_[eid] = byte_size(parse_dltype(attrs.dltype[eid]), attrs.shape[eid]);
+            entry_device_[eid] = attrs.device_index.empty() ? -1 : attrs.device_index[eid];
+        }
+
+        // Alias "__nop" outputs to their first input
+        std::vector<uint32_t> root(num_entries);
+        for (uint32_t eid = 0; eid < num_entries; eid++)
+        {
+            root[eid] = eid;
+        }
+        for (uint32_t nid = 0; nid < num_nodes; nid++)
+        {
+            const auto& node = info_.nodes_[nid];
+            if (node.op_type != "null" && node.param.func_name == "__nop" && !node.inputs.empty())
+            {
+                root[info_.entry_id(nid, 0)] = root[info_.entry_id(node.inputs[0])];
+            }
+        }
+
+        std::vector<int> tensor_of(num_entries, -1);
+        for (uint32_t eid = 0; eid < num_entries; eid++)
+        {
+            if (tensor_of[root[eid]] < 0)
+            {
+                tensor_of[root[eid]] = static_cast<int>(tensors_.size());
+                tensors_.emplace_back();
+            }
+            tensor_of[eid] = tensor_of[root[eid]];
+        }
+
+        for (uint32_t nid = 0; nid < num_nodes; nid++)
+        {
+            const auto& node = info_.nodes_[nid];
+            const bool is_null = (node.op_type == "null");
+            const uint32_t num_outputs = is_null ? 1 : node.param.num_outputs;
+            for (uint32_t index = 0; index < num_outputs; index++)
+            {
+                const uint32_t eid = info_.entry_id(nid, index);
+                Tensor& tensor = tensors_[tensor_of[eid]];
+                if (tensor.entries.empty())
+                {
+                    tensor.first = nid;
+                    tensor.last = nid;
+                    tensor.device = entry_device_[eid];
+                }
+                tensor.entries.push_back(eid);
+                tensor.bytes = std::max(tensor.bytes, Align(entry_bytes_[eid]));
+                tensor.fixed = tensor.fixed || is_null;
+            }
+
+            for (const auto& e : node.inputs)
+            {
+                Tensor& tensor = tensors_[tensor_of[info_.entry_id(e)]];
+                tensor.last = std::max(tensor.last, nid);
+            }
+        }
+
+        for (const auto& e : info_.outputs_)
+        {
+            tensors_[tensor_of[info_.entry_id(e)]].last = num_nodes;
+        }
+
+        for (const auto& tensor : tensors_)
+        {
+            if (tensor.fixed)
+            {
+                fixed_bytes_ += tensor.bytes;
+                num_fixed_++;
+            }
+            else
+            {
+                activation_bytes_ += tensor.bytes;
+            }
+        }
+    }
+
+    // A plan with one storage id per fixed tensor, in graph order
+    MemoryPlan Begin(const std::string& strategy) const
+    {
+        MemoryPlan plan;
+        plan.strategy = strategy;
+        plan.storage_id.assign(entry_bytes_.size(), -1);
+        for (std::size_t t = 0; t < tensors_.size(); t++)
+        {
+            if (tensors_[t].fixed)
+            {
+                const int sid = static_cast<int>(plan.pool.size());
+                plan.pool.push_back(GraphRuntimePrivateStuff::PoolEntry(0, tensors_[t].device));
+                Assign(plan, t, sid);
+            }
+        }
+        return plan;
+    }
+
+    void Assign(MemoryPlan& plan, std::size_t t, int sid) const
+    {
+        const Tensor& tensor = tensors_[t];
+        for (auto eid : tensor.entries)
+        {
+            plan.storage_id[eid] = sid;
+        }
+        plan.pool[sid].size = std::max(plan.pool[sid].size, tensor.bytes);
+    }
+
+    std::size_t Align(std::size_t bytes) const
+    {
+        return (bytes + alignment_ - 1) / alignment_ * alignment_;
+    }
+
+    const GraphRuntimePrivateStuff& info_;
+    std::size_t alignment_;
+    std::vector<std::size_t> entry_bytes_;
+    std::vector<int> entry_device_;
+    std::vector<Tensor> tensors_;
+    std::size_t fixed_bytes_{ 0 };
+    std::size_t activation_bytes_{ 0 };
+    std::size_t num_fixed_{ 0 };
+};
+
+#endif // __memory_planner_h__
@@ -0,0 +1,200 @@
+#ifndef __memory_report_h__
+#define __memory_report_h__
+
+#include "DataType.h"
+#include "GraphRuntime.h"
+#include "MemoryPlanner.h"
+#include "MemoryUsage.h"
+
+#include <dmlc/json.h>
+#include <tvm/runtime/packed_func.h>
+#include <tvm/runtime/registry.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+
+  Where the memory of a graph goes.
+
+  - Storage pool: what GraphRuntime::SetupStorage allocates, one entry per
+    storage_id sized to the largest entry mapped to it, summed per device
+    from attrs_.storage_id / shape / dltype (MemoryPlanner::Current).
+    Parameters are part of it.
+  - Parameters: the entries of the graph inputs other than the data inputs.
+  - Device allocations: with tracking enabled (enable_allocation_tracking,
+    before the first tensor is allocated) graph_runtime_ext.cc wraps the
+    device APIs, so every NDArray (AllocDataSpace) and every operator
+    workspace request (TVMBackendAllocWorkspace -> AllocWorkspace, served by
+    workspace_pool.cc) is counted: calls, live bytes and peak live bytes.
+    Workspace requests below the stack alloca limit of the code generator
+    (1 KiB) never reach the pool.
+  - Process: peak and current RSS (MemoryUsage.h) at each lifecycle phase.
+
+ */
+
+// Allocation counters of one device (tct.memory.stats)
+struct AllocationStats
+{
+    std::size_t data_allocs{ 0 };
+    std::size_t data_bytes{ 0 }; // live
+    std::size_t data_peak_bytes{ 0 };
+    std::size_t workspace_allocs{ 0 };
+    std::size_t workspace_bytes{ 0 }; // live, all threads
+    std::size_t workspace_peak_bytes{ 0 };
+    std::size_t workspace_max_request{ 0 };
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("data_allocs", data_allocs);
+        writer->WriteObjectKeyValue("data_bytes", data_bytes);
+        writer->WriteObjectKeyValue("data_peak_bytes", data_peak_bytes);
+        writer->WriteObjectKeyValue("workspace_allocs", workspace_allocs);
+        writer->WriteObjectKeyValue("workspace_bytes", workspace_bytes);
+        writer->WriteObjectKeyValue("workspace_peak_bytes", workspace_peak_bytes);
+        writer->WriteObjectKeyValue("workspace_max_request", workspace_max_request);
+        writer->EndObject();
+    }
+};
+
+// Wrap the registered device APIs; returns the number of devices tracked
+inline int enable_allocation_tracking()
+{
+    const tvm::runtime::PackedFunc* track = tvm::runtime::Registry::Get("tct.memory.track");
+    return track ? static_cast<int>((*track)()) : 0;
+}
+
+inline bool allocation_stats(int device_type, AllocationStats& stats)
+{
+    const tvm::runtime::PackedFunc* get = tvm::runtime::Registry::Get("tct.memory.stats");
+    return get && static_cast<int>((*get)(device_type, static_cast<void*>(&stats)));
+}
+
+struct MemoryPhase
+{
+    std::string name;
+    std::size_t peak_rss{ 0 };
+    std::size_t current_rss{ 0 };
+    std::map<int, AllocationStats> devices; // tracked devices, by device type
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        std::map<std::string, AllocationStats> by_name;
+        for (const auto& d : devices)
+        {
+            by_name[std::to_string(d.first)] = d.second;
+        }
+
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("name", name);
+        writer->WriteObjectKeyValue("peak_rss_bytes", peak_rss);
+        writer->WriteObjectKeyValue("current_rss_bytes", current_rss);
+        writer->WriteObjectKeyValue("devices", by_name);
+        writer->EndObject();
+    }
+};
+
+class MemoryReport
+{
+public:
+    // data_inputs: graph inputs set per request, the other inputs are parameters
+    explicit MemoryReport(const GraphRuntimePrivateStuff& info, const std::vector<std::string>& data_inputs = { "data" })
+    {
+        for (const auto& entry : MemoryPlanner(info, 1).Current().pool)
+        {
+            pool_bytes_[entry.device_type] += entry.size;
+        }
+
+        for (auto nid : info.input_nodes_)
+        {
+            const auto& name = info.nodes_[nid].name;
+            if (std::find(data_inputs.begin(), data_inputs.end(), name) == data_inputs.end())
+            {
+                const uint32_t eid = info.entry_id(nid, 0);
+                param_bytes_ += byte_size(parse_dltype(info.attrs_.dltype[eid]), info.attrs_.shape[eid]);
+            }
+        }
+    }
+
+    // Record RSS and the device counters at the end of a lifecycle phase
+    void Phase(const std::string& name)
+    {
+        MemoryPhase phase;
+        phase.name = name;
+        phase.peak_rss = peak_rss_bytes();
+        phase.current_rss = current_rss_bytes();
+        for (const auto& pool : pool_bytes_)
+        {
+            AllocationStats stats;
+            if (allocation_stats(pool.first, stats))
+            {
+                phase.devices[pool.first] = stats;
+            }
+        }
+        phases_.push_back(phase);
+    }
+
+    std::size_t pool_bytes() const
+    {
+        std::size_t total = 0;
+        for (const auto& pool : pool_bytes_)
+        {
+            total += pool.second;
+        }
+        return total;
+    }
+
+    std::size_t param_bytes() const { return param_bytes_; }
+
+    const std::vector<MemoryPhase>& phases() const { return phases_; }
+
+    void Print(std::ostream& os) const
+    {
+        os << "storage pool: " << to_mib(pool_bytes()) << " MiB";
+        for (const auto& pool : pool_bytes_)
+        {
+            os << " (device_type " << pool.first << ": " << to_mib(pool.second) << " MiB)";
+        }
+        os << ", parameters: " << to_mib(param_bytes_) << " MiB, activations: " << to_mib(pool_bytes() - std::min(param_bytes_, pool_bytes())) << " MiB" << std::endl;
+
+        for (const auto& phase : phases_)
+        {
+            os << "memory " << phase.name << ": peak rss " << to_mib(phase.peak_rss) << " MiB, rss " << to_mib(phase.current_rss) << " MiB";
+            for (const auto& d : phase.devices)
+            {
+                const AllocationStats& s = d.second;
+                os << ", device_type " << d.first << " tensors " << to_mib(s.data_bytes) << " MiB (peak " << to_mib(s.data_peak_bytes)
+                   << "), workspace " << s.workspace_allocs << " allocs, peak " << to_mib(s.workspace_peak_bytes) << " MiB";
+            }
+            os << std::endl;
+        }
+    }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        std::map<std::string, std::size_t> pools;
+        for (const auto& pool : pool_bytes_)
+        {
+            pools[std::to_string(pool.first)] = pool.second;
+        }
+
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("pool_bytes", pool_bytes());
+        writer->WriteObjectKeyValue("pool_bytes_by_device", pools);
+        writer->WriteObjectKeyValue("param_bytes", param_bytes_);
+        writer->WriteObjectKeyValue("phases", phases_);
+        writer->EndObject();
+    }
+
+private:
+    std::map<int, std::size_t> pool_bytes_; // by device type
+    std::size_t param_bytes_{ 0 };
+    std::vector<MemoryPhase> phases_;
+};
+
+#endif // __memory_report_h__
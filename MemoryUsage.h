@@ -0,0 +1,52 @@
+#ifndef __memory_usage_h__
+#define __memory_usage_h__
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdio>
+
+/*
+
+  Process memory counters (Linux and Android).
+
+  Peak RSS comes from getrusage() (ru_maxrss is in KiB on Linux), the current
+  RSS from /proc/self/statm.  Both return bytes and 0 when unavailable.
+
+ */
+
+inline std::size_t peak_rss_bytes()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+}
+
+inline std::size_t current_rss_bytes()
+{
+    std::FILE* fp = std::fopen("/proc/self/statm", "r");
+    if (!fp)
+    {
+        return 0;
+    }
+
+    long pages = 0, resident = 0;
+    int n = std::fscanf(fp, "%ld %ld", &pages, &resident);
+    std::fclose(fp);
+    if (n != 2)
+    {
+        return 0;
+    }
+    return static_cast<std::size_t>(resident) * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+inline double to_mib(std::size_t bytes)
+{
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+#endif // __memory_usage_h__
@@ -0,0 +1,219 @@
+#ifndef __model_loader_h__
+#define __model_loader_h__
+
+#include "CompactParams.h"
+#include "GraphBinary.h"
+#include "GraphRuntime.h"
+#include "MappedFile.h"
+
+#include <dmlc/json.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/packed_func.h>
+#include <tvm/runtime/registry.h>
+
+#include <chrono>
+#include <istream>
+#include <streambuf>
+#include <string>
+
+/*
+
+  Zero copy, single parse model loading.
+
+  Both the graph and the parameter blob are memory mapped.  The graph (JSON,
+  or the precompiled binary format from GraphBinary.h) is parsed once into
+  GraphRuntimePrivateStuff straight out of the mapping, and the runtime is
+  built from that parsed graph by tct.graph_runtime.create_from_info (see
+  graph_runtime_ext.cc), so the runtime never tokenizes the JSON again.
+
+  The mapped parameter blob is handed to load_params as a TVMByteArray, which
+  the runtimes of graph_runtime_ext.cc read in place (the stock load_params
+  would copy it into a std::string), so no private heap copy of the weights
+  ever exists.  The parameter mapping is
+  released as soon as load_params returns, after which the only copy of the
+  weights is the one in the runtime's storage pool.  Further instances of the
+  same graph can alias that copy, see create_shared_graph_runtime.
+
+  The operator library is either a shared object (dlopen) or, for lib
+  "system", the model object linked into the executable (from_mxnet.py
+  --system-lib, CMake option TCT_SYSTEM_LIB), whose kernels register
+  themselves before main: no dlopen and no symbol lookup at startup.
+  Every loading phase is timed (StartupPhases).
+
+  A compact (fp16 / bf16 / int8) parameter file, see CompactParams.h, is
+  recognized by its magic and expanded into the parameter tensors instead.
+
+ */
+
+// Read only std::streambuf over a block of memory (e.g. a MappedFile)
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const char* data, std::size_t size)
+    {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+// Wall time of the model loading phases, in seconds
+struct StartupPhases
+{
+    double lib_s{ 0.0 };    // dlopen + symbol resolution, or system lib lookup
+    double graph_s{ 0.0 };  // map + parse of the graph
+    double create_s{ 0.0 }; // runtime creation, storage allocation, op setup
+    double params_s{ 0.0 }; // parameter loading
+
+    double total() const { return lib_s + graph_s + create_s + params_s; }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("lib_s", lib_s);
+        writer->WriteObjectKeyValue("graph_s", graph_s);
+        writer->WriteObjectKeyValue("create_s", create_s);
+        writer->WriteObjectKeyValue("params_s", params_s);
+        writer->EndObject();
+    }
+};
+
+struct GraphModel
+{
+    /*! \brief The compiled operator library (from_mxnet.so). */
+    tvm::runtime::Module lib;
+    /*! \brief The graph runtime instance. */
+    tvm::runtime::Module mod;
+    /*! \brief Parsed graph for introspection. */
+    GraphRuntimePrivateStuff info;
+    /*! \brief Size of the parameter blob passed to load_params. */
+    std::size_t param_bytes{ 0 };
+    /*! \brief Expansion statistics, file_bytes is 0 for fp32 parameter files. */
+    CompactParamStats compact;
+    /*! \brief Loading time per phase. */
+    StartupPhases startup;
+};
+
+inline void load_graph_info(const char* data, std::size_t size, GraphRuntimePrivateStuff& info)
+{
+    if (is_binary_graph(data, size))
+    {
+        load_graph_binary(data, size, info);
+        return;
+    }
+
+    MemoryStreamBuf buf(data, size);
+    std::istream is(&buf);
+    dmlc::JSONReader reader(&is);
+    info.Load(&reader);
+}
+
+// Load a graph JSON or binary graph file into info
+inline void load_graph_info(const std::string& graph_file, GraphRuntimePrivateStuff& info)
+{
+    MappedFile graph(graph_file);
+    CHECK(graph) << "Failed to read graph file " << graph_file;
+    graph.advise(MADV_SEQUENTIAL);
+    load_graph_info(graph.data(), graph.size(), info);
+}
+
+// Create a graph runtime instance for a parsed graph
+inline tvm::runtime::Module create_graph_runtime(const GraphRuntimePrivateStuff& info, tvm::runtime::Module lib, int device_type, int device_id)
+{
+    const tvm::runtime::PackedFunc* create = tvm::runtime::Registry::Get("tct.graph_runtime.create_from_info");
+    CHECK(create) << "tct.graph_runtime.create_from_info is not registered, see graph_runtime_ext.cc";
+    return (*create)(const_cast<void*>(static_cast<const void*>(&info)), lib, device_type, device_id);
+}
+
+inline std::size_t load_params(tvm::runtime::Module& mod, const std::string& param_file)
+{
+    MappedFile params(param_file);
+    CHECK(params) << "Failed to read param file " << param_file;
+    params.advise(MADV_SEQUENTIAL);
+
+    TVMByteArray params_arr;
+    params_arr.data = params.data();
+    params_arr.size = params.size();
+    mod.GetFunction("load_params")(params_arr);
+    return params.size();
+} // unmapped here
+
+// load_params() for both parameter formats, compact files are expanded
+// into the parameter tensors of mod
+inline std::size_t load_model_params(tvm::runtime::Module& mod, const GraphRuntimePrivateStuff& info, const std::string& param_file, CompactParamStats* compact = nullptr)
+{
+    MappedFile params(param_file);
+    CHECK(params) << "Failed to read param file " << param_file;
+    if (!compact_params::is_compact(params.data(), params.size()))
+    {
+        return load_params(mod, param_file);
+    }
+
+    params.advise(MADV_SEQUENTIAL);
+    CompactParamStats stats = load_compact_params(mod, info, params.data(), params.size());
+    if (compact)
+    {
+        *compact = stats;
+    }
+    return params.size();
+}
+
+// Create another runtime instance whose parameters (the names in param_file)
+// alias the tensors of source instead of being loaded again
+inline tvm::runtime::Module create_shared_graph_runtime(const GraphRuntimePrivateStuff& info, tvm::runtime::Module lib, int device_type, int device_id, tvm::runtime::Module source, const std::string& param_file)
+{
+    const tvm::runtime::PackedFunc* create = tvm::runtime::Registry::Get("tct.graph_runtime.create_shared");
+    CHECK(create) << "tct.graph_runtime.create_shared is not registered, see graph_runtime_ext.cc";
+
+    MappedFile params(param_file);
+    CHECK(params) << "Failed to read param file " << param_file;
+
+    TVMByteArray params_arr;
+    params_arr.data = params.data();
+    params_arr.size = params.size();
+    return (*create)(const_cast<void*>(static_cast<const void*>(&info)), lib, device_type, device_id, source, params_arr);
+}
+
+// The operator library: a shared object, or "system" for the model linked
+// into the executable
+inline tvm::runtime::Module load_operator_library(const std::string& lib)
+{
+    if (lib == "system")
+    {
+        const tvm::runtime::PackedFunc* system_lib = tvm::runtime::Registry::Get("module._GetSystemLib");
+        CHECK(system_lib) << "module._GetSystemLib is not registered (system_lib_module.cc)";
+        return (*system_lib)();
+    }
+    return tvm::runtime::Module::LoadFromFile(lib);
+}
+
+// Create a graph runtime for an already loaded operator library
+inline void create_graph_model(GraphModel& model, tvm::runtime::Module lib, const std::string& graph_file, const std::string& param_file, int device_type, int device_id)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    model.lib = lib;
+    auto t0 = Clock::now();
+    load_graph_info(graph_file, model.info);
+    auto t1 = Clock::now();
+    model.mod = create_graph_runtime(model.info, model.lib, device_type, device_id);
+    auto t2 = Clock::now();
+    model.param_bytes = load_model_params(model.mod, model.info, param_file, &model.compact);
+    auto t3 = Clock::now();
+
+    model.startup.graph_s = Duration(t1 - t0).count();
+    model.startup.create_s = Duration(t2 - t1).count();
+    model.startup.params_s = Duration(t3 - t2).count();
+}
+
+inline void load_graph_model(GraphModel& model, const std::string& lib, const std::string& graph_file, const std::string& param_file, int device_type, int device_id)
+{
+    auto tic = std::chrono::high_resolution_clock::now();
+    tvm::runtime::Module library = load_operator_library(lib);
+    const double lib_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tic).count();
+
+    create_graph_model(model, library, graph_file, param_file, device_type, device_id);
+    model.startup.lib_s = lib_s;
+}
+
+#endif // __model_loader_h__
@@ -0,0 +1,375 @@
+#ifndef __model_registry_h__
+#define __model_registry_h__
+
+#include "Benchmark.h"
+#include "MemoryPlanner.h"
+#include "ModelLoader.h"
+
+#include <dmlc/json.h>
+#include <dmlc/logging.h>
+#include <tvm/runtime/module.h>
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+
+  Multi-model registry: models are registered by name and loaded on first
+  use, the loaded ones are kept in LRU order under a total memory budget.
+
+  Before a model is admitted its footprint is estimated from the parsed
+  graph: the runtime's storage pool (every storage_id entry, parameters
+  included, as GraphRuntime::SetupStorage allocates it) plus the operator
+  library file.  The parameter file is only mapped while the model loads.
+  Least recently used models are evicted until it fits;
+  models whose GraphModel is still held by a caller are never evicted, so
+  the budget can only be exceeded by models in use.  With an idle timeout,
+  models unused for that long are evicted on the next Get().
+
+  Loads run outside the registry lock, concurrent Get() calls for the same
+  model wait for the one load.  The registry creates no threads, so every
+  model run from one serving thread shares that thread's TVM pool (see
+  ThreadConfig.h).
+
+ */
+
+struct ModelSpec
+{
+    std::string name;
+    std::string lib; // .so path or "system"
+    std::string graph;
+    std::string params;
+};
+
+struct ModelFootprint
+{
+    std::size_t pool_bytes{ 0 };       // runtime storage pool, parameters included
+    std::size_t lib_bytes{ 0 };        // operator library file
+    std::size_t param_file_bytes{ 0 }; // mapped during the load only
+
+    std::size_t total() const { return pool_bytes + lib_bytes; }
+};
+
+struct ModelStats
+{
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+    std::size_t evictions{ 0 };
+    std::vector<double> load_times; // seconds, one per load
+    std::size_t footprint_bytes{ 0 };
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("hits", hits);
+        writer->WriteObjectKeyValue("misses", misses);
+        writer->WriteObjectKeyValue("evictions", evictions);
+        writer->WriteObjectKeyValue("footprint_bytes", footprint_bytes);
+        writer->WriteObjectKeyValue("load", LatencyStats::compute(load_times));
+        writer->EndObject();
+    }
+};
+
+struct ModelRegistryOptions
+{
+    std::size_t budget_bytes{ 0 };                // 0 : unlimited
+    std::chrono::milliseconds idle_timeout{ 0 }; // 0 : models stay until evicted for space
+};
+
+// Manifest: one model per line, "name lib graph params" or "name prefix"
+// (prefix.so, prefix.json, prefix.params); '#' starts a comment
+inline std::vector<ModelSpec> read_model_manifest(const std::string& filename)
+{
+    std::ifstream ifs(filename);
+    CHECK(ifs) << "Failed to read model manifest " << filename;
+
+    std::vector<ModelSpec> specs;
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::stringstream ss(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (ss >> field)
+        {
+            fields.push_back(field);
+        }
+
+        if (fields.empty())
+        {
+            continue;
+        }
+        CHECK(fields.size() == 2 || fields.size() == 4) << "expected \"name lib graph params\" or \"name prefix\": " << line;
+
+        ModelSpec spec;
+        spec.name = fields[0];
+        if (fields.size() == 2)
+        {
+            spec.lib = fields[1] + ".so";
+            spec.graph = fields[1] + ".json";
+            spec.params = fields[1] + ".params";
+        }
+        else
+        {
+            spec.lib = fields[1];
+            spec.graph = fields[2];
+            spec.params = fields[3];
+        }
+        specs.push_back(spec);
+    }
+    return specs;
+}
+
+// Footprint of a parsed graph, see the comment at the top
+inline ModelFootprint estimate_footprint(const GraphRuntimePrivateStuff& info, const ModelSpec& spec)
+{
+    ModelFootprint footprint;
+    footprint.pool_bytes = MemoryPlanner(info, 1).Current().total();
+
+    struct stat st;
+    if (spec.lib != "system" && stat(spec.lib.c_str(), &st) == 0)
+    {
+        footprint.lib_bytes = static_cast<std::size_t>(st.st_size);
+    }
+    if (stat(spec.params.c_str(), &st) == 0)
+    {
+        footprint.param_file_bytes = static_cast<std::size_t>(st.st_size);
+    }
+    return footprint;
+}
+
+class ModelRegistry
+{
+public:
+    ModelRegistry(const ModelRegistryOptions& opts, int device_type, int device_id)
+        : opts_(opts)
+        , device_type_(device_type)
+        , device_id_(device_id)
+    {
+    }
+
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+    // Register a model, nothing is loaded yet
+    void Add(const ModelSpec& spec)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        CHECK(!entries_.count(spec.name)) << "model " << spec.name << " registered twice";
+        entries_[spec.name].spec = spec;
+    }
+
+    // The loaded model, loading (and evicting others) on a miss.  The model
+    // stays resident while the caller holds the returned pointer.
+    std::shared_ptr<GraphModel> Get(const std::string& name)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = entries_.find(name);
+        CHECK(it != entries_.end()) << "unknown model " << name;
+        Entry& entry = it->second;
+
+        EvictIdle();
+        cv_.wait(lock, [&] { return !entry.loading; });
+        if (entry.model)
+        {
+            entry.stats.hits++;
+            Touch(name, entry);
+            return entry.model;
+        }
+
+        entry.stats.misses++;
+        entry.loading = true;
+        try
+        {
+            auto tic = std::chrono::high_resolution_clock::now();
+
+            // Parse and estimate outside the lock, then make room
+            lock.unlock();
+            auto model = std::make_shared<GraphModel>();
+            load_graph_info(entry.spec.graph, model->info);
+            const ModelFootprint footprint = estimate_footprint(model->info, entry.spec);
+            lock.lock();
+
+            Reserve(name, footprint.total());
+            entry.footprint = footprint;
+            entry.stats.footprint_bytes = footprint.total();
+
+            lock.unlock();
+            model->lib = load_operator_library(entry.spec.lib);
+            model->mod = create_graph_runtime(model->info, model->lib, device_type_, device_id_);
+            model->param_bytes = load_model_params(model->mod, model->info, entry.spec.params, &model->compact);
+            lock.lock();
+
+            entry.model = model;
+            entry.stats.load_times.push_back(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tic).count());
+            Touch(name, entry);
+        }
+        catch (...)
+        {
+            if (!lock.owns_lock())
+            {
+                lock.lock();
+            }
+            if (entry.reserved)
+            {
+                resident_bytes_ -= entry.footprint.total();
+                entry.reserved = false;
+            }
+            entry.loading = false;
+            cv_.notify_all();
+            throw;
+        }
+
+        entry.loading = false;
+        cv_.notify_all();
+        return entry.model;
+    }
+
+    // Footprint of a model, estimated without loading it
+    ModelFootprint Estimate(const std::string& name) const
+    {
+        ModelSpec spec;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(name);
+            CHECK(it != entries_.end()) << "unknown model " << name;
+            spec = it->second.spec;
+        }
+
+        GraphRuntimePrivateStuff info;
+        load_graph_info(spec.graph, info);
+        return estimate_footprint(info, spec);
+    }
+
+    std::size_t resident_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return resident_bytes_;
+    }
+
+    std::vector<std::string> resident() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::vector<std::string>(lru_.begin(), lru_.end());
+    }
+
+    std::map<std::string, ModelStats> stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, ModelStats> result;
+        for (const auto& item : entries_)
+        {
+            result[item.first] = item.second.stats;
+        }
+        return result;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        ModelSpec spec;
+        std::shared_ptr<GraphModel> model;
+        ModelFootprint footprint;
+        bool reserved{ false }; // footprint counted in resident_bytes_
+        bool loading{ false };
+        Clock::time_point last_use;
+        ModelStats stats;
+    };
+
+    // Move name to the front of the LRU list
+    void Touch(const std::string& name, Entry& entry)
+    {
+        lru_.remove(name);
+        lru_.push_front(name);
+        entry.last_use = Clock::now();
+    }
+
+    bool InUse(const Entry& entry) const { return entry.model && entry.model.use_count() > 1; }
+
+    void Evict(const std::string& name)
+    {
+        Entry& entry = entries_[name];
+        entry.model.reset();
+        resident_bytes_ -= entry.footprint.total();
+        entry.reserved = false;
+        entry.stats.evictions++;
+        lru_.remove(name);
+    }
+
+    // Count bytes for name, evicting least recently used idle models first
+    void Reserve(const std::string& name, std::size_t bytes)
+    {
+        if (opts_.budget_bytes)
+        {
+            CHECK_LE(bytes, opts_.budget_bytes) << "model " << name << " needs " << bytes << " bytes, more than the whole budget";
+            // Pick the victims first, Evict() removes them from lru_
+            std::vector<std::string> victims;
+            std::size_t freed = 0;
+            for (auto it = lru_.rbegin(); it != lru_.rend() && resident_bytes_ - freed + bytes > opts_.budget_bytes; ++it)
+            {
+                const Entry& entry = entries_[*it];
+                if (!InUse(entry))
+                {
+                    victims.push_back(*it);
+                    freed += entry.footprint.total();
+                }
+            }
+            for (const auto& victim : victims)
+            {
+                Evict(victim);
+            }
+            CHECK_LE(resident_bytes_ + bytes, opts_.budget_bytes) << "no room for model " << name << ", the resident models are in use";
+        }
+
+        resident_bytes_ += bytes;
+        entries_[name].reserved = true;
+    }
+
+    void EvictIdle()
+    {
+        if (opts_.idle_timeout.count() == 0)
+        {
+            return;
+        }
+
+        const auto now = Clock::now();
+        std::vector<std::string> idle;
+        for (const auto& name : lru_)
+        {
+            const Entry& entry = entries_[name];
+            if (!InUse(entry) && now - entry.last_use > opts_.idle_timeout)
+            {
+                idle.push_back(name);
+            }
+        }
+        for (const auto& name : idle)
+        {
+            Evict(name);
+        }
+    }
+
+    ModelRegistryOptions opts_;
+    int device_type_;
+    int device_id_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, Entry> entries_;
+    std::list<std::string> lru_; // loaded models, most recently used first
+    std::size_t resident_bytes_{ 0 };
+};
+
+#endif // __model_registry_h__
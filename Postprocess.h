@@ -0,0 +1,186 @@
+#ifndef __postprocess_h__
+#define __postprocess_h__
+
+#include <dmlc/logging.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) // as in CompactParams.h
+#include <immintrin.h>
+#define TCT_POSTPROCESS_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define TCT_POSTPROCESS_NEON 1
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <ostream>
+
+/*
+
+  Classification post-processing: top-k with optional softmax, in a single
+  pass over each row of a [batch, classes] output.
+
+  The row is scanned in blocks of kBlock scores.  The block maximum uses
+  SSE / NEON max instructions directly (intrinsics, so Debug builds get
+  them too; compilers keep a running float max scalar without
+  -ffast-math).  Only a block whose maximum beats the current k-th best
+  score is scanned element by element for insertion, which after the first
+  few blocks is rare.  For softmax the same block maximum drives an online
+  (rescaled) sum of exp(x - max), so the normalizer is ready at the end of
+  the pass and only the k winners are divided.  The sum calls the scalar
+  std::exp once per score.  Softmax does not change the order, so the
+  top-k classes are the same either way.
+
+  The result is a fixed size struct, no allocation and no text.
+
+ */
+
+struct Classification
+{
+    static constexpr int kMaxK = 16;
+
+    int count{ 0 };        // valid entries, min(k, classes)
+    int index[kMaxK];      // class ids, best first
+    float score[kMaxK];    // raw scores, or probabilities with softmax
+
+    int top1() const { return count ? index[0] : -1; }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Classification& c)
+{
+    for (int i = 0; i < c.count; i++)
+    {
+        os << (i ? " " : "") << c.index[i] << ":" << c.score[i];
+    }
+    return os;
+}
+
+namespace postprocess
+{
+    constexpr int kBlock = 16;
+
+    // Maximum of n <= kBlock scores, NaN is skipped.  A full block is reduced
+    // with SSE / NEON max instructions, the rest element by element.
+    inline float block_max(const float* x, int n)
+    {
+        float m = -std::numeric_limits<float>::infinity();
+        int i = 0;
+#if TCT_POSTPROCESS_X86
+        if (n == kBlock)
+        {
+            // maxps returns its second operand when the first one is NaN
+            __m128 v = _mm_set1_ps(m);
+            for (; i < kBlock; i += 4)
+            {
+                v = _mm_max_ps(_mm_loadu_ps(x + i), v);
+            }
+            v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+            v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+            m = _mm_cvtss_f32(v);
+        }
+#elif TCT_POSTPROCESS_NEON
+        if (n == kBlock)
+        {
+            // maxNum: a NaN lane takes the other operand
+            float32x4_t v = vdupq_n_f32(m);
+            for (; i < kBlock; i += 4)
+            {
+                v = vmaxnmq_f32(v, vld1q_f32(x + i));
+            }
+            m = vmaxnmvq_f32(v);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            m = std::max(m, x[i]);
+        }
+        return m;
+    }
+
+    // Insert (index, value) into the descending top list of size k, NaN is skipped
+    inline void insert(Classification& c, int k, int index, float value)
+    {
+        int pos = std::min(c.count, k - 1);
+        if (value != value || (c.count == k && !(value > c.score[k - 1])))
+        {
+            return;
+        }
+        while (pos > 0 && value > c.score[pos - 1])
+        {
+            c.score[pos] = c.score[pos - 1];
+            c.index[pos] = c.index[pos - 1];
+            pos--;
+        }
+        c.score[pos] = value;
+        c.index[pos] = index;
+        c.count = std::min(c.count + 1, k);
+    }
+}
+
+// Top-k of one row of classes scores
+inline Classification top_k(const float* scores, int classes, int k, bool softmax = false)
+{
+    using namespace postprocess;
+    CHECK(k > 0 && k <= Classification::kMaxK) << "top-k supports 1 <= k <= " << Classification::kMaxK;
+
+    Classification result;
+    k = std::min(k, classes);
+
+    float threshold = -std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+    float sum = 0.f; // of exp(x - max), softmax only
+    for (int b = 0; b < classes; b += kBlock)
+    {
+        const float* x = scores + b;
+        const int n = std::min(kBlock, classes - b);
+        const float bmax = block_max(x, n);
+
+        if (softmax && bmax > -std::numeric_limits<float>::infinity())
+        {
+            if (bmax > max)
+            {
+                sum *= std::exp(max - bmax);
+                max = bmax;
+            }
+            for (int i = 0; i < n; i++)
+            {
+                sum += std::exp(x[i] - max);
+            }
+        }
+
+        if (bmax > threshold || result.count < k)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                insert(result, k, b + i, x[i]);
+            }
+            if (result.count == k)
+            {
+                threshold = result.score[k - 1];
+            }
+        }
+    }
+
+    if (softmax && sum > 0.f)
+    {
+        const float inv = 1.f / sum;
+        for (int i = 0; i < result.count; i++)
+        {
+            result.score[i] = std::exp(result.score[i] - max) * inv;
+        }
+    }
+    return result;
+}
+
+// Top-k of every row of a [batch, classes] output, out has batch entries
+inline void top_k(const float* scores, int batch, int classes, int k, bool softmax, Classification* out)
+{
+    for (int b = 0; b < batch; b++)
+    {
+        out[b] = top_k(scores + static_cast<std::size_t>(b) * classes, classes, k, softmax);
+    }
+}
+
+#endif // __postprocess_h__
@@ -0,0 +1,252 @@
+#ifndef __preprocess_h__
+#define __preprocess_h__
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*
+
+  Native image preprocessing, the C++ counterpart of transform_image() in
+  from_mxnet.py:
+
+    resize to the network input size
+    (value - mean) / std per channel
+    HWC -> CHW
+
+  in one pass from an 8 bit RGB/BGR(A) buffer into planar float RGB, which
+  can be the runtime's input entry itself on CPU devices (get_input).
+
+  The resize is separable.  Each source row that is needed is converted once
+  into three planar float rows (horizontal interpolation, a table driven
+  gather); every output row is then a vertical blend of two such rows fused
+  with the normalization, out = (r0 + (r1 - r0) * wy) * inv_std + bias, a
+  contiguous loop the compiler vectorizes (SSE/AVX/NEON) in optimized builds:
+  GCC from -O3, clang from -O2; the Debug builds of build-host.sh and
+  build-android.sh leave it scalar.  Consecutive output rows mostly reuse
+  the same source rows, so the gather runs about once per source row
+  instead of once per output pixel.
+
+  Nearest resizing samples floor((x + 0.5) * scale) like PIL's NEAREST
+  (the Image.resize default used by from_mxnet.py), so cat.ppm preprocessed
+  here gives the same input as cat.bin up to float rounding of the
+  normalization.  Bilinear uses pixel centers and clamps at the border.
+
+ */
+
+enum class PixelFormat
+{
+    RGB8,
+    BGR8,
+    RGBA8,
+    BGRA8
+};
+
+inline int bytes_per_pixel(PixelFormat format)
+{
+    return (format == PixelFormat::RGBA8 || format == PixelFormat::BGRA8) ? 4 : 3;
+}
+
+enum class ResizeMode
+{
+    Nearest,
+    Bilinear
+};
+
+// Borrowed 8 bit interleaved image
+struct ImageView
+{
+    const uint8_t* data{ nullptr };
+    int width{ 0 };
+    int height{ 0 };
+    int stride{ 0 }; // bytes per row, 0 : width * bytes_per_pixel
+    PixelFormat format{ PixelFormat::RGB8 };
+};
+
+// Per channel mean and std in RGB order
+struct Normalization
+{
+    float mean[3];
+    float std[3];
+
+    // The values used by transform_image() in from_mxnet.py
+    static Normalization imagenet()
+    {
+        return Normalization{ { 123.f, 117.f, 104.f }, { 58.395f, 57.12f, 57.375f } };
+    }
+};
+
+class Preprocessor
+{
+public:
+    Preprocessor(int width, int height, const Normalization& norm = Normalization::imagenet(), ResizeMode mode = ResizeMode::Nearest)
+        : width_(width)
+        , height_(height)
+        , mode_(mode)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            scale_[c] = 1.f / norm.std[c];
+            bias_[c] = -norm.mean[c] / norm.std[c];
+        }
+        for (auto& row : rows_)
+        {
+            row.values.resize(3 * width_);
+        }
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Number of floats written by Run(): 3 * height * width
+    std::size_t size() const { return static_cast<std::size_t>(3) * width_ * height_; }
+
+    // Resize, normalize and transpose src into dst (planar RGB, size() floats)
+    void Run(const ImageView& src, float* dst)
+    {
+        Prepare(src);
+        for (auto& row : rows_)
+        {
+            row.y = -1; // cached rows belong to the previous image
+        }
+
+        const std::size_t plane = static_cast<std::size_t>(width_) * height_;
+        for (int y = 0; y < height_; y++)
+        {
+            const float* r0 = Row(src, ys0_[y]);
+            const float* r1 = Row(src, ys1_[y]);
+            const float wy = wy_[y];
+            for (int c = 0; c < 3; c++)
+            {
+                blend(r0 + c * width_, r1 + c * width_, wy, scale_[c], bias_[c], dst + c * plane + static_cast<std::size_t>(y) * width_, width_);
+            }
+        }
+    }
+
+private:
+    struct CachedRow
+    {
+        int y{ -1 };
+        std::vector<float> values; // 3 planes of width_
+    };
+
+    static void blend(const float* __restrict r0, const float* __restrict r1, float wy, float scale, float bias, float* __restrict out, int n)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            out[x] = (r0[x] + (r1[x] - r0[x]) * wy) * scale + bias;
+        }
+    }
+
+    // Rebuild the resize tables when the source geometry changes
+    void Prepare(const ImageView& src)
+    {
+        if (src.width == src_width_ && src.height == src_height_ && src.format == src_format_)
+        {
+            return;
+        }
+
+        src_width_ = src.width;
+        src_height_ = src.height;
+        src_format_ = src.format;
+
+        const bool bgr = (src.format == PixelFormat::BGR8 || src.format == PixelFormat::BGRA8);
+        for (int c = 0; c < 3; c++)
+        {
+            channel_[c] = bgr ? (2 - c) : c;
+        }
+
+        axis(src.width, width_, xs0_, xs1_, wx_);
+        axis(src.height, height_, ys0_, ys1_, wy_);
+        const int bpp = bytes_per_pixel(src.format);
+        for (auto& x : xs0_)
+        {
+            x *= bpp;
+        }
+        for (auto& x : xs1_)
+        {
+            x *= bpp;
+        }
+    }
+
+    // Source sample positions and weights for one axis
+    void axis(int src_size, int dst_size, std::vector<int>& i0, std::vector<int>& i1, std::vector<float>& w) const
+    {
+        i0.resize(dst_size);
+        i1.resize(dst_size);
+        w.resize(dst_size);
+
+        const double scale = static_cast<double>(src_size) / dst_size;
+        for (int i = 0; i < dst_size; i++)
+        {
+            if (mode_ == ResizeMode::Nearest)
+            {
+                i0[i] = i1[i] = std::min(static_cast<int>((i + 0.5) * scale), src_size - 1);
+                w[i] = 0.f;
+            }
+            else
+            {
+                const double s = std::max((i + 0.5) * scale - 0.5, 0.0);
+                const int s0 = std::min(static_cast<int>(s), src_size - 1);
+                i0[i] = s0;
+                i1[i] = std::min(s0 + 1, src_size - 1);
+                w[i] = static_cast<float>(s - s0);
+            }
+        }
+    }
+
+    // Horizontally resampled planar float row for source row y (cached)
+    const float* Row(const ImageView& src, int y)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            if (rows_[i].y == y)
+            {
+                last_ = i;
+                return rows_[i].values.data();
+            }
+        }
+
+        // Replace the row that was not used last, so r0 survives loading r1
+        last_ ^= 1;
+        CachedRow& row = rows_[last_];
+        row.y = y;
+
+        const int stride = src.stride ? src.stride : src.width * bytes_per_pixel(src.format);
+        const uint8_t* p = src.data + static_cast<std::size_t>(y) * stride;
+        const uint8_t* p0 = p + channel_[0];
+        const uint8_t* p1 = p + channel_[1];
+        const uint8_t* p2 = p + channel_[2];
+        float* __restrict out0 = row.values.data();
+        float* __restrict out1 = out0 + width_;
+        float* __restrict out2 = out1 + width_;
+        for (int x = 0; x < width_; x++)
+        {
+            const int i0 = xs0_[x];
+            const int i1 = xs1_[x];
+            const float w = wx_[x];
+            out0[x] = p0[i0] + (p0[i1] - p0[i0]) * w;
+            out1[x] = p1[i0] + (p1[i1] - p1[i0]) * w;
+            out2[x] = p2[i0] + (p2[i1] - p2[i0]) * w;
+        }
+        return row.values.data();
+    }
+
+    int width_;
+    int height_;
+    ResizeMode mode_;
+    float scale_[3];
+    float bias_[3];
+
+    int src_width_{ 0 };
+    int src_height_{ 0 };
+    PixelFormat src_format_{ PixelFormat::RGB8 };
+    int channel_[3]{ 0, 1, 2 };
+    std::vector<int> xs0_, xs1_, ys0_, ys1_; // xs in bytes
+    std::vector<float> wx_, wy_;
+
+    CachedRow rows_[2];
+    int last_{ 0 };
+};
+
+#endif // __preprocess_h__
@@ -0,0 +1,200 @@
+#ifndef __profiler_h__
+#define __profiler_h__
+
+#include "GraphRuntime.h"
+#include "Benchmark.h"
+
+#include <dmlc/json.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+
+  Per operator profiler built on top of the debug graph runtime.
+
+  tvm.graph_runtime_debug.create exposes "debug_run", which executes a single
+  op node, synchronizes the device and returns the elapsed time in seconds.
+  We walk the parsed nodes_ in topological order, time every tvm_op node for
+  a number of runs, and aggregate the samples per node and per func_name
+  (fused kernels with identical shapes share one func_name).
+
+ */
+
+struct OpProfiler
+{
+    struct Entry
+    {
+        std::string name; // node name, or func_name for the aggregated view
+        std::string func_name;
+        uint32_t node_id{ 0 };
+        uint32_t node_count{ 0 };
+        std::vector<double> samples; // seconds, one per run
+        LatencyStats stats;
+        double percent{ 0.0 };
+
+        void Save(dmlc::JSONWriter* writer) const
+        {
+            writer->BeginObject();
+            writer->WriteObjectKeyValue("name", name);
+            writer->WriteObjectKeyValue("func_name", func_name);
+            writer->WriteObjectKeyValue("node_id", node_id);
+            writer->WriteObjectKeyValue("node_count", node_count);
+            writer->WriteObjectKeyValue("mean_ms", stats.mean);
+            writer->WriteObjectKeyValue("min_ms", stats.min);
+            writer->WriteObjectKeyValue("p99_ms", stats.p99);
+            writer->WriteObjectKeyValue("percent", percent);
+            writer->EndObject();
+        }
+    };
+
+    explicit OpProfiler(const GraphRuntimePrivateStuff& info)
+        : info_(info)
+    {
+    }
+
+    // Time every op node runs times with the debug runtime "debug_run" function.
+    // The inputs must already be set (and ideally one full run() done).
+    void Run(tvm::runtime::Module& mod, int runs)
+    {
+        tvm::runtime::PackedFunc debug_run = mod.GetFunction("debug_run");
+        CHECK(debug_run != nullptr) << "debug_run requires tvm.graph_runtime_debug.create";
+
+        nodes_.clear();
+        for (uint32_t nid = 0; nid < info_.nodes_.size(); nid++)
+        {
+            const auto& node = info_.nodes_[nid];
+            if (node.op_type == "null")
+            {
+                continue;
+            }
+
+            Entry entry;
+            entry.name = node.name;
+            entry.func_name = node.param.func_name;
+            entry.node_id = nid;
+            entry.node_count = 1;
+            entry.samples.reserve(runs);
+            nodes_.push_back(entry);
+        }
+
+        for (int r = 0; r < runs; r++)
+        {
+            for (auto& entry : nodes_)
+            {
+                double elapsed = debug_run(static_cast<int>(entry.node_id));
+                entry.samples.push_back(elapsed);
+            }
+        }
+
+        Summarize(runs);
+    }
+
+    const std::vector<Entry>& nodes() const { return nodes_; }
+    const std::vector<Entry>& funcs() const { return funcs_; }
+    double total_ms() const { return total_ms_; }
+
+    void Print(std::ostream& os, std::size_t limit = 0) const
+    {
+        os << "per node (total mean " << total_ms_ << " ms)" << std::endl;
+        PrintTable(os, nodes_, limit);
+        os << "per func_name" << std::endl;
+        PrintTable(os, funcs_, limit);
+    }
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("total_ms", total_ms_);
+        writer->WriteObjectKeyValue("nodes", nodes_);
+        writer->WriteObjectKeyValue("funcs", funcs_);
+        writer->EndObject();
+    }
+
+private:
+    void Summarize(int runs)
+    {
+        std::map<std::string, Entry> by_func;
+        for (auto& entry : nodes_)
+        {
+            entry.stats = LatencyStats::compute(entry.samples);
+
+            auto& func = by_func[entry.func_name];
+            if (func.samples.empty())
+            {
+                func.name = entry.func_name;
+                func.func_name = entry.func_name;
+                func.node_id = entry.node_id;
+                func.samples.assign(runs, 0.0);
+            }
+            func.node_count++;
+            for (int r = 0; r < runs; r++)
+            {
+                func.samples[r] += entry.samples[r];
+            }
+        }
+
+        funcs_.clear();
+        for (auto& item : by_func)
+        {
+            item.second.stats = LatencyStats::compute(item.second.samples);
+            funcs_.push_back(item.second);
+        }
+
+        total_ms_ = 0.0;
+        for (const auto& entry : nodes_)
+        {
+            total_ms_ += entry.stats.mean;
+        }
+
+        for (auto* entries : { &nodes_, &funcs_ })
+        {
+            for (auto& entry : *entries)
+            {
+                entry.percent = (total_ms_ > 0.0) ? (100.0 * entry.stats.mean / total_ms_) : 0.0;
+            }
+
+            std::sort(entries->begin(), entries->end(), [](const Entry& a, const Entry& b) {
+                return a.stats.mean > b.stats.mean;
+            });
+        }
+    }
+
+    static void PrintTable(std::ostream& os, const std::vector<Entry>& entries, std::size_t limit)
+    {
+        os << std::setw(6) << "node"
+           << std::setw(6) << "count"
+           << std::setw(12) << "mean(ms)"
+           << std::setw(12) << "min(ms)"
+           << std::setw(12) << "p99(ms)"
+           << std::setw(8) << "%"
+           << "  name" << std::endl;
+
+        std::size_t n = (limit > 0) ? std::min(limit, entries.size()) : entries.size();
+        for (std::size_t i = 0; i < n; i++)
+        {
+            const auto& entry = entries[i];
+            os << std::setw(6) << entry.node_id
+               << std::setw(6) << entry.node_count
+               << std::setw(12) << std::fixed << std::setprecision(4) << entry.stats.mean
+               << std::setw(12) << entry.stats.min
+               << std::setw(12) << entry.stats.p99
+               << std::setw(8) << std::setprecision(2) << entry.percent
+               << "  " << entry.name << std::endl;
+        }
+        os.unsetf(std::ios::floatfield);
+        os << std::setprecision(6);
+    }
+
+    const GraphRuntimePrivateStuff& info_;
+    std::vector<Entry> nodes_;
+    std::vector<Entry> funcs_;
+    double total_ms_{ 0.0 };
+};
+
+#endif // __profiler_h__
@@ -0,0 +1,202 @@
+#ifndef __request_queue_h__
+#define __request_queue_h__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/*
+
+  Bounded multi producer / multi consumer request queue.
+
+  The queue itself is lock free: a power of two ring of cells, each with a
+  sequence number (D. Vyukov's bounded MPMC queue), so producers and
+  consumers only contend on one atomic position each.  Consumers that find
+  the queue empty spin for a short while and then sleep on a condition
+  variable; producers only take the mutex to wake a consumer when one is
+  actually sleeping, so a busy queue never touches it.
+
+  WaitOptions trade latency for CPU: a longer spin catches requests that
+  arrive shortly after the queue ran empty without a wake up, yielding while
+  spinning leaves the core to other threads on oversubscribed hosts, and
+  spin 0 sleeps at once.
+
+ */
+
+struct WaitOptions
+{
+    int spin{ 256 };    // polls of an empty queue before sleeping
+    bool yield{ false }; // yield the core between polls
+};
+
+template <typename T>
+class RequestQueue
+{
+public:
+    explicit RequestQueue(std::size_t capacity = 1024, const WaitOptions& wait = WaitOptions())
+        : wait_(wait)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RequestQueue(const RequestQueue&) = delete;
+    RequestQueue& operator=(const RequestQueue&) = delete;
+
+    bool try_push(T& value)
+    {
+        Cell* cell = nullptr;
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value)
+    {
+        Cell* cell = nullptr;
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->value);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Yields while the queue is full
+    void push(T value)
+    {
+        while (!try_push(value))
+        {
+            std::this_thread::yield();
+        }
+
+        // Pairs with the fetch_add in pop(): either the sleeper sees the new
+        // value or we see the sleeper
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_one();
+        }
+    }
+
+    // Blocks until a value is available; false once closed and drained
+    bool pop(T& value)
+    {
+        for (int i = 0; i < wait_.spin; i++)
+        {
+            if (try_pop(value))
+            {
+                return true;
+            }
+            if (wait_.yield)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleepers_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = false;
+        cv_.wait(lock, [&] {
+            ok = try_pop(value);
+            return ok || closed_.load(std::memory_order_acquire);
+        });
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    // Wake every consumer, pop() returns false once the queue is empty
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_.store(true, std::memory_order_release);
+        cv_.notify_all();
+    }
+
+private:
+    static constexpr std::size_t kCacheLine = 64;
+
+    WaitOptions wait_;
+
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_{ 0 };
+
+    // Producer and consumer positions live on separate cache lines
+    char pad0_[kCacheLine];
+    std::atomic<std::size_t> enqueue_pos_{ 0 };
+    char pad1_[kCacheLine - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> dequeue_pos_{ 0 };
+    char pad2_[kCacheLine - sizeof(std::atomic<std::size_t>)];
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<int> sleepers_{ 0 };
+    std::atomic<bool> closed_{ false };
+};
+
+#endif // __request_queue_h__
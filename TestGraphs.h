@@ -0,0 +1,138 @@
+#ifndef __test_graphs_h__
+#define __test_graphs_h__
+
+#include <dlpack/dlpack.h>
+#include <dmlc/logging.h>
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+
+  Fixtures of the unit tests (test_*.cpp): graph JSON and parameter files
+  of small float32 graphs without kernels.  Their nodes are variables and
+  __nop nodes (an in place reshape), so they run from the "system" library
+  and no model files are needed.
+
+ */
+
+namespace test_graphs
+{
+    constexpr uint64_t kParamListMagic = 0xF7E58D4F05049CB7; // kTVMNDArrayListMagic
+    constexpr uint64_t kNDArrayMagic = 0xDD5E40F096B4A13F;   // kTVMNDArrayMagic
+
+    struct Node
+    {
+        std::string name;
+        std::vector<int64_t> shape;
+        int input; // -1: a variable, otherwise the node this __nop reshapes
+    };
+
+    struct Param
+    {
+        std::string name;
+        std::vector<int64_t> shape;
+        std::vector<float> values;
+    };
+
+    template <typename T>
+    void append(std::string& blob, const T& value)
+    {
+        blob.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    inline void write_file(const std::string& filename, const std::string& contents)
+    {
+        std::ofstream ofs(filename, std::ios::binary);
+        CHECK(ofs.write(contents.data(), contents.size())) << "Failed to write " << filename;
+    }
+}
+
+// Graph JSON of float32 nodes, one output each.  Every variable has storage
+// of its own, a __nop shares the storage of its input; the last node is the
+// graph output.
+inline std::string make_graph_json(const std::vector<test_graphs::Node>& nodes)
+{
+    std::ostringstream nodes_json, arg_nodes, row_ptr, dltype, storage_id, shape;
+    std::vector<int> sids;
+    int variables = 0;
+    for (std::size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto& node = nodes[i];
+        const char* sep = i ? ", " : "";
+        if (node.input < 0)
+        {
+            nodes_json << sep << "{\"op\": \"null\", \"name\": \"" << node.name << "\", \"inputs\": []}";
+            arg_nodes << (variables ? ", " : "") << i;
+            sids.push_back(variables++);
+        }
+        else
+        {
+            CHECK_LT(static_cast<std::size_t>(node.input), i) << "a __nop reshapes an earlier node";
+            nodes_json << sep << "{\"op\": \"tvm_op\", \"name\": \"" << node.name << "\", \"attrs\": {\"func_name\": \"__nop\","
+                       << " \"num_inputs\": \"1\", \"num_outputs\": \"1\", \"flatten_data\": \"0\"}, \"inputs\": [[" << node.input << ", 0, 0]]}";
+            sids.push_back(sids[node.input]);
+        }
+
+        row_ptr << ", " << i + 1;
+        dltype << sep << "\"float32\"";
+        storage_id << sep << sids.back();
+        shape << sep << "[";
+        for (std::size_t d = 0; d < node.shape.size(); d++)
+        {
+            shape << (d ? ", " : "") << node.shape[d];
+        }
+        shape << "]";
+    }
+
+    std::ostringstream json;
+    json << "{\"nodes\": [" << nodes_json.str() << "],"
+         << " \"arg_nodes\": [" << arg_nodes.str() << "], \"node_row_ptr\": [0" << row_ptr.str() << "],"
+         << " \"heads\": [[" << nodes.size() - 1 << ", 0, 0]],"
+         << " \"attrs\": {\"dltype\": [\"list_str\", [" << dltype.str() << "]], \"storage_id\": [\"list_int\", [" << storage_id.str() << "]],"
+         << " \"shape\": [\"list_shape\", [" << shape.str() << "]]}}";
+    return json.str();
+}
+
+inline void write_graph_json(const std::string& filename, const std::vector<test_graphs::Node>& nodes)
+{
+    test_graphs::write_file(filename, make_graph_json(nodes));
+}
+
+// nnvm.compiler.save_param_dict(params) for float32 tensors, the format
+// GraphRuntime::LoadParams reads (SaveDLTensor in ndarray.h)
+inline void write_param_list(const std::string& filename, const std::vector<test_graphs::Param>& params)
+{
+    using test_graphs::append;
+
+    std::string blob;
+    append(blob, test_graphs::kParamListMagic);
+    append(blob, uint64_t(0)); // reserved
+    append(blob, static_cast<uint64_t>(params.size()));
+    for (const auto& param : params)
+    {
+        append(blob, static_cast<uint64_t>(param.name.size()));
+        blob += param.name;
+    }
+    append(blob, static_cast<uint64_t>(params.size()));
+    for (const auto& param : params)
+    {
+        append(blob, test_graphs::kNDArrayMagic);
+        append(blob, uint64_t(0)); // reserved
+        append(blob, DLContext{ kDLCPU, 0 });
+        append(blob, static_cast<int>(param.shape.size()));
+        append(blob, DLDataType{ kDLFloat, 32, 1 });
+        for (auto extent : param.shape)
+        {
+            append(blob, extent);
+        }
+        append(blob, static_cast<int64_t>(param.values.size() * sizeof(float)));
+        blob.append(reinterpret_cast<const char*>(param.values.data()), param.values.size() * sizeof(float));
+    }
+    test_graphs::write_file(filename, blob);
+}
+
+#endif // __test_graphs_h__
@@ -0,0 +1,234 @@
+#ifndef __thread_config_h__
+#define __thread_config_h__
+
+#include <dmlc/logging.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+  TVM thread pool settings: number of threads, the cores they may run on
+  and a big / little core preference.
+
+  TVM's pool (thread_pool.cc) belongs to the thread that launches parallel
+  work and is created on its first parallel op.  It then reads
+  TVM_NUM_THREADS for its size and, unless TVM_BIND_THREADS is 0, pins
+  worker i to the i-th fastest core.  Threads inherit the affinity mask of
+  the thread that creates them, so restricting the launching thread with
+  sched_setaffinity and disabling TVM's own binding keeps the whole pool on
+  the selected cores.
+
+  Everything here must happen before the launching thread runs its first
+  op; a pool of another size needs another thread (see run_on_new_pool).
+
+  Components that run graphs on several threads at once (InferencePool.h,
+  DagExecutor.h) call set_worker_pools before starting their threads, so
+  each thread's pool is a slice of threads_per_worker threads (the thread
+  itself plus threads_per_worker - 1), unpinned, since TVM's binding would
+  put every slice on the same cores.  workers x threads_per_worker should
+  not exceed the cores.  The environment is process wide: set it while no
+  other thread is starting TVM work.
+
+  The spin of TVM's workers before they sleep (thread_pool.cc,
+  SpscTaskQueue::Pop, 300000 yields) is a compile time constant of the
+  runtime; the spin of the request queues of this repository is set with
+  WaitOptions (RequestQueue.h).
+
+ */
+
+enum class CorePreference
+{
+    All,
+    Big,   // the cores with the highest maximum frequency
+    Little // the cores with the lowest maximum frequency
+};
+
+struct ThreadingOptions
+{
+    int threads{ 0 };     // 0 : one per selected core (all cores : TVM default)
+    std::vector<int> cpus; // allowed cores, empty : all
+    CorePreference cores{ CorePreference::All };
+};
+
+namespace thread_config
+{
+    // cpuinfo_max_freq in kHz, 0 when cpufreq is not available
+    inline long max_frequency(int cpu)
+    {
+        std::ifstream ifs("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/cpuinfo_max_freq");
+        long khz = 0;
+        return (ifs >> khz) ? khz : 0;
+    }
+}
+
+// "0-3,6" -> 0 1 2 3 6
+inline std::vector<int> parse_cpu_list(const std::string& value)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (item.empty())
+        {
+            continue;
+        }
+
+        const std::size_t dash = item.find('-');
+        const int first = std::atoi(item.substr(0, dash).c_str());
+        const int last = (dash == std::string::npos) ? first : std::atoi(item.substr(dash + 1).c_str());
+        CHECK(first >= 0 && last >= first) << "invalid cpu list " << value;
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+inline bool parse_core_preference(const std::string& value, CorePreference& cores)
+{
+    if (value == "all")
+    {
+        cores = CorePreference::All;
+    }
+    else if (value == "big")
+    {
+        cores = CorePreference::Big;
+    }
+    else if (value == "little")
+    {
+        cores = CorePreference::Little;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// The cores selected by opts.cpus and opts.cores, empty : no restriction
+inline std::vector<int> select_cpus(const ThreadingOptions& opts)
+{
+    std::vector<int> cpus = opts.cpus;
+    if (opts.cores == CorePreference::All)
+    {
+        return cpus;
+    }
+
+    if (cpus.empty())
+    {
+        const int count = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+        for (int cpu = 0; cpu < count; cpu++)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+
+    std::vector<long> freq;
+    for (auto cpu : cpus)
+    {
+        freq.push_back(thread_config::max_frequency(cpu));
+    }
+    const long wanted = (opts.cores == CorePreference::Big) ? *std::max_element(freq.begin(), freq.end()) : *std::min_element(freq.begin(), freq.end());
+
+    std::vector<int> selected;
+    for (std::size_t i = 0; i < cpus.size(); i++)
+    {
+        if (freq[i] == wanted)
+        {
+            selected.push_back(cpus[i]);
+        }
+    }
+    return selected; // all of them on symmetric or unknown systems
+}
+
+// Restrict the calling thread (and the threads it creates) to cpus
+inline bool set_thread_affinity(const std::vector<int>& cpus)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+    {
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Configure TVM's pool for the calling thread, before its first op.
+// Returns the number of threads the pool will get (0 : TVM default).
+inline int apply_threading(const ThreadingOptions& opts)
+{
+    const std::vector<int> cpus = select_cpus(opts);
+    int threads = opts.threads;
+    if (!cpus.empty())
+    {
+        if (!set_thread_affinity(cpus))
+        {
+            LOG(WARNING) << "Failed to set the cpu affinity, threads are not restricted";
+        }
+        setenv("TVM_BIND_THREADS", "0", 1);
+        if (threads == 0)
+        {
+            threads = static_cast<int>(cpus.size());
+        }
+    }
+    if (threads > 0)
+    {
+        setenv("TVM_NUM_THREADS", std::to_string(threads).c_str(), 1);
+    }
+    return threads;
+}
+
+// Size the pools of the threads started from now on to slices of
+// threads_per_worker threads, see the comment at the top
+inline void set_worker_pools(int threads_per_worker)
+{
+    ThreadingOptions opts;
+    opts.threads = std::max(threads_per_worker, 1);
+    apply_threading(opts);
+    setenv("TVM_BIND_THREADS", "0", 1);
+}
+
+// Run f on a new thread with a fresh TVM pool of the given size; the
+// thread inherits the caller's affinity
+template <typename F>
+void run_on_new_pool(int threads, F f)
+{
+    setenv("TVM_NUM_THREADS", std::to_string(threads).c_str(), 1);
+    std::exception_ptr error;
+    std::thread worker([&] {
+        try
+        {
+            f();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    });
+    worker.join();
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+#endif // __thread_config_h__
@@ -1,8 +1,11 @@
 #!/bin/bash
+#
+# Compare the android vulkan layer dump against the ubuntu vulkan dump.
+# Extra arguments are forwarded, e.g. ./cmp.sh --rtol 0.05 --json cmp.json
+#
+# By default layers with any element where |a - b| > 1e-5 + 0.1 * |b| are reported,
+# together with the first diverging layer in graph order.
 
-find _results/ndk/vulkan/ -name "tvm*.txt" | sort | while read name_android;
-do
-    name=$(basename $name_android);
-    name_ubuntu=_builds/vulkan/${name};
-    paste -d' ' $name_android <(awk '{print $NF}' $name_ubuntu) | awk '{ s1=$(NF); s2=$(NF-1); d=(s1 > s2) ? (s1-s2) : (s2-s1); if(d/(s2+s1+1e-6f) > 0.1) { print " '$name' " NR " " $0 " " d } }';
-done 
+tool=_builds/vulkan/tvm_layer_compare
+
+${tool} _results/ndk/vulkan/tvm_layers.bin _builds/vulkan/tvm_layers.bin "$@"
@@ -25,6 +25,8 @@ import tvm
 import numpy as np
 
 import argparse
+import os
+import struct
 
 target_table = [
     'llvm',
@@ -57,9 +59,35 @@ parser.add_argument(
     help="Host device (cross platform usage)",
 )
 
+parser.add_argument(
+    '--batch',
+    type=int,
+    default=1,
+    help="Batch size the graph is compiled for (files are named from_mxnet_b<N>.* for N > 1)",
+)
+
+parser.add_argument(
+    '--param-format',
+    choices=['fp32', 'fp16', 'bf16', 'int8'],
+    default='fp32',
+    help="Also write the parameters in this compact format (<prefix>.<format>.params, see CompactParams.h)",
+)
+
+parser.add_argument(
+    '--system-lib',
+    action='store_true',
+    help="Also write <prefix>.o, the model as an object for static linking (CMake option TCT_SYSTEM_LIB, llvm targets)",
+)
+
 args = parser.parse_args()
 
-target = args.target
+base_target = args.target # without build options, selects the context below
+target = base_target
+if args.system_lib:
+    if not target.startswith('llvm'):
+        parser.error('--system-lib requires an llvm target')
+    # the kernels register themselves in the runtime's system library
+    target += ' --system-lib'
 target_host = None if (args.target_host == "None") else args.target_host
 
 # detect android cross compilation
@@ -67,6 +95,9 @@ is_android = True if ('android' in (target + str(target_host))) else False
 
 print("is_android ", is_android)
 
+batch = max(args.batch, 1)
+prefix = 'from_mxnet' if batch == 1 else 'from_mxnet_b%d' % batch
+
 ######################################################################
 # Download Resnet18 model from Gluon Model Zoo
 # ---------------------------------------------
@@ -117,7 +148,8 @@ import nnvm.compiler
 print("target ", target)
 print("target_host ", target_host)
 
-shape_dict = {'data': x.shape}
+# the graph is compiled for a fixed batch size, cat.bin always holds one image
+shape_dict = {'data': (batch,) + x.shape[1:]}
 
 #    with tvm.build_config(unroll_explicit=False):
 
@@ -132,22 +164,75 @@ with nnvm.compiler.build_config(opt_level=3):
 #####################
 
 params_bytes = nnvm.compiler.save_param_dict(params)
-with open('from_mxnet.params', 'bw') as f:
+with open(prefix + '.params', 'bw') as f:
   f.write(params_bytes)
 
+# Compact parameter file (CompactParams.h): fp16, bf16 or int8 with one
+# scale per index of the first axis, expanded to fp32 by the C++ loader
+compact_encodings = {'fp32': 0, 'fp16': 1, 'bf16': 2, 'int8': 3}
+
+def encode_param(w, fmt):
+    """Returns (format used, payload bytes, the fp32 values the loader will see)"""
+    w = w.astype(np.float32)
+    if fmt == 'fp16':
+        h = w.astype(np.float16)
+        return fmt, h.tobytes(), h.astype(np.float32)
+    if fmt == 'bf16':
+        # round to nearest even on the upper 16 bits
+        u = w.view(np.uint32).astype(np.uint64)
+        b = ((u + 0x7FFF + ((u >> 16) & 1)) >> 16).astype(np.uint16)
+        return fmt, b.tobytes(), (b.astype(np.uint32) << 16).view(np.float32)
+    if fmt == 'int8' and w.ndim >= 2 and w.size // w.shape[0] >= 8:
+        rows = w.reshape(w.shape[0], -1)
+        scale = np.abs(rows).max(axis=1) / 127.0
+        scale[scale == 0] = 1.0
+        q = np.clip(np.round(rows / scale[:, None]), -127, 127).astype(np.int8)
+        values = (q.astype(np.float32) * scale[:, None].astype(np.float32)).reshape(w.shape)
+        return fmt, scale.astype(np.float32).tobytes() + q.tobytes(), values
+    return 'fp32', w.tobytes(), w
+
+def save_compact_params(filename, params, fmt):
+    expanded = {}
+    with open(filename, 'wb') as f:
+        f.write(b'TCTPARM1')
+        f.write(struct.pack('<II', 1, len(params)))
+        for name in sorted(params):
+            w = params[name].asnumpy()
+            used, payload, expanded[name] = encode_param(w, fmt)
+            encoded_name = name.encode()
+            f.write(struct.pack('<I', len(encoded_name)) + encoded_name)
+            f.write(struct.pack('<II', compact_encodings[used], w.ndim))
+            f.write(struct.pack('<%dq' % w.ndim, *w.shape))
+            f.write(struct.pack('<Q', len(payload)) + payload)
+    return expanded
+
+compact_params = None
+if args.param_format != 'fp32':
+    compact_file = '%s.%s.params' % (prefix, args.param_format)
+    compact_params = save_compact_params(compact_file, params, args.param_format)
+    print('%s: %d bytes (%.1f %% of %s.params)' % (compact_file, os.path.getsize(compact_file),
+          100.0 * os.path.getsize(compact_file) / len(params_bytes), prefix))
+
 # https://docs.tvm.ai/api/python/nnvm/graph.html#nnvm.graph.Graph.json
 graph_json = graph.json()
 
-with open('from_mxnet.json', 'w') as f:
+with open(prefix + '.json', 'w') as f:
   f.write(graph_json)
 
 with open('cat.bin', 'wb') as f:
   f.write(x.astype(np.float32).tobytes())
 
+# the original 8 bit image for the native preprocessing path (--images cat.ppm)
+Image.open(img_name).convert('RGB').save('cat.ppm')
+
 #print("source: ", lib.get_source())  
 
+if args.system_lib:
+    lib.save(prefix + '.o')
+    print('system lib object: %s.o, rebuild with -DTCT_SYSTEM_LIB=ON and run the sample with "system"' % prefix)
+
 if is_android:
-    lib.export_library('from_mxnet.so', tvm.contrib.ndk.create_shared, options=[
+    lib.export_library(prefix + '.so', tvm.contrib.ndk.create_shared, options=[
         "-g",
         "-shared",
         "-fPIC",
@@ -158,7 +243,7 @@ if is_android:
     # skip inference step for cross compilation for now
     exit()
 else:
-    lib.export_library('from_mxnet.so')
+    lib.export_library(prefix + '.so')
 
 
     
@@ -168,33 +253,43 @@ else:
 # Now, we would like to reproduce the same forward computation using TVM.
 from tvm.contrib import graph_runtime
 
-if target=='llvm':
+if base_target=='llvm':
     ctx = tvm.cpu(0)
-elif target=='cuda':
+elif base_target=='cuda':
     ctx = tvm.gpu(0)
-elif target=='opengl':
+elif base_target=='opengl':
     ctx = tvm.opengl(0)
-elif target=='opencl':
+elif base_target=='opencl':
     ctx = tvm.cl(0)
-elif target=='vulkan':
+elif base_target=='vulkan':
     ctx = tvm.vulkan(0)
-elif target=='metal':
+elif base_target=='metal':
     ctx = tvm.metal(0)
 else:
-    raise ValueError('No supported context type for ' % target)
+    raise ValueError('No supported context type for %s' % target)
 
 dtype = 'float32'
 m = graph_runtime.create(graph, lib, ctx)
 # set inputs
-m.set_input('data', tvm.nd.array(x.astype(dtype)))
+m.set_input('data', tvm.nd.array(np.repeat(x, batch, axis=0).astype(dtype)))
 m.set_input(**params)
 # execute
 m.run()
 # get outputs
-tvm_output = m.get_output(0)
-top1 = np.argmax(tvm_output.asnumpy()[0])
+# get_output returns the runtime's output tensor, copy it before the next run
+tvm_output = m.get_output(0).asnumpy()
+top1 = np.argmax(tvm_output[0])
 print('TVM prediction top-1:', top1, synset[top1])
 
+if compact_params is not None:
+    # accuracy delta of the compact parameters, as the C++ loader expands them
+    m.set_input(**{k: tvm.nd.array(v) for k, v in compact_params.items()})
+    m.run()
+    compact_output = m.get_output(0).asnumpy()
+    compact_top1 = np.argmax(compact_output[0])
+    print('%s parameters top-1:' % args.param_format, compact_top1, synset[compact_top1],
+          'max abs delta: %g' % np.abs(compact_output - tvm_output).max())
+
 ######################################################################
 # Use MXNet symbol with pretrained weights
 # ----------------------------------------
@@ -0,0 +1,928 @@
+/*!
+ * \brief Local extensions of the graph runtime for tvm_cpp_test.
+ *
+ *  This file is compiled as part of tvm_runtime_pack.cc, after
+ *  graph_runtime.cc (and graph_runtime_debug.cc), so it can derive from
+ *  the runtime classes and use their protected state directly.
+ *
+ *  tct.graph_runtime.create_from_info
+ *
+ *    Builds a graph runtime from an already parsed GraphRuntimePrivateStuff
+ *    (see GraphRuntime.h) instead of a JSON string, so the graph is parsed
+ *    exactly once per process (or not at all, with the binary graph format
+ *    in GraphBinary.h).  The returned module supports every function of the
+ *    stock (debug) graph runtime.
+ *
+ *  tct.graph_runtime.create_shared
+ *
+ *    Same as create_from_info, but every parameter named in a parameter blob
+ *    (TVM or compact format, CompactParams.h) aliases the tensor of an existing (source) runtime instead of getting
+ *    its own storage.  N instances of one graph then hold a single copy of
+ *    the weights.  The weights are shared read only: set_input or
+ *    load_params on any instance changes them for all of them.
+ *
+ *  load_params (module function of both) reads a TVMByteArray blob in place
+ *  through a dmlc::MemoryFixedSizeStream; the stock function copies it into
+ *  a std::string first, a heap copy of the whole (mapped) parameter file.
+ *
+ *  Zero copy binding (module functions of both)
+ *
+ *    bind_input(name or index, DLTensor*), bind_output(index, DLTensor*)
+ *    make the operators read the input from / write the output to a caller
+ *    owned tensor directly, so run() needs no set_input/get_output copies.
+ *    The tensor must match the graph's shape and dtype (attrs_).  It is bound
+ *    zero copy when it lives on the runtime's device, is compact and 64 byte
+ *    aligned, and the entry is not aliased by a __nop (in place) node;
+ *    otherwise run() copies it in / out (returned 0 instead of 1).  unbind()
+ *    restores the runtime's own storage.  get_output and the debug outputs
+ *    of a zero copy bound output are not updated, read the bound tensor.
+ *    set_input on a bound input drops that binding, from then on run()
+ *    reads the value set_input copied in.
+ *
+ *    To reach the operator arguments this file sets up op_execs_ itself
+ *    (SetupOpExecs + CreateTVMOp of graph_runtime.cc, keeping the argument
+ *    arrays), so every instance built here supports binding.
+ *
+ *  Layer capture (module function of both)
+ *
+ *    run_capture(const std::vector<uint32_t>* nodes, callback) is run() that
+ *    calls callback(node_id, index, DLTensor*) for every output of the
+ *    listed nodes (sorted ids) as soon as the node has run, before a later
+ *    node can reuse its storage, in node order.  See LayerCapture.h.
+ *
+ *  Inter-op parallelism (module function of both)
+ *
+ *    set_inter_op(workers, threads_per_worker) makes run() execute the
+ *    operators on a work stealing DagExecutor (DagExecutor.h) of that many
+ *    worker threads, independent branches concurrently, ordered by the
+ *    data, control and storage reuse dependencies of ExecutionDag.h.
+ *    workers 0 restores the stock sequential run().  run_capture stays
+ *    sequential.
+ *
+ *  Precompiled execution plan (module function of both)
+ *
+ *    set_plan(1) makes run() a loop over a plan built once from the bound
+ *    operator arguments: per operator (__nop nodes dropped) the raw entry
+ *    point of the kernel and a range of one contiguous TVMValue / type code
+ *    array pointing at the argument tensors, so a launch is one indirect
+ *    call, without the std::function, PackedFunc and TVMArgs layers of
+ *    op_execs_.  The entry points are the symbols WrapPackedFunc
+ *    (module_util.h) would call, found in the shared object (or executable)
+ *    whose __tvm_module_ctx points at module_; an operator not found there
+ *    (no dl_iterate_phdr, or a system library without exported symbols)
+ *    keeps its PackedFunc.  Returns the number of operators called
+ *    directly; set_plan(0) restores the stock run().  Bindings stay valid,
+ *    they redirect the same argument tensors.  set_inter_op takes
+ *    precedence.
+ *
+ *  tct.memory.track, tct.memory.stats
+ *
+ *    Allocation accounting for MemoryReport.h.  track() replaces the
+ *    registered device APIs by wrappers that count tensor allocations
+ *    (AllocDataSpace) and operator workspace requests (AllocWorkspace, the
+ *    path of TVMBackendAllocWorkspace into workspace_pool.cc) and forward
+ *    everything else.  The runtime looks a device API up once, on its first
+ *    use, so track() must run before the first tensor is allocated.
+ *    stats(device_type, AllocationStats*) copies the counters of a device.
+ */
+
+#include "CompactParams.h"
+#include "DagExecutor.h"
+#include "ExecutionDag.h"
+#include "GraphRuntime.h"
+#include "MemoryReport.h"
+
+#include <dmlc/memory_io.h>
+#include <tvm/runtime/device_api.h>
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <link.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace tvm {
+namespace runtime {
+
+#if defined(TVM_USE_GRAPH_RUNTIME_DEBUG)
+using GraphRuntimeExtBase = GraphRuntimeDebug;
+#else
+using GraphRuntimeExtBase = GraphRuntime;
+#endif
+
+// Parameter names from a blob written by nnvm.compiler.save_param_dict
+static std::vector<std::string> param_names(const TVMByteArray& blob)
+{
+    if (compact_params::is_compact(blob.data, blob.size))
+    {
+        return compact_params::tensor_names(blob.data, blob.size);
+    }
+
+    constexpr uint64_t kParamListMagic = 0xF7E58D4F05049CB7; // kTVMNDArrayListMagic
+    const char* ptr = blob.data;
+    const char* end = blob.data + blob.size;
+    auto read_u64 = [&]() {
+        uint64_t value = 0;
+        CHECK_LE(sizeof(value), static_cast<std::size_t>(end - ptr)) << "Invalid parameters file format";
+        std::memcpy(&value, ptr, sizeof(value));
+        ptr += sizeof(value);
+        return value;
+    };
+
+    CHECK_EQ(read_u64(), kParamListMagic) << "Invalid parameters file format";
+    read_u64(); // reserved
+    std::vector<std::string> names(read_u64());
+    for (auto& name : names)
+    {
+        const uint64_t length = read_u64();
+        CHECK_LE(length, static_cast<uint64_t>(end - ptr)) << "Invalid parameters file format";
+        name.assign(ptr, length);
+        ptr += length;
+    }
+    return names;
+}
+
+// Entry point of a generated operator (BackendPackedCFunc in module_util.h)
+using OpEntryPoint = int (*)(void* args, int* type_codes, int num_args);
+
+// dlopen handle of the loaded object whose __tvm_module_ctx is module,
+// which DSOModuleNode::Init and the system library set; null if not found
+static void* library_handle(const ModuleNode* module)
+{
+#if defined(__linux__)
+    struct Search
+    {
+        const ModuleNode* module;
+        void* handle;
+    };
+    Search search{ module, nullptr };
+    dl_iterate_phdr([](struct dl_phdr_info* info, size_t, void* data) -> int {
+        auto* search = static_cast<Search*>(data);
+        // The executable has an empty name, dlopen(nullptr) is its handle
+        const char* name = (info->dlpi_name && info->dlpi_name[0]) ? info->dlpi_name : nullptr;
+        void* handle = dlopen(name, RTLD_LAZY | RTLD_NOLOAD);
+        if (!handle)
+        {
+            return 0;
+        }
+        void** ctx = static_cast<void**>(dlsym(handle, "__tvm_module_ctx"));
+        if (ctx && *ctx == search->module)
+        {
+            search->handle = handle;
+            return 1;
+        }
+        dlclose(handle);
+        return 0;
+    }, &search);
+    return search.handle;
+#else
+    return nullptr;
+#endif
+}
+
+class GraphRuntimeExt : public GraphRuntimeExtBase
+{
+public:
+    // Same as GraphRuntime::Init() with the JSON Load() step replaced by a copy.
+    // With a source runtime, the named parameters alias the source's tensors.
+    void InitFromInfo(const GraphRuntimePrivateStuff& info, tvm::runtime::Module module, const std::vector<TVMContext>& ctxs, GraphRuntime* source = nullptr, const std::vector<std::string>& shared_params = {})
+    {
+        nodes_.resize(info.nodes_.size());
+        for (std::size_t i = 0; i < info.nodes_.size(); i++)
+        {
+            const auto& src = info.nodes_[i];
+            auto& dst = nodes_[i];
+            dst.op_type = src.op_type;
+            dst.name = src.name;
+            dst.param.func_name = src.param.func_name;
+            dst.param.num_inputs = src.param.num_inputs;
+            dst.param.num_outputs = src.param.num_outputs;
+            dst.param.flatten_data = src.param.flatten_data;
+            dst.inputs.resize(src.inputs.size());
+            for (std::size_t k = 0; k < src.inputs.size(); k++)
+            {
+                dst.inputs[k].node_id = src.inputs[k].node_id;
+                dst.inputs[k].index = src.inputs[k].index;
+                dst.inputs[k].version = src.inputs[k].version;
+            }
+            dst.control_deps = src.control_deps;
+        }
+
+        input_nodes_ = info.input_nodes_;
+        node_row_ptr_ = info.node_row_ptr_;
+
+        outputs_.resize(info.outputs_.size());
+        for (std::size_t i = 0; i < info.outputs_.size(); i++)
+        {
+            outputs_[i].node_id = info.outputs_[i].node_id;
+            outputs_[i].index = info.outputs_[i].index;
+            outputs_[i].version = info.outputs_[i].version;
+        }
+
+        attrs_.storage_num_not_alloctaed = info.attrs_.storage_num_not_alloctaed;
+        attrs_.storage_id = info.attrs_.storage_id;
+        attrs_.device_index = info.attrs_.device_index;
+        attrs_.dltype = info.attrs_.dltype;
+        attrs_.shape = info.attrs_.shape;
+
+        module_ = module;
+        ctxs_ = ctxs;
+        if (source)
+        {
+            this->SetupSharedStorage(*source, shared_params);
+        }
+        else
+        {
+            this->SetupStorage();
+        }
+        this->SetupBindableOpExecs();
+        dag_ = build_execution_dag(info);
+    }
+
+    PackedFunc GetFunction(const std::string& name, const std::shared_ptr<ModuleNode>& sptr_to_self) final
+    {
+        if (name == "bind_input")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                const int in_idx = (args[0].type_code() == kStr) ? this->GetInputIndex(args[0]) : static_cast<int>(args[0]);
+                CHECK(in_idx >= 0 && in_idx < static_cast<int>(input_nodes_.size())) << "no such graph input";
+                *rv = static_cast<int>(this->Bind(this->entry_id(input_nodes_[in_idx], 0), args[1], input_bindings_));
+            });
+        }
+        else if (name == "bind_output")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                const int index = args[0];
+                CHECK(index >= 0 && index < static_cast<int>(outputs_.size())) << "no such graph output";
+                *rv = static_cast<int>(this->Bind(this->entry_id(outputs_[index]), args[1], output_bindings_));
+            });
+        }
+        else if (name == "set_input")
+        {
+            // Setting a bound input drops its binding, the operators read the copy again
+            PackedFunc set_input = GraphRuntimeExtBase::GetFunction(name, sptr_to_self);
+            return PackedFunc([sptr_to_self, this, set_input](TVMArgs args, TVMRetValue* rv) {
+                const int in_idx = (args[0].type_code() == kStr) ? this->GetInputIndex(args[0]) : static_cast<int>(args[0]);
+                if (in_idx >= 0 && in_idx < static_cast<int>(input_nodes_.size()))
+                {
+                    this->Release(this->entry_id(input_nodes_[in_idx], 0));
+                }
+                set_input.CallPacked(args, rv);
+            });
+        }
+        else if (name == "load_params")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                if (args.type_codes[0] == kBytes)
+                {
+                    const auto* blob = static_cast<const TVMByteArray*>(args.values[0].v_handle);
+                    dmlc::MemoryFixedSizeStream strm(const_cast<char*>(blob->data), blob->size);
+                    this->LoadParams(&strm);
+                }
+                else
+                {
+                    this->LoadParams(args[0].operator std::string());
+                }
+            });
+        }
+        else if (name == "unbind")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) { this->Unbind(); });
+        }
+        else if (name == "run")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) { this->RunBound(); });
+        }
+        else if (name == "set_inter_op")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                const int workers = args[0];
+                const int threads_per_worker = (args.num_args > 1) ? args[1].operator int() : 1;
+                executor_.reset();
+                if (workers > 0)
+                {
+                    executor_.reset(new DagExecutor(dag_, workers, threads_per_worker));
+                }
+            });
+        }
+        else if (name == "set_plan")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                plan_enabled_ = static_cast<int>(args[0]) != 0;
+                if (plan_enabled_ && !plan_)
+                {
+                    this->SetupPlan();
+                }
+                *rv = static_cast<int>(plan_enabled_ ? plan_->direct : 0);
+            });
+        }
+        else if (name == "run_capture")
+        {
+            return PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                const auto* nodes = static_cast<const std::vector<uint32_t>*>(args[0].operator void*());
+                CHECK(nodes) << "null node list";
+                PackedFunc callback = args[1];
+                this->RunBound(nodes, &callback);
+            });
+        }
+        return GraphRuntimeExtBase::GetFunction(name, sptr_to_self);
+    }
+
+private:
+    // Arguments of one operator call, as in GraphRuntime::CreateTVMOp
+    struct OpArgs
+    {
+        std::vector<DLTensor> args;
+        std::vector<TVMValue> arg_values;
+        std::vector<int> arg_tcodes;
+        std::vector<int64_t> shape_data;
+    };
+
+    struct Binding
+    {
+        uint32_t eid;
+        DLTensor* tensor;
+        bool zero_copy;
+    };
+
+    // GraphRuntime::SetupOpExecs() that keeps the argument arrays and records,
+    // per entry, every operator argument that points at it
+    void SetupBindableOpExecs()
+    {
+        op_execs_.assign(this->GetNumOfNodes(), std::function<void()>());
+        op_args_.assign(this->GetNumOfNodes(), nullptr);
+        entry_args_.assign(num_node_entries(), {});
+        nop_alias_.assign(num_node_entries(), false);
+
+        for (uint32_t nid = 0; nid < this->GetNumOfNodes(); ++nid)
+        {
+            const auto& inode = nodes_[nid];
+            if (inode.op_type == "null")
+            {
+                continue;
+            }
+            CHECK(inode.op_type == "tvm_op") << "Can only take tvm_op as op";
+
+            std::vector<uint32_t> eids;
+            for (const auto& e : inode.inputs)
+            {
+                eids.push_back(this->entry_id(e));
+            }
+            for (uint32_t index = 0; index < inode.param.num_outputs; ++index)
+            {
+                eids.push_back(this->entry_id(nid, index));
+            }
+
+            auto arg_ptr = std::make_shared<OpArgs>();
+            for (auto eid : eids)
+            {
+                arg_ptr->args.push_back(*(data_entry_[eid].operator->()));
+            }
+            if (inode.param.flatten_data)
+            {
+                arg_ptr->shape_data.resize(arg_ptr->args.size());
+            }
+            for (std::size_t i = 0; i < arg_ptr->args.size(); ++i)
+            {
+                DLTensor* t = &(arg_ptr->args[i]);
+                TVMValue v;
+                v.v_handle = t;
+                arg_ptr->arg_values.push_back(v);
+                arg_ptr->arg_tcodes.push_back(kArrayHandle);
+                if (inode.param.flatten_data)
+                {
+                    arg_ptr->shape_data[i] = std::accumulate(t->shape, t->shape + t->ndim, int64_t(1), std::multiplies<int64_t>());
+                    t->ndim = 1;
+                    t->shape = &(arg_ptr->shape_data[i]);
+                }
+                entry_args_[eids[i]].push_back(t);
+            }
+            op_args_[nid] = arg_ptr;
+
+            if (inode.param.func_name == "__nop")
+            {
+                // Outputs share the input's memory, rebinding one side would break that
+                for (auto eid : eids)
+                {
+                    nop_alias_[eid] = true;
+                }
+                op_execs_[nid] = []() {};
+                continue;
+            }
+
+            PackedFunc pf = module_.GetFunction(inode.param.func_name, false);
+            CHECK(pf != nullptr) << "no such function in module: " << inode.param.func_name;
+            op_execs_[nid] = [arg_ptr, pf]() {
+                TVMRetValue rv;
+                TVMArgs targs(arg_ptr->arg_values.data(), arg_ptr->arg_tcodes.data(), static_cast<int>(arg_ptr->arg_values.size()));
+                pf.CallPacked(targs, &rv);
+            };
+        }
+    }
+
+    // Operators of the precompiled plan, struct of arrays
+    struct ExecutionPlan
+    {
+        std::vector<OpEntryPoint> funcs; // null : call packed[i]
+        std::vector<PackedFunc> packed;  // only where funcs[i] is null
+        std::vector<uint32_t> offsets;   // argument range i is [offsets[i], offsets[i + 1])
+        std::vector<TVMValue> values;    // all arguments, point into op_args_
+        std::vector<int> type_codes;
+        std::size_t direct{ 0 };
+    };
+
+    void SetupPlan()
+    {
+        std::unique_ptr<ExecutionPlan> plan(new ExecutionPlan());
+        void* handle = library_handle(module_.operator->());
+        plan->offsets.push_back(0);
+        for (uint32_t nid = 0; nid < op_args_.size(); ++nid)
+        {
+            if (!op_args_[nid] || nodes_[nid].param.func_name == "__nop")
+            {
+                continue;
+            }
+
+            const std::string& func_name = nodes_[nid].param.func_name;
+            OpEntryPoint func = nullptr;
+#if defined(__linux__)
+            func = handle ? reinterpret_cast<OpEntryPoint>(dlsym(handle, func_name.c_str())) : nullptr;
+#endif
+            plan->funcs.push_back(func);
+            plan->packed.push_back(func ? PackedFunc() : module_.GetFunction(func_name, false));
+            plan->direct += func ? 1 : 0;
+
+            const OpArgs& args = *op_args_[nid];
+            plan->values.insert(plan->values.end(), args.arg_values.begin(), args.arg_values.end());
+            plan->type_codes.insert(plan->type_codes.end(), args.arg_tcodes.begin(), args.arg_tcodes.end());
+            plan->offsets.push_back(static_cast<uint32_t>(plan->values.size()));
+        }
+#if defined(__linux__)
+        if (handle)
+        {
+            dlclose(handle); // module_ keeps the library loaded
+        }
+#endif
+        plan_ = std::move(plan);
+    }
+
+    void RunPlan()
+    {
+        ExecutionPlan& plan = *plan_;
+        TVMRetValue rv;
+        const std::size_t count = plan.funcs.size();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            TVMValue* values = plan.values.data() + plan.offsets[i];
+            int* type_codes = plan.type_codes.data() + plan.offsets[i];
+            const int num_args = static_cast<int>(plan.offsets[i + 1] - plan.offsets[i]);
+            if (plan.funcs[i])
+            {
+                const int ret = plan.funcs[i](values, type_codes, num_args);
+                CHECK_EQ(ret, 0) << TVMGetLastError();
+            }
+            else
+            {
+                plan.packed[i].CallPacked(TVMArgs(values, type_codes, num_args), &rv);
+            }
+        }
+    }
+
+    // Point every operator argument of entry eid at data
+    void Redirect(uint32_t eid, void* data, uint64_t byte_offset)
+    {
+        for (DLTensor* t : entry_args_[eid])
+        {
+            t->data = data;
+            t->byte_offset = byte_offset;
+        }
+    }
+
+    bool Bind(uint32_t eid, DLTensor* tensor, std::vector<Binding>& bindings)
+    {
+        CHECK(tensor) << "null tensor";
+        const auto& shape = attrs_.shape[eid];
+        const TVMType dtype = tvm::runtime::String2TVMType(attrs_.dltype[eid]);
+        CHECK_EQ(static_cast<std::size_t>(tensor->ndim), shape.size()) << "rank mismatch for entry " << eid;
+        CHECK(std::equal(shape.begin(), shape.end(), tensor->shape)) << "shape mismatch for entry " << eid;
+        CHECK(tensor->dtype.code == dtype.code && tensor->dtype.bits == dtype.bits && tensor->dtype.lanes == dtype.lanes)
+            << "dtype mismatch for entry " << eid << ", expected " << attrs_.dltype[eid];
+
+        constexpr uintptr_t kAlignment = 64; // kAllocAlignment, what the generated code expects
+        const DLTensor* own = data_entry_[eid].operator->();
+        const uintptr_t address = reinterpret_cast<uintptr_t>(tensor->data) + tensor->byte_offset;
+        const bool zero_copy = !nop_alias_[eid] && tensor->strides == nullptr && (address % kAlignment) == 0 && tensor->ctx.device_type == own->ctx.device_type && tensor->ctx.device_id == own->ctx.device_id;
+
+        Release(eid);
+        bindings.push_back({ eid, tensor, zero_copy });
+        if (zero_copy)
+        {
+            Redirect(eid, tensor->data, tensor->byte_offset);
+        }
+        return zero_copy;
+    }
+
+    // Drop any binding of entry eid
+    void Release(uint32_t eid)
+    {
+        for (auto* bindings : { &input_bindings_, &output_bindings_ })
+        {
+            bindings->erase(std::remove_if(bindings->begin(), bindings->end(), [eid](const Binding& b) { return b.eid == eid; }), bindings->end());
+        }
+        const DLTensor* own = data_entry_[eid].operator->();
+        Redirect(eid, own->data, own->byte_offset);
+    }
+
+    void Unbind()
+    {
+        for (auto* bindings : { &input_bindings_, &output_bindings_ })
+        {
+            for (const auto& b : *bindings)
+            {
+                const DLTensor* own = data_entry_[b.eid].operator->();
+                Redirect(b.eid, own->data, own->byte_offset);
+            }
+            bindings->clear();
+        }
+    }
+
+    // Run() with the copies of bindings that could not be zero copy, and
+    // the outputs of the capture nodes passed to callback
+    void RunBound(const std::vector<uint32_t>* capture = nullptr, const PackedFunc* callback = nullptr)
+    {
+        for (const auto& b : input_bindings_)
+        {
+            if (!b.zero_copy)
+            {
+                data_entry_[b.eid].CopyFrom(b.tensor);
+            }
+        }
+
+        if (capture)
+        {
+            // Variables have storage of their own, nothing overwrites them
+            auto next = capture->begin();
+            for (uint32_t nid = 0; nid < op_execs_.size(); ++nid)
+            {
+                if (op_execs_[nid])
+                {
+                    op_execs_[nid]();
+                }
+                for (; next != capture->end() && *next == nid; ++next)
+                {
+                    const uint32_t num_outputs = (nodes_[nid].op_type == "null") ? 1 : nodes_[nid].param.num_outputs;
+                    for (uint32_t index = 0; index < num_outputs; ++index)
+                    {
+                        this->Report(nid, index, *callback);
+                    }
+                }
+            }
+        }
+        else if (executor_)
+        {
+            executor_->Run(op_execs_);
+        }
+        else if (plan_enabled_)
+        {
+            this->RunPlan();
+        }
+        else
+        {
+            this->Run();
+        }
+
+        for (const auto& b : output_bindings_)
+        {
+            if (!b.zero_copy)
+            {
+                data_entry_[b.eid].CopyTo(b.tensor);
+            }
+        }
+    }
+
+    // Pass the tensor the operators see for an output to callback
+    void Report(uint32_t nid, uint32_t index, const PackedFunc& callback)
+    {
+        const uint32_t eid = this->entry_id(nid, index);
+        DLTensor tensor = *(data_entry_[eid].operator->());
+        if (!entry_args_[eid].empty()) // redirected by a zero copy binding
+        {
+            tensor.data = entry_args_[eid].front()->data;
+            tensor.byte_offset = entry_args_[eid].front()->byte_offset;
+        }
+        callback(static_cast<int>(nid), static_cast<int>(index), &tensor);
+    }
+
+    // GraphRuntime::SetupStorage() for entries that are not shared; pool
+    // entries used only by shared parameters are not allocated at all.
+    // Entries in the storage of a shared parameter (the outputs of __nop
+    // nodes, e.g. a reshape of the parameter) view the shared tensor.
+    void SetupSharedStorage(GraphRuntime& source, const std::vector<std::string>& names)
+    {
+        CHECK_EQ(source.GetNumOfNodes(), nodes_.size()) << "shared parameters need the same graph";
+
+        std::vector<NDArray> shared(num_node_entries());
+        for (const auto& name : names)
+        {
+            const int index = this->GetInputIndex(name);
+            CHECK_GE(index, 0) << "Found param for non-existent input: " << name;
+            const uint32_t eid = this->entry_id(input_nodes_[index], 0);
+            shared[eid] = source.GetInput(source.GetInputIndex(name));
+            CHECK(shared[eid].defined()) << "source runtime has no parameter " << name;
+            CHECK_EQ(static_cast<std::size_t>(shared[eid]->ndim), attrs_.shape[eid].size()) << "shape mismatch for " << name;
+            CHECK(std::equal(attrs_.shape[eid].begin(), attrs_.shape[eid].end(), shared[eid]->shape)) << "shape mismatch for " << name;
+        }
+
+        std::vector<TVMType> vtype;
+        for (const std::string& s_type : attrs_.dltype)
+        {
+            vtype.push_back(tvm::runtime::String2TVMType(s_type));
+        }
+
+        // Shared tensor per storage id, undefined : the pool's own storage
+        std::map<int, NDArray> shared_storage;
+        for (std::size_t i = 0; i < shared.size(); ++i)
+        {
+            if (shared[i].defined())
+            {
+                shared_storage[attrs_.storage_id[i]] = shared[i];
+            }
+        }
+
+        // Size and device type of each storage pool entry, 0 / -1 : unused
+        std::vector<std::size_t> pool_size;
+        std::vector<int> pool_device;
+        for (std::size_t i = 0; i < attrs_.shape.size(); ++i)
+        {
+            const int storage_id = attrs_.storage_id[i];
+            CHECK_GE(storage_id, 0) << "Do not support runtime shape op";
+            const uint32_t sid = static_cast<uint32_t>(storage_id);
+            if (sid >= pool_size.size())
+            {
+                pool_size.resize(sid + 1, 0);
+                pool_device.resize(sid + 1, -1);
+            }
+            if (shared_storage.count(storage_id))
+            {
+                continue;
+            }
+
+            const int device_type = attrs_.device_index.empty() ? static_cast<int>(ctxs_[0].device_type) : attrs_.device_index[i];
+            CHECK(pool_device[sid] == -1 || pool_device[sid] == device_type) << "The same pool entry cannot be assigned to multiple devices";
+
+            std::size_t size = 1;
+            for (int64_t sz : attrs_.shape[i])
+            {
+                size *= static_cast<std::size_t>(sz);
+            }
+            const std::size_t bits = vtype[i].bits * vtype[i].lanes;
+            CHECK(bits % 8U == 0U || bits == 1U);
+            pool_size[sid] = std::max(pool_size[sid], ((bits + 7U) / 8U) * size);
+            pool_device[sid] = device_type;
+        }
+
+        for (std::size_t sid = 0; sid < pool_size.size(); ++sid)
+        {
+            if (pool_device[sid] == -1)
+            {
+                storage_pool_.push_back(NDArray());
+                continue;
+            }
+
+            const auto& cit = std::find_if(ctxs_.begin(), ctxs_.end(), [&](const TVMContext& c) {
+                return pool_device[sid] == static_cast<int>(c.device_type);
+            });
+            const TVMContext ctx = (cit == ctxs_.end()) ? ctxs_[0] : *cit;
+            const std::vector<int64_t> shape{ static_cast<int64_t>(pool_size[sid] + 3) / 4 };
+            storage_pool_.push_back(NDArray::Empty(shape, DLDataType{ kDLFloat, 32, 1 }, ctx));
+        }
+
+        data_entry_.resize(num_node_entries());
+        for (std::size_t i = 0; i < data_entry_.size(); ++i)
+        {
+            auto it = shared_storage.find(attrs_.storage_id[i]);
+            if (shared[i].defined())
+            {
+                data_entry_[i] = shared[i];
+            }
+            else if (it != shared_storage.end())
+            {
+                data_entry_[i] = it->second.CreateView(attrs_.shape[i], vtype[i]);
+            }
+            else
+            {
+                data_entry_[i] = storage_pool_[attrs_.storage_id[i]].CreateView(attrs_.shape[i], vtype[i]);
+            }
+        }
+    }
+
+    std::vector<std::shared_ptr<OpArgs>> op_args_;  // per node, null for variables
+    std::vector<std::vector<DLTensor*>> entry_args_; // per entry, into op_args_
+    std::vector<bool> nop_alias_;                    // per entry
+    std::vector<Binding> input_bindings_;
+    std::vector<Binding> output_bindings_;
+    ExecutionDag dag_;
+    std::unique_ptr<DagExecutor> executor_; // null : sequential run()
+    std::unique_ptr<ExecutionPlan> plan_;   // built on the first set_plan(1)
+    bool plan_enabled_{ false };
+};
+
+TVM_REGISTER_GLOBAL("tct.graph_runtime.create_from_info")
+    .set_body([](TVMArgs args, TVMRetValue* rv) {
+        CHECK_EQ(args.num_args, 4) << "expected (info, module, device_type, device_id)";
+        const auto* info = static_cast<const GraphRuntimePrivateStuff*>(args[0].operator void*());
+        CHECK(info) << "null graph info";
+
+        TVMContext ctx;
+        ctx.device_type = static_cast<DLDeviceType>(args[2].operator int());
+        ctx.device_id = args[3];
+
+        std::shared_ptr<GraphRuntimeExt> exec = std::make_shared<GraphRuntimeExt>();
+        exec->InitFromInfo(*info, args[1], { ctx });
+        *rv = Module(exec);
+    });
+
+TVM_REGISTER_GLOBAL("tct.graph_runtime.create_shared")
+    .set_body([](TVMArgs args, TVMRetValue* rv) {
+        CHECK_EQ(args.num_args, 6) << "expected (info, module, device_type, device_id, source, params)";
+        const auto* info = static_cast<const GraphRuntimePrivateStuff*>(args[0].operator void*());
+        CHECK(info) << "null graph info";
+
+        Module source_module = args[4];
+        auto* source = dynamic_cast<GraphRuntime*>(source_module.operator->());
+        CHECK(source) << "source is not a graph runtime";
+
+        // Only the names are read, so the blob is not copied into a std::string
+        CHECK_EQ(args.type_codes[5], kBytes) << "expected the parameter blob as bytes";
+        const auto* params = static_cast<const TVMByteArray*>(args.values[5].v_handle);
+
+        TVMContext ctx;
+        ctx.device_type = static_cast<DLDeviceType>(args[2].operator int());
+        ctx.device_id = args[3];
+
+        std::shared_ptr<GraphRuntimeExt> exec = std::make_shared<GraphRuntimeExt>();
+        exec->InitFromInfo(*info, args[1], { ctx }, source, param_names(*params));
+        *rv = Module(exec);
+    });
+
+// Counting device API, forwards to the device API it replaces
+class TrackingDeviceAPI final : public DeviceAPI
+{
+public:
+    explicit TrackingDeviceAPI(DeviceAPI* base)
+        : base_(base)
+    {
+    }
+
+    void SetDevice(TVMContext ctx) final { base_->SetDevice(ctx); }
+    void GetAttr(TVMContext ctx, DeviceAttrKind kind, TVMRetValue* rv) final { base_->GetAttr(ctx, kind, rv); }
+
+    void* AllocDataSpace(TVMContext ctx, size_t nbytes, size_t alignment, TVMType type_hint) final
+    {
+        void* ptr = base_->AllocDataSpace(ctx, nbytes, alignment, type_hint);
+        std::lock_guard<std::mutex> lock(mutex_);
+        data_[ptr] = nbytes;
+        stats_.data_allocs++;
+        stats_.data_bytes += nbytes;
+        stats_.data_peak_bytes = std::max(stats_.data_peak_bytes, stats_.data_bytes);
+        return ptr;
+    }
+
+    void FreeDataSpace(TVMContext ctx, void* ptr) final
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = data_.find(ptr);
+            if (it != data_.end()) // allocated before tracking started otherwise
+            {
+                stats_.data_bytes -= it->second;
+                data_.erase(it);
+            }
+        }
+        base_->FreeDataSpace(ctx, ptr);
+    }
+
+    void CopyDataFromTo(const void* from, size_t from_offset, void* to, size_t to_offset, size_t num_bytes,
+                        TVMContext ctx_from, TVMContext ctx_to, TVMType type_hint, TVMStreamHandle stream) final
+    {
+        base_->CopyDataFromTo(from, from_offset, to, to_offset, num_bytes, ctx_from, ctx_to, type_hint, stream);
+    }
+
+    TVMStreamHandle CreateStream(TVMContext ctx) final { return base_->CreateStream(ctx); }
+    void FreeStream(TVMContext ctx, TVMStreamHandle stream) final { base_->FreeStream(ctx, stream); }
+    void StreamSync(TVMContext ctx, TVMStreamHandle stream) final { base_->StreamSync(ctx, stream); }
+    void SetStream(TVMContext ctx, TVMStreamHandle stream) final { base_->SetStream(ctx, stream); }
+    void SyncStreamFromTo(TVMContext ctx, TVMStreamHandle event_src, TVMStreamHandle event_dst) final
+    {
+        base_->SyncStreamFromTo(ctx, event_src, event_dst);
+    }
+
+    void* AllocWorkspace(TVMContext ctx, size_t nbytes, TVMType type_hint) final
+    {
+        void* ptr = base_->AllocWorkspace(ctx, nbytes, type_hint);
+        std::lock_guard<std::mutex> lock(mutex_);
+        workspace_[ptr] = nbytes;
+        stats_.workspace_allocs++;
+        stats_.workspace_bytes += nbytes;
+        stats_.workspace_peak_bytes = std::max(stats_.workspace_peak_bytes, stats_.workspace_bytes);
+        stats_.workspace_max_request = std::max(stats_.workspace_max_request, nbytes);
+        return ptr;
+    }
+
+    void FreeWorkspace(TVMContext ctx, void* ptr) final
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = workspace_.find(ptr);
+            if (it != workspace_.end())
+            {
+                stats_.workspace_bytes -= it->second;
+                workspace_.erase(it);
+            }
+        }
+        base_->FreeWorkspace(ctx, ptr);
+    }
+
+    AllocationStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    DeviceAPI* base_;
+    mutable std::mutex mutex_;
+    std::map<void*, size_t> data_;
+    std::map<void*, size_t> workspace_;
+    AllocationStats stats_;
+};
+
+// Tracked device APIs by device type, alive until the process exits like
+// the device APIs they wrap
+static std::map<int, TrackingDeviceAPI*>& tracked_device_apis()
+{
+    static std::map<int, TrackingDeviceAPI*> apis;
+    return apis;
+}
+
+static std::mutex& tracked_device_apis_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+TVM_REGISTER_GLOBAL("tct.memory.track")
+    .set_body([](TVMArgs args, TVMRetValue* rv) {
+        // The names DeviceAPIManager looks up (c_runtime_api.cc, DeviceName)
+        static const std::pair<int, const char*> devices[] = {
+            { kDLCPU, "cpu" }, { kDLGPU, "gpu" }, { kDLOpenCL, "opencl" }, { kDLVulkan, "vulkan" }, { kDLMetal, "metal" }, { kOpenGL, "opengl" }
+        };
+
+        std::lock_guard<std::mutex> lock(tracked_device_apis_mutex());
+        auto& apis = tracked_device_apis();
+        for (const auto& device : devices)
+        {
+            const std::string name = std::string("device_api.") + device.second;
+            const PackedFunc* get = Registry::Get(name);
+            if (!get || apis.count(device.first))
+            {
+                continue;
+            }
+
+            // Register() keeps the entry and replaces its body, so the base
+            // device API is fetched first
+            void* base = (*get)();
+            TrackingDeviceAPI* api = new TrackingDeviceAPI(static_cast<DeviceAPI*>(base));
+            apis[device.first] = api;
+            Registry::Register(name, true).set_body([api](TVMArgs, TVMRetValue* rv) { *rv = static_cast<void*>(api); });
+        }
+        *rv = static_cast<int>(apis.size());
+    });
+
+TVM_REGISTER_GLOBAL("tct.memory.stats")
+    .set_body([](TVMArgs args, TVMRetValue* rv) {
+        CHECK_EQ(args.num_args, 2) << "expected (device_type, AllocationStats*)";
+        const int device_type = args[0];
+        auto* stats = static_cast<AllocationStats*>(args[1].operator void*());
+        CHECK(stats) << "null stats";
+
+        std::lock_guard<std::mutex> lock(tracked_device_apis_mutex());
+        auto it = tracked_device_apis().find(device_type);
+        if (it != tracked_device_apis().end())
+        {
+            *stats = it->second->stats();
+        }
+        *rv = static_cast<int>(it != tracked_device_apis().end());
+    });
+
+} // namespace runtime
+} // namespace tvm
@@ -0,0 +1,136 @@
+"""
+Performance regression check, run by CTest (see CMakeLists.txt).
+
+Runs a benchmark command that writes a JSON report, takes the median of
+every metric over --repeat runs and compares it with a stored baseline:
+
+    perf_check.py BASELINE RESULT [--repeat N] [--update --output FILE] -- command args...
+
+The baseline file lists the metrics by their path in the report (list
+elements by index, e.g. "latency.p99_ms" or "best.0.throughput"):
+
+    {
+      "metrics": {
+        "latency.p50_ms": { "value": 12.5, "tolerance": 0.15, "better": "lower" }
+      }
+    }
+
+A metric regresses when it is worse than value * (1 + tolerance) (lower is
+better) or value * (1 - tolerance) (higher is better); any regression fails
+the test.  Baselines depend on the machine and the stored files carry no
+values: a metric without a value is not checked, and when no metric has
+one the benchmark is not run at all.  Either way the test exits with
+SKIP_STATUS (77, CTest's SKIP_RETURN_CODE of the perf tests) unless a
+recorded metric regressed.  --update (or TCT_PERF_UPDATE=1) writes the
+baseline with the measured values to --output instead of checking them;
+the baseline file itself is never modified.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+SKIP_STATUS = 77
+
+
+def lookup(report, path):
+    value = report
+    for key in path.split('.'):
+        if isinstance(value, list):
+            value = value[int(key)]
+        else:
+            value = value[key]
+    return float(value)
+
+
+def median(values):
+    values = sorted(values)
+    n = len(values)
+    return values[n // 2] if n % 2 else 0.5 * (values[n // 2 - 1] + values[n // 2])
+
+
+def measure(command, result, metrics, repeat):
+    samples = {name: [] for name in metrics}
+    for _ in range(repeat):
+        if os.path.exists(result):
+            os.remove(result)
+        status = subprocess.call(command)
+        if status != 0:
+            sys.exit("command failed with status %d: %s" % (status, ' '.join(command)))
+        with open(result) as f:
+            report = json.load(f)
+        for name in metrics:
+            samples[name].append(lookup(report, name))
+    return {name: median(values) for name, values in samples.items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare a benchmark JSON report with a stored baseline")
+    parser.add_argument('baseline', help="baseline file")
+    parser.add_argument('result', help="JSON report written by the command")
+    parser.add_argument('--repeat', type=int, default=1, help="runs, the median of every metric is compared")
+    parser.add_argument('--update', action='store_true', help="write the measured values as a new baseline to --output")
+    parser.add_argument('--output', help="new baseline file written by --update")
+    argv = sys.argv[1:]
+    split = argv.index('--') if '--' in argv else len(argv)
+    args = parser.parse_args(argv[:split])
+    command = argv[split + 1:]
+    if not command:
+        parser.error("missing benchmark command after --")
+    update = args.update or os.environ.get('TCT_PERF_UPDATE') == '1'
+    if update and not args.output:
+        parser.error("--update requires --output")
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    metrics = baseline['metrics']
+    missing = sorted(name for name, spec in metrics.items() if spec.get('value') is None)
+    if not update and len(missing) == len(metrics):
+        print("no baseline values in %s, record them with TCT_PERF_UPDATE=1: skipped" % args.baseline)
+        return SKIP_STATUS
+
+    measured = measure(command, args.result, metrics, max(args.repeat, 1))
+
+    if update:
+        for name, value in measured.items():
+            metrics[name]['value'] = value
+        directory = os.path.dirname(args.output)
+        if directory and not os.path.isdir(directory):
+            os.makedirs(directory)
+        with open(args.output, 'w') as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write('\n')
+        print("baseline written: %s" % args.output)
+        return 0
+
+    regressions = 0
+    print("%-32s %14s %14s %14s %8s" % ("metric", "baseline", "limit", "measured", "change"))
+    for name in sorted(metrics):
+        spec = metrics[name]
+        value = measured[name]
+        if spec.get('value') is None:
+            print("%-32s %14s %14s %14.6g" % (name, "-", "-", value))
+            continue
+
+        base = float(spec['value'])
+        tolerance = float(spec.get('tolerance', 0.1))
+        lower = spec.get('better', 'lower') == 'lower'
+        limit = base * (1.0 + tolerance) if lower else base * (1.0 - tolerance)
+        change = (value - base) / base if base else 0.0
+        regressed = value > limit if lower else value < limit
+        regressions += int(regressed)
+        print("%-32s %14.6g %14.6g %14.6g %+7.1f%%%s" % (name, base, limit, value, 100.0 * change, "  REGRESSION" if regressed else ""))
+
+    if regressions:
+        print("%d metric(s) regressed against %s" % (regressions, args.baseline))
+        return 1
+    if missing:
+        print("no baseline value for %s in %s: skipped" % (', '.join(missing), args.baseline))
+        return SKIP_STATUS
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
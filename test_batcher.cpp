@@ -0,0 +1,129 @@
+// DynamicBatcher (Batcher.h) deadline test: max_wait counts from the
+// arrival of the oldest queued request, so a request that arrived while a
+// batch was running, and whose max_wait has passed by then, runs as soon as
+// that batch finishes instead of waiting max_wait again.
+//
+// The batcher drives a fake graph runtime module whose run() doubles its
+// input and takes kRunTime, so no model files are needed.
+
+#include "Batcher.h"
+#include "ModelLoader.h"
+#include "TestGraphs.h"
+
+#include <dlpack/dlpack.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr int kBatch = 4;
+static constexpr int kSample = 2; // floats per sample
+static const std::chrono::milliseconds kMaxWait(200);
+static const std::chrono::milliseconds kRunTime(500);
+
+// set_input / run / get_output of a graph computing 2 * data
+class FakeRuntime final : public tvm::runtime::ModuleNode
+{
+public:
+    const char* type_key() const final { return "fake_graph_runtime"; }
+
+    tvm::runtime::PackedFunc GetFunction(const std::string& name, const std::shared_ptr<tvm::runtime::ModuleNode>& sptr_to_self) final
+    {
+        using tvm::runtime::TVMArgs;
+        using tvm::runtime::TVMRetValue;
+        if (name == "set_input")
+        {
+            return tvm::runtime::PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                const DLTensor* x = args[1];
+                std::memcpy(data_.data(), x->data, data_.size() * sizeof(float));
+            });
+        }
+        else if (name == "run")
+        {
+            return tvm::runtime::PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                const auto start = Clock::now();
+                std::this_thread::sleep_for(kRunTime);
+                for (auto& v : data_)
+                {
+                    v *= 2.f;
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                runs_.push_back({ start, Clock::now() });
+            });
+        }
+        else if (name == "get_output")
+        {
+            return tvm::runtime::PackedFunc([sptr_to_self, this](TVMArgs args, TVMRetValue* rv) {
+                DLTensor* y = args[1];
+                std::memcpy(y->data, data_.data(), data_.size() * sizeof(float));
+            });
+        }
+        return tvm::runtime::PackedFunc();
+    }
+
+    std::vector<std::pair<Clock::time_point, Clock::time_point>> runs()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return runs_;
+    }
+
+private:
+    std::vector<float> data_ = std::vector<float>(kBatch * kSample);
+    std::mutex mutex_;
+    std::vector<std::pair<Clock::time_point, Clock::time_point>> runs_; // start, end
+};
+
+int main() try
+{
+    // One float32 variable "data" of kBatch x kSample, which is also the output
+    const std::string graph = make_graph_json({ { "data", { kBatch, kSample }, -1 } });
+    GraphRuntimePrivateStuff info;
+    load_graph_info(graph.data(), graph.size(), info);
+
+    auto runtime = std::make_shared<FakeRuntime>();
+    BatchingOptions opts;
+    opts.max_wait = kMaxWait;
+    std::vector<std::pair<Clock::time_point, Clock::time_point>> runs;
+    {
+        DynamicBatcher batcher(tvm::runtime::Module(runtime), info, kDLCPU, 0, opts);
+
+        // a runs alone after max_wait; b arrives during a's run, and its
+        // max_wait is over before that run ends
+        const float a_sample[kSample] = { 1.f, 2.f };
+        const float b_sample[kSample] = { 3.f, 4.f };
+        auto a = batcher.Submit(a_sample);
+        std::this_thread::sleep_for(kMaxWait + (kRunTime - kMaxWait) / 4);
+        auto b = batcher.Submit(b_sample);
+
+        const DynamicBatcher::Result a_result = a.get();
+        const DynamicBatcher::Result b_result = b.get();
+        CHECK_EQ(a_result.batch_size, 1);
+        CHECK_EQ(b_result.batch_size, 1);
+        CHECK_EQ(b_result.output.size(), static_cast<std::size_t>(kSample));
+        CHECK_EQ(b_result.output[0], 6.f);
+        CHECK_EQ(b_result.output[1], 8.f);
+        runs = runtime->runs();
+    }
+
+    CHECK_EQ(runs.size(), 2U);
+    const auto gap = std::chrono::duration_cast<std::chrono::milliseconds>(runs[1].first - runs[0].second);
+    std::cout << "second batch started " << gap.count() << " ms after the first one ended" << std::endl;
+    CHECK_LT(gap.count(), kMaxWait.count() / 2) << "the request waited max_wait again after the running batch";
+
+    std::cout << "batcher deadline: ok" << std::endl;
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
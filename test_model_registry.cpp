@@ -0,0 +1,69 @@
+// ModelRegistry (ModelRegistry.h) eviction test: a model that needs the
+// room of several idle models evicts all of them in one Reserve(), least
+// recently used first, and skips the models still in use.
+//
+// The models are graphs of a single variable (no operators) run from the
+// system library, so the footprint is exactly the variable's bytes and no
+// model files are needed.
+
+#include "ModelRegistry.h"
+#include "TestGraphs.h"
+
+#include <dlpack/dlpack.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+static constexpr std::size_t kUnit = 1 << 20; // footprint of a small model
+
+int main() try
+{
+    const std::string prefix = "test_model_registry_";
+    write_param_list(prefix + "empty.params", {}); // save_param_dict({})
+
+    ModelRegistryOptions opts;
+    opts.budget_bytes = 3 * kUnit;
+    ModelRegistry registry(opts, kDLCPU, 0);
+    for (const auto& model : std::vector<std::pair<std::string, std::size_t>>{ { "a", kUnit }, { "b", kUnit }, { "c", kUnit }, { "big", 2 * kUnit } })
+    {
+        // A single float32 variable of the model's bytes
+        write_graph_json(prefix + model.first + ".json", { { "data", { static_cast<int64_t>(model.second / sizeof(float)) }, -1 } });
+        registry.Add({ model.first, "system", prefix + model.first + ".json", prefix + "empty.params" });
+    }
+
+    // a stays in use, b and c are idle: LRU order c, b, a
+    std::shared_ptr<GraphModel> a = registry.Get("a");
+    registry.Get("b");
+    registry.Get("c");
+    CHECK_EQ(registry.resident_bytes(), 3 * kUnit);
+
+    // big needs two units: b and c go in one Reserve(), a is skipped
+    registry.Get("big");
+    const std::vector<std::string> resident = registry.resident();
+    CHECK_EQ(resident.size(), 2U);
+    CHECK_EQ(resident[0], "big");
+    CHECK_EQ(resident[1], "a");
+    CHECK_EQ(registry.resident_bytes(), 3 * kUnit);
+
+    auto stats = registry.stats();
+    CHECK_EQ(stats["a"].evictions, 0U);
+    CHECK_EQ(stats["b"].evictions, 1U);
+    CHECK_EQ(stats["c"].evictions, 1U);
+
+    // Once a is idle, c needs a single eviction: a is the least recently used
+    a.reset();
+    registry.Get("c");
+    stats = registry.stats();
+    CHECK_EQ(stats["a"].evictions, 1U);
+    CHECK_EQ(stats["big"].evictions, 0U);
+    CHECK_EQ(stats["c"].misses, 2U);
+
+    std::cout << "model registry eviction: ok" << std::endl;
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
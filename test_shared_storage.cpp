@@ -0,0 +1,56 @@
+// Shared parameter storage test (tct.graph_runtime.create_shared in
+// graph_runtime_ext.cc): the output of a __nop node (a reshape) applied to
+// a shared parameter lives in the parameter's storage, so in an instance
+// that shares the weights it must view the source's tensor instead of
+// uninitialized storage of its own.
+//
+// The graph has no kernels (a variable and a __nop), so it runs from the
+// system library without model files.
+
+#include "ModelLoader.h"
+#include "TestGraphs.h"
+
+#include <dlpack/dlpack.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/ndarray.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main() try
+{
+    // w (2x3) reshaped to 6 by a __nop node in w's storage, the graph output
+    const std::string graph = make_graph_json({ { "w", { 2, 3 }, -1 }, { "reshape0", { 6 }, 0 } });
+    GraphRuntimePrivateStuff info;
+    load_graph_info(graph.data(), graph.size(), info);
+
+    const std::vector<float> values{ 1.f, 2.f, 3.f, 4.f, 5.f, 6.f };
+    const std::string param_file = "test_shared_storage.params";
+    write_param_list(param_file, { { "w", { 2, 3 }, values } });
+
+    tvm::runtime::Module lib = load_operator_library("system");
+    tvm::runtime::Module source = create_graph_runtime(info, lib, kDLCPU, 0);
+    load_params(source, param_file);
+    tvm::runtime::Module shared = create_shared_graph_runtime(info, lib, kDLCPU, 0, source, param_file);
+
+    shared.GetFunction("run")();
+    tvm::runtime::NDArray y = shared.GetFunction("get_output")(0);
+    tvm::runtime::NDArray source_w = source.GetFunction("get_input")("w");
+    CHECK_EQ(y->ndim, 1);
+    CHECK_EQ(y->shape[0], 6);
+    CHECK(y->data == source_w->data) << "the __nop output does not alias the shared parameter";
+
+    std::vector<float> output(values.size());
+    TVMArrayCopyToBytes(const_cast<DLTensor*>(y.operator->()), output.data(), output.size() * sizeof(float));
+    CHECK(output == values) << "the __nop output does not hold the shared parameter";
+
+    std::cout << "shared storage: ok" << std::endl;
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
@@ -0,0 +1,338 @@
+// Throughput of the asynchronous submit / callback API (AsyncRunner.h) against
+// the synchronous loop of tvm_deploy_gpu_sample (copy in, set_input, run,
+// get_output, copy out, post-process), on one runtime instance.  Every
+// request ends with the top-k post-processing, which the pipeline overlaps
+// with the next run.
+
+#include "AsyncRunner.h"
+#include "Benchmark.h"
+#include "BenchmarkArgs.h"
+#include "Device.h"
+#include "ModelLoader.h"
+#include "Postprocess.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct AsyncBenchOptions
+{
+    std::string lib;
+    std::string graph{ "from_mxnet.json" };
+    std::string params{ "from_mxnet.params" };
+    std::string input{ "cat.bin" };
+    std::vector<int> depths{ 1, 2, 4, 8 }; // max in flight per async setting
+    int buffers{ 2 };
+    int requests{ 200 }; // timed requests per setting
+    int warmup{ 10 };
+    bool softmax{ false };
+    int expected{ 282 }; // expected top-1, -1 : no check
+    std::string json;
+};
+
+struct AsyncResult
+{
+    std::string mode; // "sync" or "async"
+    int depth{ 0 };
+    int buffers{ 0 };
+    double throughput{ 0.0 }; // requests per second
+    double speedup{ 0.0 };    // vs. sync
+    std::size_t top1_errors{ 0 };
+    LatencyStats latency; // submit to result
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("mode", mode);
+        writer->WriteObjectKeyValue("depth", depth);
+        writer->WriteObjectKeyValue("buffers", buffers);
+        writer->WriteObjectKeyValue("throughput", throughput);
+        writer->WriteObjectKeyValue("speedup", speedup);
+        writer->WriteObjectKeyValue("top1_errors", top1_errors);
+        writer->WriteObjectKeyValue("latency", latency);
+        writer->EndObject();
+    }
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_async_bench /full/path/to/from_mxnet.so [options]\n"
+              << "  --graph FILE     graph JSON or binary graph (default from_mxnet.json)\n"
+              << "  --params FILE    parameters (default from_mxnet.params)\n"
+              << "  --input FILE     one input sample (default cat.bin)\n"
+              << "  --depths LIST    comma separated max in flight requests of the async runs (default 1,2,4,8)\n"
+              << "  --buffers N      device input and output buffers each (default 2)\n"
+              << "  --requests N     timed requests per setting (default 200)\n"
+              << "  --warmup N       untimed requests per setting (default 10)\n"
+              << "  --softmax 0|1    softmax in post-processing (default 0)\n"
+              << "  --expect N       expected top-1 class, -1 to disable the check (default 282)\n"
+              << "  --json FILE      write the results as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, AsyncBenchOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.lib = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--graph")
+        {
+            opts.graph = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--depths")
+        {
+            opts.depths = parse_list(value);
+        }
+        else if (arg == "--buffers")
+        {
+            opts.buffers = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--requests")
+        {
+            opts.requests = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--warmup")
+        {
+            opts.warmup = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--softmax")
+        {
+            opts.softmax = (std::atoi(value) != 0);
+        }
+        else if (arg == "--expect")
+        {
+            opts.expected = std::atoi(value);
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return !opts.depths.empty();
+}
+
+// The sample's loop: nothing overlaps
+static AsyncResult run_sync(GraphModel& model, const AsyncBenchOptions& opts, const std::vector<float>& input)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    const auto& info = model.info;
+    const auto& in_shape = info.attrs_.shape[info.entry_id(info.input_nodes_.front(), 0)];
+    const auto& out_shape = info.attrs_.shape[info.entry_id(info.outputs_.front())];
+    const std::size_t out_size = element_count(out_shape);
+
+    DLTensor* x = nullptr;
+    DLTensor* y = nullptr;
+    TVMArrayAlloc(in_shape.data(), static_cast<int>(in_shape.size()), kDLFloat, 32, 1, kDeviceType, 0, &x);
+    TVMArrayAlloc(out_shape.data(), static_cast<int>(out_shape.size()), kDLFloat, 32, 1, kDeviceType, 0, &y);
+
+    tvm::runtime::PackedFunc set_input = model.mod.GetFunction("set_input");
+    tvm::runtime::PackedFunc run = model.mod.GetFunction("run");
+    tvm::runtime::PackedFunc get_output = model.mod.GetFunction("get_output");
+
+    AsyncResult result;
+    result.mode = "sync";
+    result.depth = 1;
+    result.buffers = 1;
+
+    std::vector<float> output(out_size);
+    std::vector<double> samples;
+    auto start = Clock::now();
+    for (int i = -opts.warmup; i < opts.requests; i++)
+    {
+        if (i == 0)
+        {
+            start = Clock::now();
+        }
+
+        auto tic = Clock::now();
+        TVMArrayCopyFromBytes(x, const_cast<float*>(input.data()), input.size() * sizeof(float));
+        set_input("data", x);
+        run();
+        get_output(0, y);
+        TVMArrayCopyToBytes(y, output.data(), out_size * sizeof(float));
+        const int top1 = top_k(output.data(), static_cast<int>(out_size), 5, opts.softmax).top1();
+        auto toc = Clock::now();
+
+        if (i >= 0)
+        {
+            samples.push_back(Duration(toc - tic).count());
+            result.top1_errors += (opts.expected >= 0 && top1 != opts.expected) ? 1 : 0;
+        }
+    }
+    const double wall = Duration(Clock::now() - start).count();
+
+    TVMArrayFree(x);
+    TVMArrayFree(y);
+
+    result.throughput = (wall > 0.0) ? (samples.size() / wall) : 0.0;
+    result.latency = LatencyStats::compute(samples);
+    return result;
+}
+
+static AsyncResult run_async(GraphModel& model, const AsyncBenchOptions& opts, const std::vector<float>& input, int depth)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    AsyncRunnerOptions runner_opts;
+    runner_opts.buffers = opts.buffers;
+    runner_opts.max_in_flight = depth;
+    AsyncRunner runner(model.mod, model.info, kDeviceType, 0, runner_opts);
+
+    AsyncResult result;
+    result.mode = "async";
+    result.depth = depth;
+    result.buffers = opts.buffers;
+
+    // Callbacks all run on the read thread, one at a time
+    std::vector<double> samples;
+    std::size_t failed = 0;
+    auto submit = [&](bool timed) {
+        const auto tic = Clock::now();
+        runner.Submit(input.data(), [&, tic, timed](AsyncRunner::Output output, std::exception_ptr error) {
+            if (error)
+            {
+                failed++;
+                return;
+            }
+            const int top1 = top_k(output.data(), static_cast<int>(output.size()), 5, opts.softmax).top1();
+            if (timed)
+            {
+                samples.push_back(Duration(Clock::now() - tic).count());
+                result.top1_errors += (opts.expected >= 0 && top1 != opts.expected) ? 1 : 0;
+            }
+        });
+    };
+
+    for (int i = 0; i < opts.warmup; i++)
+    {
+        submit(false);
+    }
+    runner.Drain();
+
+    auto start = Clock::now();
+    for (int i = 0; i < opts.requests; i++)
+    {
+        submit(true);
+    }
+    runner.Drain();
+    const double wall = Duration(Clock::now() - start).count();
+
+    CHECK_EQ(failed, 0u) << "async requests failed";
+    result.throughput = (wall > 0.0) ? (samples.size() / wall) : 0.0;
+    result.latency = LatencyStats::compute(samples);
+    return result;
+}
+
+int main(int argc, char** argv) try
+{
+    AsyncBenchOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, opts.params, kDeviceType, 0);
+
+    std::vector<float> input(element_count(model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)]));
+    read_input_file(opts.input, input);
+
+    std::cout << std::setw(7) << "mode"
+              << std::setw(7) << "depth"
+              << std::setw(9) << "buffers"
+              << std::setw(12) << "req/s"
+              << std::setw(10) << "speedup"
+              << std::setw(10) << "p50_ms"
+              << std::setw(10) << "p99_ms" << std::endl;
+
+    std::vector<AsyncResult> results{ run_sync(model, opts, input) };
+    for (auto depth : opts.depths)
+    {
+        results.push_back(run_async(model, opts, input, depth));
+    }
+
+    const double base = results.front().throughput;
+    for (auto& r : results)
+    {
+        r.speedup = (base > 0.0) ? (r.throughput / base) : 0.0;
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(7) << r.mode
+                  << std::setw(7) << r.depth
+                  << std::setw(9) << r.buffers
+                  << std::setw(12) << r.throughput
+                  << std::setw(10) << r.speedup
+                  << std::setw(10) << r.latency.p50
+                  << std::setw(10) << r.latency.p99 << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("lib", opts.lib);
+        writer.WriteObjectKeyValue("device_type", kDeviceType);
+        writer.WriteObjectKeyValue("requests", opts.requests);
+        writer.WriteObjectKeyValue("results", results);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    for (const auto& r : results)
+    {
+        if (r.top1_errors)
+        {
+            std::cerr << "unexpected top-1 results" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
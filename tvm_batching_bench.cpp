@@ -0,0 +1,312 @@
+// Serve single image requests from concurrent clients through DynamicBatcher
+// (Batcher.h) and report throughput and latency percentiles for a sweep of
+// max batch size / max wait settings.  The graph must be compiled for the
+// largest batch size, e.g. from_mxnet.py --batch 8.
+
+#include "Batcher.h"
+#include "Benchmark.h"
+#include "BenchmarkArgs.h"
+#include "Device.h"
+#include "ModelLoader.h"
+#include "Postprocess.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BatchingBenchOptions
+{
+    std::string lib;
+    std::string graph{ "from_mxnet_b8.json" };
+    std::string params{ "from_mxnet_b8.params" };
+    std::string input{ "cat.bin" };
+    int clients{ 8 };
+    int requests{ 100 }; // per client
+    int warmup{ 2 };     // per client
+    int threads{ 0 };
+    int expected{ 282 }; // expected top-1, -1 : no check
+    std::vector<int> max_batch{ 1, 2, 4, 8 };
+    std::vector<int> max_wait_us{ 0, 500, 2000 };
+    std::string json;
+};
+
+struct BatchingResult
+{
+    int max_batch{ 0 };
+    int max_wait_us{ 0 };
+    double wall_s{ 0.0 };
+    double throughput{ 0.0 }; // requests per second over the wall time
+    double mean_batch{ 0.0 };
+    std::size_t top1_errors{ 0 };
+    LatencyStats latency; // per request, submit to result
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("max_batch", max_batch);
+        writer->WriteObjectKeyValue("max_wait_us", max_wait_us);
+        writer->WriteObjectKeyValue("wall_s", wall_s);
+        writer->WriteObjectKeyValue("throughput", throughput);
+        writer->WriteObjectKeyValue("mean_batch", mean_batch);
+        writer->WriteObjectKeyValue("top1_errors", top1_errors);
+        writer->WriteObjectKeyValue("latency", latency);
+        writer->EndObject();
+    }
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_batching_bench /full/path/to/from_mxnet_b8.so [options]\n"
+              << "  --graph FILE        graph compiled for the largest batch (default from_mxnet_b8.json)\n"
+              << "  --params FILE       parameters (default from_mxnet_b8.params)\n"
+              << "  --input FILE        one input sample (default cat.bin)\n"
+              << "  --clients N         concurrent closed loop clients (default 8)\n"
+              << "  --requests N        timed requests per client (default 100)\n"
+              << "  --warmup N          untimed requests per client (default 2)\n"
+              << "  --threads N         TVM thread pool size (default: runtime choice)\n"
+              << "  --max-batch LIST    comma separated max batch sizes (default 1,2,4,8)\n"
+              << "  --max-wait-us LIST  comma separated max wait times in us (default 0,500,2000)\n"
+              << "  --expect N          expected top-1 class, -1 to disable the check (default 282)\n"
+              << "  --json FILE         write the sweep as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, BatchingBenchOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.lib = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--graph")
+        {
+            opts.graph = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--clients")
+        {
+            opts.clients = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--requests")
+        {
+            opts.requests = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--warmup")
+        {
+            opts.warmup = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--threads")
+        {
+            opts.threads = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--max-batch")
+        {
+            opts.max_batch = parse_list(value, 0);
+        }
+        else if (arg == "--max-wait-us")
+        {
+            opts.max_wait_us = parse_list(value, 0);
+        }
+        else if (arg == "--expect")
+        {
+            opts.expected = std::atoi(value);
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return !opts.max_batch.empty() && !opts.max_wait_us.empty();
+}
+
+static BatchingResult run_setting(GraphModel& model, const BatchingBenchOptions& opts, const std::vector<float>& sample, int max_batch, int max_wait_us)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    BatchingOptions batching;
+    batching.max_batch = max_batch;
+    batching.max_wait = std::chrono::microseconds(max_wait_us);
+    DynamicBatcher batcher(model.mod, model.info, kDeviceType, 0, batching);
+    CHECK_EQ(sample.size(), batcher.sample_size()) << "input size does not match the graph input";
+
+    // Per client results, merged after the join
+    std::vector<std::vector<double>> latencies(opts.clients);
+    std::vector<std::size_t> errors(opts.clients, 0);
+    std::vector<std::size_t> batch_sizes(opts.clients, 0);
+
+    auto client = [&](int c) {
+        latencies[c].reserve(opts.requests);
+        for (int i = 0; i < opts.warmup + opts.requests; i++)
+        {
+            auto tic = Clock::now();
+            DynamicBatcher::Result result = batcher.Submit(sample.data()).get();
+            auto toc = Clock::now();
+            if (i < opts.warmup)
+            {
+                continue;
+            }
+
+            latencies[c].push_back(Duration(toc - tic).count());
+            batch_sizes[c] += result.batch_size;
+            const int top1 = top_k(result.output.data(), static_cast<int>(result.output.size()), 1).top1();
+            if (opts.expected >= 0 && top1 != opts.expected)
+            {
+                errors[c]++;
+            }
+        }
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < opts.clients; c++)
+    {
+        clients.emplace_back(client, c);
+    }
+    for (auto& t : clients)
+    {
+        t.join();
+    }
+    auto stop = Clock::now();
+
+    BatchingResult result;
+    result.max_batch = batcher.max_batch();
+    result.max_wait_us = max_wait_us;
+
+    std::vector<double> samples;
+    std::size_t batched = 0;
+    for (int c = 0; c < opts.clients; c++)
+    {
+        samples.insert(samples.end(), latencies[c].begin(), latencies[c].end());
+        batched += batch_sizes[c];
+        result.top1_errors += errors[c];
+    }
+
+    // Wall time covers the warmup requests too, so they are counted here
+    const double total = static_cast<double>(opts.clients) * (opts.warmup + opts.requests);
+    result.wall_s = Duration(stop - start).count();
+    result.throughput = (result.wall_s > 0.0) ? (total / result.wall_s) : 0.0;
+    result.mean_batch = samples.empty() ? 0.0 : static_cast<double>(batched) / samples.size();
+    result.latency = LatencyStats::compute(samples);
+    return result;
+}
+
+int main(int argc, char** argv) try
+{
+    BatchingBenchOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    // The TVM thread pool reads TVM_NUM_THREADS once, on first use
+    if (opts.threads > 0)
+    {
+        setenv("TVM_NUM_THREADS", std::to_string(opts.threads).c_str(), 1);
+    }
+
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, opts.params, kDeviceType, 0);
+
+    const auto& in = model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)];
+    std::vector<float> sample(element_count(in) / in.front());
+    read_input_file(opts.input, sample);
+
+    std::cout << "graph batch: " << in.front() << ", clients: " << opts.clients << ", requests/client: " << opts.requests << std::endl;
+    std::cout << std::setw(10) << "max_batch"
+              << std::setw(12) << "max_wait_us"
+              << std::setw(12) << "mean_batch"
+              << std::setw(12) << "req/s"
+              << std::setw(10) << "p50_ms"
+              << std::setw(10) << "p90_ms"
+              << std::setw(10) << "p99_ms"
+              << std::setw(10) << "max_ms"
+              << std::setw(8) << "errors" << std::endl;
+
+    std::vector<BatchingResult> results;
+    for (auto max_batch : opts.max_batch)
+    {
+        for (auto max_wait_us : opts.max_wait_us)
+        {
+            auto r = run_setting(model, opts, sample, max_batch, max_wait_us);
+            std::cout << std::fixed << std::setprecision(2)
+                      << std::setw(10) << r.max_batch
+                      << std::setw(12) << r.max_wait_us
+                      << std::setw(12) << r.mean_batch
+                      << std::setw(12) << r.throughput
+                      << std::setw(10) << r.latency.p50
+                      << std::setw(10) << r.latency.p90
+                      << std::setw(10) << r.latency.p99
+                      << std::setw(10) << r.latency.max
+                      << std::setw(8) << r.top1_errors << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+            results.push_back(r);
+        }
+    }
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("lib", opts.lib);
+        writer.WriteObjectKeyValue("device_type", kDeviceType);
+        writer.WriteObjectKeyValue("graph_batch", static_cast<int>(in.front()));
+        writer.WriteObjectKeyValue("clients", opts.clients);
+        writer.WriteObjectKeyValue("requests", opts.requests);
+        writer.WriteObjectKeyValue("results", results);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    for (const auto& r : results)
+    {
+        if (r.top1_errors)
+        {
+            std::cerr << "unexpected top-1 results" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
@@ -0,0 +1,326 @@
+// Static cost model of a compiled graph (CostModel.h): FLOPs, compulsory
+// memory traffic and arithmetic intensity per fused op.  With the compiled
+// library every op node is also timed (debug runtime, Profiler.h) and placed
+// on the roofline of the measured machine peak: achieved GFLOP/s and GB/s,
+// memory or compute bound, and the fraction of the attainable performance.
+
+#include "BenchmarkArgs.h"
+#include "CostModel.h"
+#include "Device.h"
+#include "ModelLoader.h"
+#include "Profiler.h"
+#include "ThreadConfig.h"
+
+#include <dlpack/dlpack.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CostModelOptions
+{
+    std::string graph;
+    std::string lib; // empty : static report only
+    std::string params{ "from_mxnet.params" };
+    std::string input{ "cat.bin" };
+    int runs{ 10 };
+    int threads{ 0 }; // 0 : all cores
+    MachinePeak peak; // 0 : measured
+    std::size_t limit{ 0 };
+    std::string json;
+};
+
+struct NodeReport
+{
+    OpCost cost;
+    double ms{ 0.0 };         // measured mean, 0 without --lib
+    double gflops{ 0.0 };     // achieved
+    double gbs{ 0.0 };        // achieved, compulsory traffic
+    double attainable{ 0.0 }; // roofline GFLOP/s at this intensity
+    double efficiency{ 0.0 }; // achieved / attainable (bandwidth for copies)
+    bool memory_bound{ false };
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("node_id", cost.node_id);
+        writer->WriteObjectKeyValue("name", cost.name);
+        writer->WriteObjectKeyValue("func_name", cost.func_name);
+        writer->WriteObjectKeyValue("kind", std::string(op_kind_name(cost.kind)));
+        writer->WriteObjectKeyValue("flops", cost.flops);
+        writer->WriteObjectKeyValue("bytes", cost.bytes);
+        writer->WriteObjectKeyValue("intensity", cost.intensity());
+        writer->WriteObjectKeyValue("mean_ms", ms);
+        writer->WriteObjectKeyValue("gflops", gflops);
+        writer->WriteObjectKeyValue("gbs", gbs);
+        writer->WriteObjectKeyValue("attainable_gflops", attainable);
+        writer->WriteObjectKeyValue("efficiency", efficiency);
+        writer->WriteObjectKeyValue("bound", std::string(memory_bound ? "memory" : "compute"));
+        writer->EndObject();
+    }
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_cost_model from_mxnet.json [options]\n"
+              << "  --lib LIB          time every op node with LIB (from_mxnet.so), otherwise static report only\n"
+              << "  --params FILE      parameters (default from_mxnet.params)\n"
+              << "  --input FILE       input sample (default cat.bin)\n"
+              << "  --runs N           timed runs per node (default 10)\n"
+              << "  --threads N        TVM threads and threads of the peak measurement (default all cores)\n"
+              << "  --peak-gflops X    machine peak GFLOP/s instead of the measured one\n"
+              << "  --peak-gbs X       machine peak GB/s instead of the measured one\n"
+              << "  --limit N          print the N most expensive nodes (default all)\n"
+              << "  --json FILE        write the report as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, CostModelOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.graph = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--lib")
+        {
+            opts.lib = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--runs")
+        {
+            opts.runs = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--threads")
+        {
+            opts.threads = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--peak-gflops")
+        {
+            opts.peak.gflops = std::max(std::atof(value), 0.0);
+        }
+        else if (arg == "--peak-gbs")
+        {
+            opts.peak.gbs = std::max(std::atof(value), 0.0);
+        }
+        else if (arg == "--limit")
+        {
+            opts.limit = static_cast<std::size_t>(std::max(std::atoi(value), 0));
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Mean time of every op node in ms, by node id
+static std::map<uint32_t, double> time_nodes(const CostModelOptions& opts, const GraphRuntimePrivateStuff& info)
+{
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, opts.params, kDeviceType, 0);
+
+    const auto& in_shape = info.attrs_.shape[info.entry_id(info.input_nodes_.front(), 0)];
+    std::vector<float> input(element_count(in_shape));
+    read_input_file(opts.input, input);
+
+    tvm::runtime::NDArray x = tvm::runtime::NDArray::Empty(in_shape, DLDataType{ kDLFloat, 32, 1 }, DLContext{ static_cast<DLDeviceType>(kDeviceType), 0 });
+    TVMArrayCopyFromBytes(const_cast<DLTensor*>(x.operator->()), input.data(), input.size() * sizeof(float));
+    model.mod.GetFunction("set_input")("data", x);
+    model.mod.GetFunction("run")(); // warm up
+
+    OpProfiler profiler(model.info);
+    profiler.Run(model.mod, opts.runs);
+
+    std::map<uint32_t, double> times;
+    for (const auto& entry : profiler.nodes())
+    {
+        times[entry.node_id] = entry.stats.mean;
+    }
+    return times;
+}
+
+int main(int argc, char** argv) try
+{
+    CostModelOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    const int threads = (opts.threads > 0) ? opts.threads : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    ThreadingOptions threading;
+    threading.threads = threads;
+    apply_threading(threading);
+
+    GraphRuntimePrivateStuff info;
+    load_graph_info(opts.graph, info);
+
+    std::vector<NodeReport> nodes;
+    for (const auto& cost : estimate_costs(info))
+    {
+        NodeReport node;
+        node.cost = cost;
+        nodes.push_back(node);
+    }
+
+    const bool measured = !opts.lib.empty();
+    MachinePeak peak = opts.peak;
+    if (measured)
+    {
+        const auto times = time_nodes(opts, info);
+        if (peak.gflops == 0.0 || peak.gbs == 0.0)
+        {
+            const MachinePeak m = measure_machine_peak(threads);
+            peak.gflops = (peak.gflops > 0.0) ? peak.gflops : m.gflops;
+            peak.gbs = (peak.gbs > 0.0) ? peak.gbs : m.gbs;
+        }
+
+        for (auto& node : nodes)
+        {
+            auto it = times.find(node.cost.node_id);
+            node.ms = (it != times.end()) ? it->second : 0.0;
+            const double seconds = node.ms * 1e-3;
+            node.gflops = (seconds > 0.0) ? (node.cost.flops / seconds * 1e-9) : 0.0;
+            node.gbs = (seconds > 0.0) ? (node.cost.bytes / seconds * 1e-9) : 0.0;
+            node.attainable = peak.attainable(node.cost.intensity());
+            node.memory_bound = node.cost.intensity() < peak.ridge();
+            if (node.cost.flops > 0.0)
+            {
+                node.efficiency = (node.attainable > 0.0) ? (node.gflops / node.attainable) : 0.0;
+            }
+            else
+            {
+                node.efficiency = (peak.gbs > 0.0) ? (node.gbs / peak.gbs) : 0.0;
+                node.memory_bound = true;
+            }
+        }
+    }
+
+    std::sort(nodes.begin(), nodes.end(), [measured](const NodeReport& a, const NodeReport& b) {
+        return measured ? (a.ms > b.ms) : (a.cost.flops > b.cost.flops);
+    });
+
+    if (measured)
+    {
+        std::cout << "machine peak (" << threads << " threads): " << peak.gflops << " GFLOP/s, " << peak.gbs
+                  << " GB/s, ridge point " << peak.ridge() << " flop/byte" << std::endl;
+    }
+
+    std::cout << std::setw(6) << "node"
+              << std::setw(10) << "kind"
+              << std::setw(11) << "MFLOP"
+              << std::setw(10) << "MB"
+              << std::setw(9) << "flop/B";
+    if (measured)
+    {
+        std::cout << std::setw(10) << "ms"
+                  << std::setw(10) << "GFLOP/s"
+                  << std::setw(8) << "GB/s"
+                  << std::setw(9) << "bound"
+                  << std::setw(8) << "%roof";
+    }
+    std::cout << "  name" << std::endl;
+
+    const std::size_t n = (opts.limit > 0) ? std::min(opts.limit, nodes.size()) : nodes.size();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        const auto& node = nodes[i];
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(6) << node.cost.node_id
+                  << std::setw(10) << op_kind_name(node.cost.kind)
+                  << std::setw(11) << node.cost.flops * 1e-6
+                  << std::setw(10) << node.cost.bytes * 1e-6
+                  << std::setw(9) << node.cost.intensity();
+        if (measured)
+        {
+            std::cout << std::setprecision(4) << std::setw(10) << node.ms
+                      << std::setprecision(2) << std::setw(10) << node.gflops
+                      << std::setw(8) << node.gbs
+                      << std::setw(9) << (node.memory_bound ? "memory" : "compute")
+                      << std::setw(8) << 100.0 * node.efficiency;
+        }
+        std::cout << "  " << node.cost.name << std::endl;
+    }
+    std::cout.unsetf(std::ios::floatfield);
+
+    double flops = 0.0, bytes = 0.0, ms = 0.0, memory_ms = 0.0;
+    for (const auto& node : nodes)
+    {
+        flops += node.cost.flops;
+        bytes += node.cost.bytes;
+        ms += node.ms;
+        memory_ms += node.memory_bound ? node.ms : 0.0;
+    }
+    std::cout << "total: " << flops * 1e-9 << " GFLOP, " << bytes * 1e-6 << " MB";
+    if (measured && ms > 0.0)
+    {
+        std::cout << ", " << ms << " ms, " << flops / (ms * 1e-3) * 1e-9 << " GFLOP/s, "
+                  << 100.0 * memory_ms / ms << " % of the time in memory bound nodes";
+    }
+    std::cout << std::endl;
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("graph", opts.graph);
+        writer.WriteObjectKeyValue("threads", threads);
+        if (measured)
+        {
+            writer.WriteObjectKeyValue("peak", peak);
+        }
+        writer.WriteObjectKeyValue("total_flops", flops);
+        writer.WriteObjectKeyValue("total_bytes", bytes);
+        writer.WriteObjectKeyValue("total_ms", ms);
+        writer.WriteObjectKeyValue("nodes", nodes);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
@@ -0,0 +1,276 @@
+// Inter-op parallelism: analyses the operator DAG of a graph (ExecutionDag.h)
+// and times run() of the stock sequential executor against the work
+// stealing DagExecutor (DagExecutor.h, set_inter_op in graph_runtime_ext.cc)
+// for a list of worker counts, checking that every parallel run produces
+// the sequential output.  Graphs with parallel branches (inception style,
+// multi-head) gain most, at small batch sizes where the intra-op
+// parallelism of single operators runs out.
+
+#include "Benchmark.h"
+#include "BenchmarkArgs.h"
+#include "Device.h"
+#include "ExecutionDag.h"
+#include "ModelLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct DagBenchOptions
+{
+    std::string lib;
+    std::string graph{ "from_mxnet.json" };
+    std::string params{ "from_mxnet.params" };
+    std::string input{ "cat.bin" };
+    std::vector<int> workers{ 1, 2, 4 };
+    int threads{ 1 };     // TVM threads per worker
+    int seq_threads{ 0 }; // TVM threads of the sequential run, 0 : all cores
+    int iterations{ 100 };
+    int warmup{ 5 };
+    double atol{ 1e-5 }; // largest output difference to the sequential run
+    std::string json;
+};
+
+struct DagResult
+{
+    int workers{ 0 }; // 0 : sequential
+    int threads_per_worker{ 0 };
+    double speedup{ 0.0 };
+    double max_abs_diff{ 0.0 };
+    LatencyStats latency;
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("workers", workers);
+        writer->WriteObjectKeyValue("threads_per_worker", threads_per_worker);
+        writer->WriteObjectKeyValue("speedup", speedup);
+        writer->WriteObjectKeyValue("max_abs_diff", max_abs_diff);
+        writer->WriteObjectKeyValue("latency", latency);
+        writer->EndObject();
+    }
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_dag_bench /full/path/to/from_mxnet.so [options]\n"
+              << "  --graph FILE       graph JSON or binary graph (default from_mxnet.json)\n"
+              << "  --params FILE      parameters (default from_mxnet.params)\n"
+              << "  --input FILE       one input sample (default cat.bin)\n"
+              << "  --workers LIST     comma separated inter-op worker counts (default 1,2,4)\n"
+              << "  --threads N        TVM threads per worker (default 1)\n"
+              << "  --seq-threads N    TVM threads of the sequential run (default: all cores)\n"
+              << "  --iterations N     timed runs per setting (default 100)\n"
+              << "  --warmup N         untimed runs per setting (default 5)\n"
+              << "  --atol X           largest output difference to the sequential run (default 1e-5)\n"
+              << "  --json FILE        write the DAG and the timings as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, DagBenchOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.lib = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--graph")
+        {
+            opts.graph = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--workers")
+        {
+            opts.workers = parse_list(value);
+        }
+        else if (arg == "--threads")
+        {
+            opts.threads = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--seq-threads")
+        {
+            opts.seq_threads = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--iterations")
+        {
+            opts.iterations = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--warmup")
+        {
+            opts.warmup = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--atol")
+        {
+            opts.atol = std::atof(value);
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Time run() of the current executor, output 0 of the last run into output
+static LatencyStats time_runs(GraphModel& model, const DagBenchOptions& opts, std::vector<float>& output)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    tvm::runtime::PackedFunc run = model.mod.GetFunction("run");
+    std::vector<double> samples;
+    for (int i = -opts.warmup; i < opts.iterations; i++)
+    {
+        auto tic = Clock::now();
+        run();
+        auto toc = Clock::now();
+        if (i >= 0)
+        {
+            samples.push_back(Duration(toc - tic).count());
+        }
+    }
+
+    tvm::runtime::NDArray y = model.mod.GetFunction("get_output")(0);
+    output.resize(element_count(std::vector<int64_t>(y->shape, y->shape + y->ndim)));
+    TVMArrayCopyToBytes(const_cast<DLTensor*>(y.operator->()), output.data(), output.size() * sizeof(float));
+    return LatencyStats::compute(samples);
+}
+
+int main(int argc, char** argv) try
+{
+    DagBenchOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    // The main thread's TVM thread pool is sized on its first run
+    const int all_cores = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    setenv("TVM_NUM_THREADS", std::to_string(opts.seq_threads ? opts.seq_threads : all_cores).c_str(), 1);
+
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, opts.params, kDeviceType, 0);
+
+    const ExecutionDag dag = build_execution_dag(model.info);
+    std::cout << "dag: " << dag.ops.size() << " ops, " << dag.edges << " edges, " << dag.roots.size() << " roots"
+              << ", critical path " << dag.critical_path << ", width " << dag.width
+              << ", parallelism " << dag.parallelism() << std::endl;
+
+    std::vector<float> input(element_count(model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)]));
+    read_input_file(opts.input, input);
+
+    DLTensor* x = nullptr;
+    const auto& in_shape = model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)];
+    TVMArrayAlloc(in_shape.data(), static_cast<int>(in_shape.size()), kDLFloat, 32, 1, kDeviceType, 0, &x);
+    TVMArrayCopyFromBytes(x, input.data(), input.size() * sizeof(float));
+    model.mod.GetFunction("set_input")("data", x);
+    TVMArrayFree(x);
+
+    tvm::runtime::PackedFunc set_inter_op = model.mod.GetFunction("set_inter_op");
+    CHECK(set_inter_op != nullptr) << "set_inter_op requires a runtime created by graph_runtime_ext.cc";
+
+    std::cout << std::setw(9) << "workers"
+              << std::setw(9) << "threads"
+              << std::setw(10) << "mean_ms"
+              << std::setw(10) << "p50_ms"
+              << std::setw(10) << "p99_ms"
+              << std::setw(10) << "speedup"
+              << std::setw(14) << "max_abs_diff" << std::endl;
+
+    std::vector<float> reference, output;
+    std::vector<DagResult> results;
+    for (int k = -1; k < static_cast<int>(opts.workers.size()); k++)
+    {
+        DagResult r;
+        r.workers = (k < 0) ? 0 : opts.workers[k];
+        r.threads_per_worker = (k < 0) ? (opts.seq_threads ? opts.seq_threads : all_cores) : opts.threads;
+        set_inter_op(r.workers, r.threads_per_worker);
+
+        r.latency = time_runs(model, opts, (k < 0) ? reference : output);
+        if (k >= 0)
+        {
+            for (std::size_t i = 0; i < reference.size(); i++)
+            {
+                r.max_abs_diff = std::max(r.max_abs_diff, static_cast<double>(std::fabs(output[i] - reference[i])));
+            }
+        }
+        r.speedup = (r.latency.mean > 0.0 && !results.empty()) ? (results.front().latency.mean / r.latency.mean) : 1.0;
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << std::setw(9) << r.workers
+                  << std::setw(9) << r.threads_per_worker
+                  << std::setw(10) << r.latency.mean
+                  << std::setw(10) << r.latency.p50
+                  << std::setw(10) << r.latency.p99
+                  << std::setw(10) << r.speedup;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setw(14) << r.max_abs_diff << std::endl;
+        results.push_back(r);
+    }
+    set_inter_op(0);
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("lib", opts.lib);
+        writer.WriteObjectKeyValue("device_type", kDeviceType);
+        writer.WriteObjectKeyValue("dag", dag);
+        writer.WriteObjectKeyValue("results", results);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    for (const auto& r : results)
+    {
+        if (r.max_abs_diff > opts.atol)
+        {
+            std::cerr << "parallel output differs from the sequential run" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
@@ -1,172 +1,505 @@
-#define TCT_SAVE_LAYERS 1
-#define TCT_TEST_DEBUG_GET_OUTPUT 0
-
 #include <string>
 #include <cstring>
 #include <fstream>
 #include <algorithm>
 #include <chrono>
 #include <iomanip>
+#include <memory>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
 
 #include <dlpack/dlpack.h>
 #include <tvm/runtime/module.h>
 #include <tvm/runtime/registry.h>
 #include <tvm/runtime/packed_func.h>
 
-#if TCT_SAVE_LAYERS
-
+#include "Benchmark.h"
+#include "Device.h"
+#include "GraphBinary.h"
 #include "GraphRuntime.h"
+#include "HostTensor.h"
+#include "ImageSource.h"
+#include "LayerCapture.h"
+#include "MemoryReport.h"
+#include "MemoryUsage.h"
+#include "ModelLoader.h"
+#include "Postprocess.h"
+#include "Preprocess.h"
+#include "Profiler.h"
+#include "ThreadConfig.h"
+
+struct SampleOptions
+{
+    std::string lib;
+    int iterations{ 1 };
+    int warmup{ 0 };
+    ThreadingOptions threading; // threads 0 : leave the TVM default (TVM_NUM_THREADS or #cores)
+    int thread_sweep{ 0 };      // benchmark 1..N threads, 0 : disabled
+    std::string json;
+    int profile{ 0 }; // number of per-op profiling runs, 0 : disabled
+    std::string profile_json;
+    std::string graph{ "from_mxnet.json" }; // graph JSON or binary graph (GraphBinary.h)
+    std::string params{ "from_mxnet.params" }; // TVM or compact (CompactParams.h) parameters
+    std::string save_graph;
+    int graph_bench{ 0 }; // number of JSON vs binary graph load comparisons, 0 : disabled
+    std::string images; // image file, directory or "-" (PPM stream on stdin), empty : cat.bin
+    ResizeMode resize{ ResizeMode::Nearest };
+    int raw_width{ 224 };
+    int raw_height{ 224 };
+    int top_k{ 5 };
+    int softmax{ 0 };       // apply softmax in post-processing (the graph already ends in one)
+    int print_scores{ 0 };  // debug: print every output score
+    int zero_copy{ 0 };     // bind caller owned input / output buffers (HostTensor.h)
+    int memory{ 0 };        // storage pool, workspace and RSS report (MemoryReport.h)
+    int plan{ 0 };          // precompiled execution plan (set_plan in graph_runtime_ext.cc)
+    LayerCaptureOptions capture; // layer dumps (LayerCapture.h), default: all layers of the final run
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_deploy_gpu_sample /full/path/to/from_mxnet.so|system [options]\n"
+              << "  (system: the model linked into the executable, CMake option TCT_SYSTEM_LIB)\n"
+              << "  --iterations N  timed iterations (default 1)\n"
+              << "  --warmup N      untimed warmup iterations (default 0)\n"
+              << "  --threads N     TVM thread pool size (default: runtime choice)\n"
+              << "  --cpus LIST     run the TVM threads on these cores only, e.g. 0-3,6\n"
+              << "  --cores KIND    all (default), big or little cores (by cpuinfo_max_freq)\n"
+              << "  --thread-sweep N     benchmark 1..N threads, speedup and parallel efficiency\n"
+              << "  --json FILE     write latency statistics as JSON\n"
+              << "  --profile N     time every op node over N runs (debug runtime)\n"
+              << "  --profile-json FILE  write the per-op profile as JSON\n"
+              << "  --graph FILE    graph JSON or precompiled binary graph (default from_mxnet.json)\n"
+              << "  --params FILE   parameters, TVM or compact fp16/bf16/int8 format (default from_mxnet.params)\n"
+              << "  --save-graph FILE    write the parsed graph in the binary format\n"
+              << "  --graph-bench N compare N JSON and binary graph loads (from_mxnet.json vs from_mxnet.graph)\n"
+              << "  --images PATH   classify .ppm/.rgb/.bgr images (file, directory or - for a PPM stream on stdin)\n"
+              << "  --resize MODE   nearest (default, as PIL in from_mxnet.py) or bilinear\n"
+              << "  --raw-size WxH  size of headerless .rgb/.bgr images (default 224x224)\n"
+              << "  --top-k N       number of classes reported (default 5, max 16)\n"
+              << "  --softmax 0|1   softmax in post-processing, for graphs that output logits (default 0)\n"
+              << "  --print-scores 0|1  debug: print all output scores (default 0)\n"
+              << "  --zero-copy 0|1 bind aligned host buffers as graph input and output (default 0)\n"
+              << "  --memory 0|1    report storage pool, parameter, workspace and peak RSS per phase (default 0)\n"
+              << "  --plan 0|1      run() from a precompiled plan of the operators' entry points (default 0)\n"
+              << "  --layers SPEC   layers to capture: all (default), none or node ids, ranges and name patterns, e.g. 0-10,conv*\n"
+              << "  --capture-every N    capture every Nth request of the timed loop instead of the final run\n"
+              << "  --capture-sample P   capture a random fraction P of the requests instead of the final run\n"
+              << "  --capture-buffers N  captures in flight, requests finding none free are not captured (default 2)\n"
+              << "  --capture-prefix P   layer dump file prefix (default tvm_layers: tvm_layers.bin, tvm_layers_<request>.bin)\n"
+              << "  --fingerprint 0|1    per layer statistics and hashes (.fp files) instead of full dumps (default 0)\n"
+              << "  --fingerprint-quantum Q  hash bucket width, values within Q hash alike (default 1e-4)" << std::endl;
+}
 
-#endif // TCT_SAVE_LAYERS
-
-// Iterator for N dimensional array
-inline void iterate(int dimensions, int64_t* ordinates, int64_t* maximums)
+static bool parse_options(int argc, char** argv, SampleOptions& opts)
 {
-    for (int d = dimensions - 1; d >= 0; d--)
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.lib = argv[1];
+    for (int i = 2; i < argc; i++)
     {
-        if ((ordinates[d]+1) < maximums[d])
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
         {
-            ordinates[d]++;
-            break;
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
         }
 
-        ordinates[d] = 0;
+        const char* value = argv[++i];
+        if (arg == "--iterations")
+        {
+            opts.iterations = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--warmup")
+        {
+            opts.warmup = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--threads")
+        {
+            opts.threading.threads = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--cpus")
+        {
+            opts.threading.cpus = parse_cpu_list(value);
+        }
+        else if (arg == "--cores")
+        {
+            if (!parse_core_preference(value, opts.threading.cores))
+            {
+                std::cerr << "unknown core kind " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--thread-sweep")
+        {
+            opts.thread_sweep = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else if (arg == "--profile")
+        {
+            opts.profile = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--profile-json")
+        {
+            opts.profile_json = value;
+        }
+        else if (arg == "--graph")
+        {
+            opts.graph = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--save-graph")
+        {
+            opts.save_graph = value;
+        }
+        else if (arg == "--graph-bench")
+        {
+            opts.graph_bench = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--top-k")
+        {
+            // A copy: std::min takes references, which would need a definition of kMaxK
+            const int max_k = Classification::kMaxK;
+            opts.top_k = std::min(std::max(std::atoi(value), 1), max_k);
+        }
+        else if (arg == "--softmax")
+        {
+            opts.softmax = std::atoi(value);
+        }
+        else if (arg == "--print-scores")
+        {
+            opts.print_scores = std::atoi(value);
+        }
+        else if (arg == "--zero-copy")
+        {
+            opts.zero_copy = std::atoi(value);
+        }
+        else if (arg == "--memory")
+        {
+            opts.memory = std::atoi(value);
+        }
+        else if (arg == "--plan")
+        {
+            opts.plan = std::atoi(value);
+        }
+        else if (arg == "--layers")
+        {
+            opts.capture.layers = value;
+        }
+        else if (arg == "--capture-every")
+        {
+            opts.capture.every = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--capture-sample")
+        {
+            opts.capture.sample = std::min(std::max(std::atof(value), 0.0), 1.0);
+        }
+        else if (arg == "--capture-buffers")
+        {
+            opts.capture.buffers = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--capture-prefix")
+        {
+            opts.capture.prefix = value;
+        }
+        else if (arg == "--fingerprint")
+        {
+            opts.capture.fingerprint = std::atoi(value) != 0;
+        }
+        else if (arg == "--fingerprint-quantum")
+        {
+            opts.capture.quantum = std::atof(value);
+            if (!(opts.capture.quantum > 0.0))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--images")
+        {
+            opts.images = value;
+        }
+        else if (arg == "--resize")
+        {
+            const std::string mode = value;
+            if (mode != "nearest" && mode != "bilinear")
+            {
+                std::cerr << "unknown resize mode " << mode << std::endl;
+                return false;
+            }
+            opts.resize = (mode == "bilinear") ? ResizeMode::Bilinear : ResizeMode::Nearest;
+        }
+        else if (arg == "--raw-size")
+        {
+            if (std::sscanf(value, "%dx%d", &opts.raw_width, &opts.raw_height) != 2 || opts.raw_width <= 0 || opts.raw_height <= 0)
+            {
+                std::cerr << "invalid raw size " << value << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
     }
+    return true;
 }
 
-// Print DLTensor in flat diff friendly 'value[i,j,k...] = value' format:
-void print(DLTensor *layer_output, const std::vector<float> &values, std::ofstream &ofs)
+struct SweepResult
 {
-    std::vector<int64_t> ord( layer_output->ndim , 0);
-    for (int k = 0; k < static_cast<int>(values.size()); k++)
+    int threads{ 0 };
+    double speedup{ 0.0 };    // mean latency of 1 thread / mean latency
+    double efficiency{ 0.0 }; // speedup / threads
+    LatencyStats latency;
+
+    void Save(dmlc::JSONWriter* writer) const
     {
-        std::stringstream index, shape;
-        for(int d = 0; d < ord.size(); d++)
-        {
-            index << ord[d];
-            shape << layer_output->shape[d];
-            if(d < ord.size()-1)
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("threads", threads);
+        writer->WriteObjectKeyValue("speedup", speedup);
+        writer->WriteObjectKeyValue("efficiency", efficiency);
+        writer->WriteObjectKeyValue("latency", latency);
+        writer->EndObject();
+    }
+};
+
+// Time run() with TVM pools of 1..opts.thread_sweep threads.  Every size
+// gets a new thread, and with it a new pool, on the cores chosen by
+// apply_threading (the input is already set).
+static std::vector<SweepResult> thread_sweep(const SampleOptions& opts, tvm::runtime::Module& mod, int device_type, int device_id)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    tvm::runtime::PackedFunc run = mod.GetFunction("run");
+
+    std::vector<SweepResult> results;
+    for (int threads = 1; threads <= opts.thread_sweep; threads++)
+    {
+        std::vector<double> timings;
+        run_on_new_pool(threads, [&]() {
+            for (int i = 0; i < opts.warmup + opts.iterations; ++i)
             {
-                index << ", ";
-                shape << ", ";
+                auto tic = Clock::now();
+                run();
+                TVMSynchronize(device_type, device_id, nullptr);
+                auto toc = Clock::now();
+                if (i >= opts.warmup)
+                {
+                    timings.push_back(Duration(toc - tic).count());
+                }
             }
-        }
-
-        std::stringstream ss;
-        ss  << "value"
-            << "["
-            << index.str()
-            << "] = "
-            << "{"
-            << shape.str()
-            << "} = "
-            << values[k]
-#if TUI_TEST_DEBUG_GET_OUTPUT
-            << " "
-            << values2[k]
-#endif
-          ;
-
-        ofs << ss.str() << std::endl;
+        });
+
+        SweepResult r;
+        r.threads = threads;
+        r.latency = LatencyStats::compute(timings);
+        const double base = results.empty() ? r.latency.mean : results.front().latency.mean;
+        r.speedup = (r.latency.mean > 0.0) ? (base / r.latency.mean) : 0.0;
+        r.efficiency = r.speedup / threads;
+        results.push_back(r);
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << std::setw(8) << r.threads
+                  << std::setw(12) << r.latency.mean
+                  << std::setw(12) << r.latency.p50
+                  << std::setw(12) << r.latency.p99
+                  << std::setw(10) << r.speedup
+                  << std::setw(12) << r.efficiency << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
     }
+    return results;
 }
 
-int main(int argc, char** argv) try
+// Preprocess every image of opts.images into the runtime's input entry and
+// classify it.  Preprocessing (including any host to device copy) and run()
+// are timed separately.
+static int classify_images(const SampleOptions& opts, tvm::runtime::Module& mod, DLTensor* y, int device_type, int device_id)
 {
     using Clock = std::chrono::high_resolution_clock;
-    using Timepoint = Clock::time_point;
     using Duration = std::chrono::duration<double>;
 
-    if (argc < 2)
+    // The runtime's own "data" entry: filled in place, run() needs no set_input
+    tvm::runtime::NDArray data_entry = mod.GetFunction("get_input")("data");
+    DLTensor* x = const_cast<DLTensor*>(data_entry.operator->());
+    CHECK_EQ(x->ndim, 4);
+    CHECK_EQ(x->shape[1], 3) << "3 channel input expected";
+    Preprocessor preprocess(static_cast<int>(x->shape[3]), static_cast<int>(x->shape[2]), Normalization::imagenet(), opts.resize);
+
+    // On the CPU the input tensor is host memory, so the preprocessor writes
+    // straight into it; other devices need a host staging buffer and a copy.
+    std::vector<float> staging;
+    float* input = nullptr;
+    if (device_type == kDLCPU)
     {
-        std::cerr << "usage: tvm_deploy_gpu_sample /full/path/to/from_mxnet.so " << std::endl;
-        return 1;
+        input = reinterpret_cast<float*>(static_cast<char*>(x->data) + x->byte_offset);
+    }
+    else
+    {
+        staging.resize(preprocess.size());
+        input = staging.data();
     }
 
-    std::string lib = argv[1];
-
-    const std::string json_file("from_mxnet.json");
-    const std::string param_file("from_mxnet.params");
-    tvm::runtime::Module mod_syslib = tvm::runtime::Module::LoadFromFile(lib);
+    std::vector<float> output(static_cast<std::size_t>(y->shape[0] * y->shape[1]));
 
-#if TCT_SAVE_LAYERS
-    GraphRuntimePrivateStuff info;
-#endif
+    tvm::runtime::PackedFunc run = mod.GetFunction("run");
+    tvm::runtime::PackedFunc get_output = mod.GetFunction("get_output");
 
-    std::string json_data;
+    std::vector<double> preprocess_times, run_times;
+    ImageSource source(opts.images, opts.raw_width, opts.raw_height);
+    Image image;
+    while (source.next(image))
     {
-        std::ifstream json_in(json_file.c_str(), std::ios::in);
-        if (!json_in)
+        auto tic = Clock::now();
+        preprocess.Run(image.view(), input);
+        if (!staging.empty())
         {
-            std::cerr << "Failed to read json file " << json_file << std::endl;
-            return 1;
+            TVMArrayCopyFromBytes(x, staging.data(), staging.size() * sizeof(float));
         }
+        auto mid = Clock::now();
+        run();
+        TVMSynchronize(device_type, device_id, nullptr);
+        auto toc = Clock::now();
 
-#if TCT_SAVE_LAYERS
-        dmlc::JSONReader json(&json_in);
-        info.Load(&json);
-        json_in.clear();                 // clear fail and eof bits
-        json_in.seekg(0, std::ios::beg); // back to the start
-#endif
+        preprocess_times.push_back(Duration(mid - tic).count());
+        run_times.push_back(Duration(toc - mid).count());
 
-        json_data.assign((std::istreambuf_iterator<char>(json_in)), std::istreambuf_iterator<char>());
+        get_output(0, y);
+        TVMArrayCopyToBytes(y, output.data(), output.size() * sizeof(float));
+        const Classification result = top_k(output.data(), static_cast<int>(output.size()), opts.top_k, opts.softmax != 0);
+        std::cout << image.name << " " << image.width << "x" << image.height << ": " << result << std::endl;
     }
 
-    std::string params_data;
+    if (preprocess_times.empty())
     {
-        std::ifstream params_in(param_file.c_str(), std::ios::binary);
-        if (!params_in)
-        {
-            std::cerr << "Failed to read param file " << param_file << std::endl;
-            return 1;
-        }
+        std::cerr << "No images in " << opts.images << std::endl;
+        return 1;
+    }
+
+    std::cout << "preprocess " << LatencyStats::compute(preprocess_times) << std::endl;
+    std::cout << "run " << LatencyStats::compute(run_times) << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) try
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Timepoint = Clock::time_point;
+    using Duration = std::chrono::duration<double>;
+
+    auto start = Clock::now();
+
+    SampleOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
 
-        params_data.assign((std::istreambuf_iterator<char>(params_in)), std::istreambuf_iterator<char>());
+    // The TVM thread pool reads TVM_NUM_THREADS once, on first use, so this
+    // must happen before any module is created or run (ThreadConfig.h).
+    const int threads = apply_threading(opts.threading);
+
+    // Allocation counting wraps the device APIs, before the first tensor
+    if (opts.memory && !enable_allocation_tracking())
+    {
+        std::cerr << "allocation tracking is not available, the runtime lacks graph_runtime_ext.cc" << std::endl;
     }
 
-    TVMByteArray params_arr;
-    params_arr.data = params_data.data();
-    params_arr.size = params_data.length();
+    const std::string json_file("from_mxnet.json");
+    const std::string binary_graph_file("from_mxnet.graph");
+    const std::string& param_file = opts.params;
 
     constexpr int dtype_code = kDLFloat;
     constexpr int dtype_bits = 32;
     constexpr int dtype_lanes = 1;
 
-    // If you receive an error stating "device_type
-#if defined(TVM_OPENCL_RUNTIME)
-    constexpr int device_type = kDLOpenCL;
-#elif defined(TVM_OPENGL_RUNTIME)
-    constexpr int device_type = 11; // kDLOpenGL;
-#elif defined(TVM_VULKAN_RUNTIME)
-    constexpr int device_type = kDLVulkan;
-#elif defined(TVM_METAL_RUNTIME)
-    constexpr int device_type = kDLMetal;
-#elif defined(TVM_CUDA_RUNTIME)
-    constexpr int device_type = kDLGPU;
-#elif defined(TVM_CPU_RUNTIME)
-    constexpr int device_type = kDLCPU;
-#else
-#  error Must define a valid TVM_<KIND>_RUNTIME flag, see CMakeLists.txt
-#endif
+    constexpr int device_type = kDeviceType;
 
     std::cout << "device_type " << int(device_type) << std::endl;
 
     constexpr int device_id = 0;
 
-    //const char * runtime = "tvm.graph_runtime.create";
-    const char* runtime = "tvm.graph_runtime_debug.create";
+    // Graph and parameters are memory mapped and the graph is parsed once,
+    // see ModelLoader.h.  The runtime is the (debug) graph runtime built from
+    // the parsed graph by graph_runtime_ext.cc.
+    auto load_begin = Clock::now();
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, param_file, device_type, device_id);
+
+    tvm::runtime::Module& mod = model.mod;
+    const GraphRuntimePrivateStuff& info = model.info;
 
-    tvm::runtime::Module mod = (*tvm::runtime::Registry::Get(runtime))(json_data, mod_syslib, device_type, device_id);
+    auto loaded = Clock::now();
+    const std::size_t peak_rss_load = peak_rss_bytes();
+    std::cout << "load_params: " << model.param_bytes << " bytes, load time: " << Duration(loaded - start).count()
+              << " s, peak rss: " << to_mib(peak_rss_load) << " MiB" << std::endl;
+
+    MemoryReport memory(info);
+    if (opts.memory)
+    {
+        memory.Phase("load");
+    }
+    if (model.compact.file_bytes)
+    {
+        using compact_params::Encoding;
+        const auto& c = model.compact;
+        std::cout << "compact params: " << c.file_bytes << " bytes (" << 100.0 * c.file_bytes / c.float32_bytes << " % of fp32), "
+                  << "tensors fp32 " << c.tensors[static_cast<int>(Encoding::Float32)]
+                  << " fp16 " << c.tensors[static_cast<int>(Encoding::Float16)]
+                  << " bf16 " << c.tensors[static_cast<int>(Encoding::BFloat16)]
+                  << " int8 " << c.tensors[static_cast<int>(Encoding::Int8)]
+                  << ", expand time: " << c.expand_s << " s" << std::endl;
+    }
 
-    std::cout << "load_params" << std::endl;
-    tvm::runtime::PackedFunc load_params = mod.GetFunction("load_params");
-    load_params(params_arr);
+    if (!opts.save_graph.empty())
+    {
+        if (!save_graph_binary(info, opts.save_graph))
+        {
+            std::cerr << "Failed to write binary graph " << opts.save_graph << std::endl;
+            return 1;
+        }
+        std::cout << "binary graph: " << opts.save_graph << std::endl;
+    }
+
+    if (opts.graph_bench > 0)
+    {
+        // Startup comparison of the two graph formats: map + parse only
+        if (!MappedFile(binary_graph_file) && !save_graph_binary(info, binary_graph_file))
+        {
+            std::cerr << "Failed to write binary graph " << binary_graph_file << std::endl;
+            return 1;
+        }
+
+        std::vector<double> json_times, binary_times;
+        for (int i = 0; i < opts.graph_bench; i++)
+        {
+            for (auto* path : { &json_file, &binary_graph_file })
+            {
+                GraphRuntimePrivateStuff parsed;
+                auto tic = Clock::now();
+                load_graph_info(*path, parsed);
+                auto toc = Clock::now();
+                ((path == &json_file) ? json_times : binary_times).push_back(Duration(toc - tic).count());
+            }
+        }
+
+        std::cout << "graph load " << json_file << ": " << LatencyStats::compute(json_times) << std::endl;
+        std::cout << "graph load " << binary_graph_file << ": " << LatencyStats::compute(binary_times) << std::endl;
+    }
 
     DLTensor* x = nullptr;
     DLTensor* y = nullptr;
 
-    const int n_samples = 1;
-
     // Configure input tensor for single 1x3x224x224 RGB image (floating point)
     const int in_ndim = 4;
     const int64_t in_shape[] = { 1, 3, 224, 224 };
@@ -174,7 +507,24 @@ int main(int argc, char** argv) try
     const size_t in_size = in_shape[0] * in_shape[1] * in_shape[2] * in_shape[3];
     std::vector<float> tvm_input(1 * in_size, 0);
 
-    // load image data saved in binary to tvm_input array
+    // Configure output tensor for 1x100 softmax class "probability" vector
+    const int out_ndim = 2;
+    const int64_t out_shape[] = { 1, 1000 };
+    TVMArrayAlloc(out_shape, out_ndim, dtype_code, dtype_bits, dtype_lanes, device_type, device_id, &y);
+    const size_t out_size = out_shape[0] * out_shape[1];
+    std::vector<float> tvm_output(1 * out_size, 0);
+
+    if (!opts.images.empty())
+    {
+        const int status = classify_images(opts, mod, y, device_type, device_id);
+        TVMArrayFree(x);
+        TVMArrayFree(y);
+        return status;
+    }
+
+    // load image data saved in binary to tvm_input array; input_time
+    // covers this read, the zero copy binding and the first staging
+    auto input_tic = Clock::now();
     std::ifstream data_fin("cat.bin", std::ios::binary);
     if (!data_fin)
     {
@@ -183,118 +533,295 @@ int main(int argc, char** argv) try
     }
 
     data_fin.read(reinterpret_cast<char*>(tvm_input.data()), in_size * sizeof(float));
-
-    // Configure output tensor for 1x100 softmax class "probability" vector
-    const int out_ndim = 2;
-    const int64_t out_shape[] = { 1, 1000 };
-    TVMArrayAlloc(out_shape, out_ndim, dtype_code, dtype_bits, dtype_lanes, device_type, device_id, &y);
-    const size_t out_size = out_shape[0] * out_shape[1];
-    std::vector<float> tvm_output(1 * out_size, 0);
+    double input_time = Duration(Clock::now() - input_tic).count();
 
     tvm::runtime::PackedFunc set_input = mod.GetFunction("set_input");
     tvm::runtime::PackedFunc run = mod.GetFunction("run");
     tvm::runtime::PackedFunc get_output = mod.GetFunction("get_output");
-    tvm::runtime::PackedFunc get_output_by_layer = mod.GetFunction("get_output_by_layer");
-#if TCT_TEST_DEBUG_GET_OUTPUT
-    tvm::runtime::PackedFunc debug_get_output = mod.GetFunction("debug_get_output");
-#endif
 
-    const int warmup = 10;
+    // Layer capture buffers are allocated up front, the writes go to a
+    // background thread (LayerCapture.h)
+    std::unique_ptr<LayerCapture> capture;
+    if (opts.capture.layers != "none")
+    {
+        LayerCaptureOptions capture_opts = opts.capture;
+        capture_opts.buffers = capture_opts.sampling() ? capture_opts.buffers : 1; // the final run only
+        capture.reset(new LayerCapture(info, capture_opts, device_type, device_id));
+    }
 
-    int count = 0;
-    double total = 0.0;
-    for (int i = 0; i < n_samples; ++i)
+    // With --zero-copy the input is produced directly in an aligned host
+    // buffer that the operators read, and the last operator writes into the
+    // output buffer (bind_input / bind_output in graph_runtime_ext.cc), so
+    // the io phase below has nothing left to copy.  Buffers that cannot be
+    // bound in place (another device) are copied by run() instead.
+    std::unique_ptr<HostTensor> input_buffer, output_buffer;
+    if (opts.zero_copy)
     {
-        std::cout << "iteration " << i << std::endl;
+        input_buffer.reset(new HostTensor(info, info.entry_id(info.input_nodes_.front(), 0)));
+        output_buffer.reset(new HostTensor(info, info.entry_id(info.outputs_.front())));
+        CHECK_EQ(input_buffer->bytes(), in_size * sizeof(float));
+        CHECK_EQ(output_buffer->bytes(), out_size * sizeof(float));
+        input_tic = Clock::now();
+        std::memcpy(input_buffer->data<float>(), tvm_input.data(), input_buffer->bytes());
+
+        const int in_place = static_cast<int>(mod.GetFunction("bind_input")("data", input_buffer->tensor())) + static_cast<int>(mod.GetFunction("bind_output")(0, output_buffer->tensor()));
+        input_time += Duration(Clock::now() - input_tic).count();
+        std::cout << "zero copy: " << in_place << " of 2 buffers bound in place" << std::endl;
+    }
 
-        std::cout << "set_input(data, x)" << std::endl;
-        TVMArrayCopyFromBytes(x, tvm_input.data(), in_size * sizeof(float));
+    // With --plan run() calls the operators' entry points from pre-bound
+    // argument arrays instead of through a PackedFunc per node; bound
+    // buffers stay bound.
+    if (opts.plan)
+    {
+        const int direct = mod.GetFunction("set_plan")(1);
+        std::cout << "plan: " << direct << " operators called directly" << std::endl;
+    }
 
-        set_input("data", x);
+    std::cout << "warmup: " << opts.warmup << " iterations: " << opts.iterations << std::endl;
+
+    // Only run() (plus a device sync, so asynchronous GPU back-ends report
+    // the real kernel time) is timed.  Input staging and output readback are
+    // timed separately as io; layer dumps and score printing stay outside.
+    std::vector<double> timings, io_timings;
+    timings.reserve(opts.iterations);
+    io_timings.reserve(opts.iterations);
+    Timepoint first_inference, first_tic;
+    double first_run = 0.0;
+    for (int i = 0; i < opts.warmup + opts.iterations; ++i)
+    {
+        auto io_tic = Clock::now();
+        if (!opts.zero_copy)
+        {
+            TVMArrayCopyFromBytes(x, tvm_input.data(), in_size * sizeof(float));
+            set_input("data", x);
+        }
 
-        std::cout << "run()" << std::endl;
         auto tic = Clock::now();
-        run();
-        auto toc = Clock::now();
-        auto elapsed = Duration(toc - tic).count();
-        if (i > warmup)
+        if (capture && opts.capture.sampling() && capture->Sampled(i))
         {
-            count++;
-            total += elapsed;
-            std::cout << "elapsed: " << elapsed << std::endl;
+            capture->Run(mod, opts.capture.prefix + "_" + std::to_string(i) + opts.capture.extension());
         }
-
-        std::cout << "get_output(0, y)" << std::endl;
-        get_output(0, y);
-
-#if TCT_SAVE_LAYERS
-        for (int j = 0, k = 0; j < info.attrs_.shape.size(); j += 1, k++)
+        else
         {
-            DLTensor* layer_output = nullptr;
-            DLTensor* layer_output2 = nullptr;
+            run();
+        }
+        TVMSynchronize(device_type, device_id, nullptr);
+        auto toc = Clock::now();
 
-            auto& shape = info.attrs_.shape[j];
-            auto code = info.attrs_.dltype;
+        if (!opts.zero_copy)
+        {
+            get_output(0, y);
+            TVMArrayCopyToBytes(y, tvm_output.data(), out_size * sizeof(float));
+        }
+        auto io_toc = Clock::now();
 
-            std::size_t total = shape.front();
-            for (auto iter = shape.begin() + 1; iter != shape.end(); iter++)
+        if (i == 0)
+        {
+            input_time += Duration(tic - io_tic).count();
+            first_tic = tic;
+            first_inference = toc;
+            first_run = Duration(toc - tic).count();
+            if (opts.memory)
             {
-                total *= (*iter);
+                memory.Phase("first run");
             }
+        }
 
-            std::cout << "N=" << k << " total = " << total << std::endl;
+        if (i >= opts.warmup)
+        {
+            timings.push_back(Duration(toc - tic).count());
+            io_timings.push_back(Duration((tic - io_tic) + (io_toc - toc)).count());
+        }
+    }
 
-            std::cout << "get_output_by_layer(" << j << ", layer_output);" << std::endl;
-            std::vector<float> values(total);
-            layer_output = get_output_by_layer(j, 0);
-            TVMArrayCopyToBytes(layer_output, values.data(), values.size() * sizeof(float));
+    if (opts.memory)
+    {
+        memory.Phase("steady");
+    }
 
-#if TCT_TEST_DEBUG_GET_OUTPUT
-            // debug_get_output require pre-allocation:
-            TVMArrayAlloc(shape.data(), shape.size(), dtype_code, dtype_bits, dtype_lanes, device_type, device_id, &layer_output2);
+    if (opts.zero_copy)
+    {
+        std::memcpy(tvm_output.data(), output_buffer->data<float>(), output_buffer->bytes());
 
-            std::cout << "debug_get_output(" << j << ", layer_output);" << std::endl;
-            auto result = debug_get_output(j, layer_output2);
-            std::vector<float> values2(total);
-            TVMArrayCopyToBytes(layer_output2, values2.data(), values2.size() * sizeof(float));
-            TVMArrayFree(layer_output2);
-#endif // TCT_TEST_DEBUG_GET_OUTPUT
+        // get_output and the layer dump read the runtime's own entries, which
+        // the bound run() did not use: run once more without the bindings.
+        mod.GetFunction("unbind")();
+        TVMArrayCopyFromBytes(x, tvm_input.data(), in_size * sizeof(float));
+        set_input("data", x);
+        run();
+    }
 
-            std::stringstream ss;
-            ss << "tvm_" << std::setw(4) << std::setfill('0') << j << '_' << info.nodes_[j].name << ".txt";
-            std::ofstream ofs(ss.str());
-            if (ofs)
+    std::vector<SweepResult> sweep;
+    if (opts.thread_sweep > 0)
+    {
+        std::cout << std::setw(8) << "threads"
+                  << std::setw(12) << "mean_ms"
+                  << std::setw(12) << "p50_ms"
+                  << std::setw(12) << "p99_ms"
+                  << std::setw(10) << "speedup"
+                  << std::setw(12) << "efficiency" << std::endl;
+        sweep = thread_sweep(opts, mod, device_type, device_id);
+    }
+
+    if (opts.profile > 0)
+    {
+        OpProfiler profiler(info);
+        profiler.Run(mod, opts.profile);
+        profiler.Print(std::cout);
+
+        if (!opts.profile_json.empty())
+        {
+            std::ofstream profile_out(opts.profile_json);
+            if (!profile_out)
             {
-    	        print(layer_output, values, ofs);
+                std::cerr << "Failed to write json file " << opts.profile_json << std::endl;
+                return 1;
             }
+
+            dmlc::JSONWriter writer(&profile_out);
+            profiler.Save(&writer);
+            profile_out << std::endl;
         }
-#endif // TCT_SAVE_LAYERS
+    }
 
-        std::cout << "TVMArrayCopyToBytes(y, y_iter, out_size * sizeof(float));" << std::endl;
-        float* y_iter = tvm_output.data();
-        TVMArrayCopyToBytes(y, y_iter, out_size * sizeof(float));
+    std::cout << "get_output(0, y)" << std::endl;
+    get_output(0, y);
+    TVMArrayCopyToBytes(y, tvm_output.data(), out_size * sizeof(float));
 
-        for (std::size_t i = 0; i < tvm_output.size(); i++)
+    if (capture)
+    {
+        // Without sampling, all selected layers of one more run go into a
+        // single indexed file, see LayerDump.h and tvm_layer_dump for the
+        // conversion to the per layer text format, or with --fingerprint
+        // into a fingerprint file (LayerFingerprint.h).
+        const std::string dump_file = opts.capture.prefix + opts.capture.extension();
+        if (!opts.capture.sampling())
         {
-            std::cout << "score[" << i << "] = " << tvm_output[i] << std::endl;
+            capture->Run(mod, dump_file);
         }
+        capture->Flush();
 
-        // get the maximum position in output vector
-        auto max_iter = std::max_element(y_iter, y_iter + 1000);
-        auto max_index = std::distance(y_iter, max_iter);
-        std::cout << "The maximum position in output vector is: " << max_index << std::endl;
+        const LayerCaptureStats c = capture->stats();
+        if (c.failed)
+        {
+            std::cerr << "Failed to write " << c.failed << " layer captures" << std::endl;
+            return 1;
+        }
+        if (opts.capture.sampling())
+        {
+            std::cout << "layers: " << capture->nodes().size() << " nodes, " << c.captured << " requests captured, " << c.dropped
+                      << " dropped, " << to_mib(c.bytes) << " MiB " << (opts.capture.fingerprint ? "fingerprinted" : "written") << " in " << c.write_s << " s" << std::endl;
+        }
+        else
+        {
+            std::cout << "layers: " << dump_file << std::endl;
+        }
+    }
 
-        if (max_index != 282) // 282: 'tiger cat' (see synset.txt)
+    if (opts.print_scores)
+    {
+        for (std::size_t i = 0; i < tvm_output.size(); i++)
         {
-            std::cerr << "Expected 282 but got: " << max_index << std::endl;
-            exit(1);
+            std::cout << "score[" << i << "] = " << tvm_output[i] << std::endl;
         }
     }
 
+    const Classification result = top_k(tvm_output.data(), static_cast<int>(out_size), opts.top_k, opts.softmax != 0);
+    const int max_index = result.top1();
+    std::cout << "The maximum position in output vector is: " << max_index << std::endl;
+    std::cout << "top-" << result.count << ": " << result << std::endl;
+
     TVMArrayFree(x);
     TVMArrayFree(y);
 
-    std::cout << "average: " << total / static_cast<double>(count) << std::endl;
+    if (max_index != 282) // 282: 'tiger cat' (see synset.txt)
+    {
+        std::cerr << "Expected 282 but got: " << max_index << std::endl;
+        exit(1);
+    }
+
+    const double load_time = Duration(loaded - start).count();
+    const double time_to_first_inference = Duration(first_inference - start).count();
+    const std::size_t peak_rss = peak_rss_bytes();
+    std::cout << "startup: load " << load_time << " s, first run() " << first_run
+              << " s, time to first inference " << time_to_first_inference << " s" << std::endl;
+
+    // Where the time to first inference goes, phase by phase
+    const StartupPhases& phases = model.startup;
+    const double setup_time = Duration(load_begin - start).count();
+    const double other_time = Duration(first_tic - loaded).count() - input_time; // graph bench, capture, plan ...
+    std::cout << "startup phases (s): setup " << setup_time
+              << ", lib " << phases.lib_s << ((opts.lib == "system") ? " (system lib)" : " (dlopen)")
+              << ", graph " << phases.graph_s
+              << ", create " << phases.create_s
+              << ", params " << phases.params_s
+              << ", input " << input_time
+              << ", other " << other_time
+              << ", first run() " << first_run << std::endl;
+    std::cout << "peak rss: load " << to_mib(peak_rss_load) << " MiB, final " << to_mib(peak_rss) << " MiB" << std::endl;
+    if (opts.memory)
+    {
+        memory.Print(std::cout);
+    }
+
+    auto stats = LatencyStats::compute(timings);
+    std::cout << "latency " << stats << std::endl;
+
+    auto io_stats = LatencyStats::compute(io_timings);
+    std::cout << "io (" << (opts.zero_copy ? "zero copy" : "copy") << ") " << io_stats << std::endl;
+
+    if (!opts.json.empty())
+    {
+        std::ofstream json_out(opts.json);
+        if (!json_out)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&json_out);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("lib", opts.lib);
+        writer.WriteObjectKeyValue("device_type", device_type);
+        writer.WriteObjectKeyValue("threads", threads);
+        writer.WriteObjectKeyValue("warmup", opts.warmup);
+        writer.WriteObjectKeyValue("iterations", opts.iterations);
+        writer.WriteObjectKeyValue("load_s", load_time);
+        writer.WriteObjectKeyValue("first_run_s", first_run);
+        writer.WriteObjectKeyValue("time_to_first_inference_s", time_to_first_inference);
+        writer.WriteObjectKeyValue("setup_s", setup_time);
+        writer.WriteObjectKeyValue("startup", phases);
+        writer.WriteObjectKeyValue("input_s", input_time);
+        writer.WriteObjectKeyValue("other_s", other_time);
+        writer.WriteObjectKeyValue("params", opts.params);
+        writer.WriteObjectKeyValue("param_bytes", model.param_bytes);
+        if (model.compact.file_bytes)
+        {
+            writer.WriteObjectKeyValue("compact_params", model.compact);
+        }
+        writer.WriteObjectKeyValue("peak_rss_load_bytes", peak_rss_load);
+        writer.WriteObjectKeyValue("peak_rss_bytes", peak_rss);
+        if (opts.memory)
+        {
+            writer.WriteObjectKeyValue("memory", memory);
+        }
+        writer.WriteObjectKeyValue("top1", max_index);
+        writer.WriteObjectKeyValue("latency", stats);
+        writer.WriteObjectKeyValue("zero_copy", opts.zero_copy);
+        writer.WriteObjectKeyValue("plan", opts.plan);
+        if (capture)
+        {
+            writer.WriteObjectKeyValue("capture", capture->stats());
+        }
+        writer.WriteObjectKeyValue("io", io_stats);
+        if (!sweep.empty())
+        {
+            writer.WriteObjectKeyValue("thread_sweep", sweep);
+        }
+        writer.EndObject();
+        json_out << std::endl;
+    }
 
     exit(0);
 }
@@ -0,0 +1,335 @@
+// Per node dispatch overhead of the graph runtime: the stock run() (one
+// std::function per op around a PackedFunc, TVMArgs / TVMRetValue per call)
+// against the precompiled execution plan (set_plan in graph_runtime_ext.cc:
+// raw entry points and pre-bound argument arrays).
+//
+// - dispatch only: both launch paths, with the graph's operator count and
+//   argument counts, calling an empty kernel, so the time is the dispatch
+//   alone (ns per node);
+// - graph: run() of the model with and without the plan, interleaved, and
+//   the difference per node; the outputs must match exactly.
+
+#include "Benchmark.h"
+#include "BenchmarkArgs.h"
+#include "Device.h"
+#include "ModelLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct DispatchBenchOptions
+{
+    std::string lib;
+    std::string graph{ "from_mxnet.json" };
+    std::string params{ "from_mxnet.params" };
+    std::string input{ "cat.bin" };
+    int iterations{ 200 };      // timed run() per executor
+    int warmup{ 10 };
+    int dispatch_runs{ 10000 }; // passes over the operators, dispatch only
+    std::string json;
+};
+
+struct DispatchResult
+{
+    std::size_t ops{ 0 };
+    std::size_t direct_ops{ 0 };     // called through a raw entry point by the plan
+    double stock_dispatch_ns{ 0.0 }; // per node, empty kernel
+    double plan_dispatch_ns{ 0.0 };
+    LatencyStats stock;
+    LatencyStats plan;
+    double saved_per_node_ns{ 0.0 }; // run() mean difference per node
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("ops", ops);
+        writer->WriteObjectKeyValue("direct_ops", direct_ops);
+        writer->WriteObjectKeyValue("stock_dispatch_ns", stock_dispatch_ns);
+        writer->WriteObjectKeyValue("plan_dispatch_ns", plan_dispatch_ns);
+        writer->WriteObjectKeyValue("stock", stock);
+        writer->WriteObjectKeyValue("plan", plan);
+        writer->WriteObjectKeyValue("saved_per_node_ns", saved_per_node_ns);
+        writer->EndObject();
+    }
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_dispatch_bench /full/path/to/from_mxnet.so [options]\n"
+              << "  --graph FILE         graph JSON or binary graph (default from_mxnet.json)\n"
+              << "  --params FILE        parameters (default from_mxnet.params)\n"
+              << "  --input FILE         one input sample (default cat.bin)\n"
+              << "  --iterations N       timed run() per executor (default 200)\n"
+              << "  --warmup N           untimed run() per executor (default 10)\n"
+              << "  --dispatch-runs N    passes over the operators with an empty kernel (default 10000)\n"
+              << "  --json FILE          write the results as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, DispatchBenchOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.lib = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--graph")
+        {
+            opts.graph = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--iterations")
+        {
+            opts.iterations = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--warmup")
+        {
+            opts.warmup = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--dispatch-runs")
+        {
+            opts.dispatch_runs = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The kernel of the dispatch only runs
+static int empty_kernel(void*, int*, int)
+{
+    return 0;
+}
+
+using EntryPoint = int (*)(void* args, int* type_codes, int num_args);
+
+// ns per node of both launch paths, for operators with arg_counts arguments
+static void time_dispatch(const std::vector<int>& arg_counts, int runs, double& stock_ns, double& plan_ns)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    std::size_t total_args = 0;
+    for (auto n : arg_counts)
+    {
+        total_args += n;
+    }
+    std::vector<TVMValue> values(total_args);
+    std::vector<int> type_codes(total_args, kArrayHandle);
+    for (auto& v : values)
+    {
+        v.v_handle = nullptr;
+    }
+
+    // Stock: GraphRuntime::CreateTVMOp's closure around WrapPackedFunc's
+    std::vector<std::function<void()>> op_execs;
+    std::vector<EntryPoint> funcs;
+    std::vector<uint32_t> offsets{ 0 };
+    for (auto n : arg_counts)
+    {
+        EntryPoint faddr = empty_kernel;
+        tvm::runtime::PackedFunc pf([faddr](tvm::runtime::TVMArgs args, tvm::runtime::TVMRetValue* rv) {
+            const int ret = (*faddr)(const_cast<TVMValue*>(args.values), const_cast<int*>(args.type_codes), args.num_args);
+            CHECK_EQ(ret, 0) << TVMGetLastError();
+        });
+        TVMValue* v = values.data() + offsets.back();
+        int* t = type_codes.data() + offsets.back();
+        op_execs.push_back([pf, v, t, n]() {
+            tvm::runtime::TVMRetValue rv;
+            tvm::runtime::TVMArgs targs(v, t, n);
+            pf.CallPacked(targs, &rv);
+        });
+        funcs.push_back(faddr);
+        offsets.push_back(offsets.back() + n);
+    }
+
+    auto tic = Clock::now();
+    for (int r = 0; r < runs; r++)
+    {
+        for (std::size_t i = 0; i < op_execs.size(); i++)
+        {
+            if (op_execs[i])
+            {
+                op_execs[i]();
+            }
+        }
+    }
+    auto toc = Clock::now();
+    stock_ns = Duration(toc - tic).count() * 1e9 / (static_cast<double>(runs) * std::max<std::size_t>(op_execs.size(), 1));
+
+    tic = Clock::now();
+    for (int r = 0; r < runs; r++)
+    {
+        for (std::size_t i = 0; i < funcs.size(); i++)
+        {
+            const int ret = funcs[i](values.data() + offsets[i], type_codes.data() + offsets[i], static_cast<int>(offsets[i + 1] - offsets[i]));
+            CHECK_EQ(ret, 0) << TVMGetLastError();
+        }
+    }
+    toc = Clock::now();
+    plan_ns = Duration(toc - tic).count() * 1e9 / (static_cast<double>(runs) * std::max<std::size_t>(funcs.size(), 1));
+}
+
+static std::vector<float> read_output(GraphModel& model)
+{
+    tvm::runtime::NDArray y = model.mod.GetFunction("get_output")(0);
+    std::vector<float> output(element_count(std::vector<int64_t>(y->shape, y->shape + y->ndim)));
+    TVMArrayCopyToBytes(const_cast<DLTensor*>(y.operator->()), output.data(), output.size() * sizeof(float));
+    return output;
+}
+
+int main(int argc, char** argv) try
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    DispatchBenchOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, opts.params, kDeviceType, 0);
+
+    // Operators the runtime launches: every tvm_op node but __nop
+    DispatchResult result;
+    std::vector<int> arg_counts;
+    for (const auto& node : model.info.nodes_)
+    {
+        if (node.op_type == "tvm_op" && node.param.func_name != "__nop")
+        {
+            arg_counts.push_back(static_cast<int>(node.inputs.size() + node.param.num_outputs));
+        }
+    }
+    result.ops = arg_counts.size();
+
+    time_dispatch(arg_counts, opts.dispatch_runs, result.stock_dispatch_ns, result.plan_dispatch_ns);
+    std::cout << "dispatch only (" << result.ops << " ops, empty kernel): stock " << result.stock_dispatch_ns << " ns/node, plan "
+              << result.plan_dispatch_ns << " ns/node" << std::endl;
+
+    std::vector<float> input(element_count(model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)]));
+    read_input_file(opts.input, input);
+
+    DLTensor* x = nullptr;
+    const auto& in_shape = model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)];
+    TVMArrayAlloc(in_shape.data(), static_cast<int>(in_shape.size()), kDLFloat, 32, 1, kDeviceType, 0, &x);
+    TVMArrayCopyFromBytes(x, input.data(), input.size() * sizeof(float));
+    model.mod.GetFunction("set_input")("data", x);
+    TVMArrayFree(x);
+
+    tvm::runtime::PackedFunc set_plan = model.mod.GetFunction("set_plan");
+    CHECK(set_plan != nullptr) << "set_plan requires a runtime created by graph_runtime_ext.cc";
+    tvm::runtime::PackedFunc run = model.mod.GetFunction("run");
+
+    result.direct_ops = static_cast<int>(set_plan(1));
+    run();
+    const std::vector<float> plan_output = read_output(model);
+    set_plan(0);
+    run();
+    const std::vector<float> stock_output = read_output(model);
+
+    // Interleaved, so both see the same frequency and cache state
+    std::vector<double> stock_samples, plan_samples;
+    for (int i = -opts.warmup; i < opts.iterations; i++)
+    {
+        for (int use_plan = 0; use_plan < 2; use_plan++)
+        {
+            set_plan(use_plan);
+            auto tic = Clock::now();
+            run();
+            auto toc = Clock::now();
+            if (i >= 0)
+            {
+                (use_plan ? plan_samples : stock_samples).push_back(Duration(toc - tic).count());
+            }
+        }
+    }
+    set_plan(0);
+
+    result.stock = LatencyStats::compute(stock_samples);
+    result.plan = LatencyStats::compute(plan_samples);
+    result.saved_per_node_ns = (result.stock.mean - result.plan.mean) * 1e6 / std::max<std::size_t>(result.ops, 1);
+
+    std::cout << "plan: " << result.direct_ops << " of " << result.ops << " ops called through their entry point" << std::endl;
+    std::cout << std::setw(8) << "run()"
+              << std::setw(10) << "mean_ms"
+              << std::setw(10) << "p50_ms"
+              << std::setw(10) << "p99_ms" << std::endl;
+    std::cout << std::fixed << std::setprecision(3)
+              << std::setw(8) << "stock"
+              << std::setw(10) << result.stock.mean
+              << std::setw(10) << result.stock.p50
+              << std::setw(10) << result.stock.p99 << std::endl
+              << std::setw(8) << "plan"
+              << std::setw(10) << result.plan.mean
+              << std::setw(10) << result.plan.p50
+              << std::setw(10) << result.plan.p99 << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << "saved per node: " << result.saved_per_node_ns << " ns, "
+              << 100.0 * (result.stock.mean - result.plan.mean) / std::max(result.stock.mean, 1e-12) << " % of run()" << std::endl;
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("lib", opts.lib);
+        writer.WriteObjectKeyValue("device_type", kDeviceType);
+        writer.WriteObjectKeyValue("dispatch", result);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    if (plan_output != stock_output)
+    {
+        std::cerr << "plan output differs from the stock run()" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
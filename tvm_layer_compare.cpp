@@ -0,0 +1,292 @@
+// Compare two binary layer dumps (e.g. Android vs Ubuntu Vulkan, or CPU vs GPU)
+// written by tvm_deploy_gpu_sample with --layers.  Replaces the awk
+// pipeline in cmp.sh.  Two fingerprint files (--fingerprint 1) are compared
+// by hash and statistics instead, the tolerances do not apply there.
+
+#include "LayerCompare.h"
+#include "LayerFingerprint.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+static void usage()
+{
+    std::cerr << "usage: tvm_layer_compare test.bin reference.bin [options]\n"
+              << "       tvm_layer_compare test.fp reference.fp [--all] [--json FILE]\n"
+              << "  --atol X     absolute tolerance (default 1e-5)\n"
+              << "  --rtol X     relative tolerance (default 0.1)\n"
+              << "  --threads N  worker threads (default: hardware concurrency)\n"
+              << "  --all        print every layer, not only diverging ones\n"
+              << "  --json FILE  write the per layer report as JSON" << std::endl;
+}
+
+static void print_row(const LayerDiff& diff)
+{
+    std::cout << std::setw(5) << diff.node_id
+              << std::setw(12) << diff.size;
+    if (!diff.comparable)
+    {
+        std::cout << "  shape/dtype mismatch  " << diff.name << std::endl;
+        return;
+    }
+
+    std::cout << std::setw(14) << diff.max_abs
+              << std::setw(14) << diff.max_rel
+              << std::setw(12) << diff.max_ulp
+              << std::setw(10) << diff.mismatches
+              << std::setw(6) << diff.nan_a << '/' << diff.nan_b
+              << std::setw(6) << diff.inf_a << '/' << diff.inf_b
+              << "  " << diff.name << std::endl;
+}
+
+static void print_row(const FingerprintDiff& diff)
+{
+    std::cout << std::setw(5) << diff.b.node_id
+              << std::setw(12) << diff.b.size;
+    if (!diff.comparable())
+    {
+        std::cout << "  shape/dtype mismatch  " << diff.b.name << std::endl;
+        return;
+    }
+
+    std::cout << std::setw(6) << ((diff.a.hash == diff.b.hash) ? "=" : "x")
+              << std::setw(14) << diff.max_stat_diff()
+              << std::setw(14) << diff.l2_rel_diff()
+              << std::setw(6) << diff.a.nan << '/' << diff.b.nan
+              << std::setw(6) << diff.a.inf << '/' << diff.b.inf
+              << "  " << diff.b.name << std::endl;
+}
+
+static int compare_fingerprint_files(const char* test_file, const char* reference_file, bool all, const std::string& json)
+{
+    double test_quantum = 0.0, reference_quantum = 0.0;
+    std::vector<LayerFingerprint> test, reference;
+    if (!load_fingerprints(test_file, test_quantum, test))
+    {
+        std::cerr << "Failed to read fingerprint file " << test_file << std::endl;
+        return 1;
+    }
+    if (!load_fingerprints(reference_file, reference_quantum, reference))
+    {
+        std::cerr << "Failed to read fingerprint file " << reference_file << std::endl;
+        return 1;
+    }
+    if (test_quantum != reference_quantum)
+    {
+        std::cerr << "Fingerprints use different quanta: " << test_quantum << " vs " << reference_quantum << std::endl;
+        return 1;
+    }
+
+    const auto diffs = compare_fingerprints(test, reference);
+
+    std::cout << std::setw(5) << "node"
+              << std::setw(12) << "size"
+              << std::setw(6) << "hash"
+              << std::setw(14) << "max_stat"
+              << std::setw(14) << "l2_rel"
+              << std::setw(8) << "nan"
+              << std::setw(8) << "inf"
+              << "  name" << std::endl;
+
+    const FingerprintDiff* first = nullptr;
+    std::size_t diverged = 0;
+    for (const auto& diff : diffs)
+    {
+        if (diff.diverged())
+        {
+            diverged++;
+            first = first ? first : &diff;
+        }
+        if (all || diff.diverged())
+        {
+            print_row(diff);
+        }
+    }
+
+    std::cout << "compared " << diffs.size() << " layer fingerprints (" << test.size() << " vs " << reference.size() << ")"
+              << ", quantum " << reference_quantum << ", diverging: " << diverged << std::endl;
+    if (first)
+    {
+        std::cout << "first diverging layer: " << first->b.node_id << " " << first->b.name << std::endl;
+    }
+
+    if (!json.empty())
+    {
+        std::ofstream ofs(json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("quantum", reference_quantum);
+        writer.WriteObjectKeyValue("diverging", diverged);
+        writer.WriteObjectKeyValue("first_diverging", first ? static_cast<int64_t>(first->b.node_id) : int64_t(-1));
+        writer.WriteObjectKeyValue("layers", diffs);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    return (diverged > 0) ? 2 : 0;
+}
+
+int main(int argc, char** argv) try
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    LayerTolerance tol;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    bool all = false;
+    std::string json;
+    for (int i = 3; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--all")
+        {
+            all = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--atol")
+        {
+            tol.atol = std::atof(value);
+        }
+        else if (arg == "--rtol")
+        {
+            tol.rtol = std::atof(value);
+        }
+        else if (arg == "--threads")
+        {
+            threads = std::max(1, std::atoi(value));
+        }
+        else if (arg == "--json")
+        {
+            json = value;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (is_fingerprint_file(argv[1]) && is_fingerprint_file(argv[2]))
+    {
+        return compare_fingerprint_files(argv[1], argv[2], all, json);
+    }
+
+    auto tic = Clock::now();
+
+    LayerDumpReader test, reference;
+    if (!test.open(argv[1]))
+    {
+        std::cerr << "Failed to read layer dump " << argv[1] << std::endl;
+        return 1;
+    }
+    if (!reference.open(argv[2]))
+    {
+        std::cerr << "Failed to read layer dump " << argv[2] << std::endl;
+        return 1;
+    }
+
+    auto diffs = compare_layers(test, reference, tol, threads);
+
+    auto toc = Clock::now();
+
+    std::cout << std::setw(5) << "node"
+              << std::setw(12) << "size"
+              << std::setw(14) << "max_abs"
+              << std::setw(14) << "max_rel"
+              << std::setw(12) << "max_ulp"
+              << std::setw(10) << "mismatch"
+              << std::setw(8) << "nan"
+              << std::setw(8) << "inf"
+              << "  name" << std::endl;
+
+    const LayerDiff* first = nullptr;
+    std::size_t diverged = 0;
+    for (const auto& diff : diffs)
+    {
+        if (diff.diverged())
+        {
+            diverged++;
+            if (!first)
+            {
+                first = &diff;
+            }
+        }
+
+        if (all || diff.diverged())
+        {
+            print_row(diff);
+        }
+    }
+
+    std::cout << "compared " << diffs.size() << " layers (" << test.size() << " vs " << reference.size() << ")"
+              << " in " << Duration(toc - tic).count() << " s"
+              << ", diverging: " << diverged << std::endl;
+    if (first)
+    {
+        std::cout << "first diverging layer: " << first->node_id << " " << first->name;
+        if (!first->comparable)
+        {
+            std::cout << " (shape/dtype mismatch)";
+        }
+        else if (first->exact)
+        {
+            std::cout << " (bitwise mismatch)";
+        }
+        else
+        {
+            std::cout << " at element " << first->first_mismatch;
+        }
+        std::cout << std::endl;
+    }
+
+    if (!json.empty())
+    {
+        std::ofstream ofs(json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("atol", tol.atol);
+        writer.WriteObjectKeyValue("rtol", tol.rtol);
+        writer.WriteObjectKeyValue("diverging", diverged);
+        writer.WriteObjectKeyValue("first_diverging", first ? static_cast<int64_t>(first->node_id) : int64_t(-1));
+        writer.WriteObjectKeyValue("layers", diffs);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    return (diverged > 0) ? 2 : 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
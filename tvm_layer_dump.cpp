@@ -0,0 +1,78 @@
+// Inspect a binary layer dump written by tvm_deploy_gpu_sample (--layers)
+// and optionally convert it to the per-layer text files used by cmp.sh.
+
+#include "LayerDump.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static void usage()
+{
+    std::cerr << "usage: tvm_layer_dump tvm_layers.bin [list|text] [output_prefix]\n"
+              << "  list : print the index (default)\n"
+              << "  text : write one <output_prefix>NNNN_<name>.txt file per layer (default prefix 'tvm_')" << std::endl;
+}
+
+int main(int argc, char** argv) try
+{
+    if (argc < 2)
+    {
+        usage();
+        return 1;
+    }
+
+    const std::string filename = argv[1];
+    const std::string command = (argc > 2) ? argv[2] : "list";
+    const std::string prefix = (argc > 3) ? argv[3] : "tvm_";
+
+    LayerDumpReader dump;
+    if (!dump.open(filename))
+    {
+        std::cerr << "Failed to read layer dump " << filename << std::endl;
+        return 1;
+    }
+
+    if (command == "list")
+    {
+        for (const auto& record : dump.records())
+        {
+            std::cout << std::setw(4) << record.node_id << ' '
+                      << std::setw(4) << record.entry_id << ' '
+                      << std::setw(8) << dltype_string(record.dtype) << " {";
+            for (std::size_t d = 0; d < record.shape.size(); d++)
+            {
+                std::cout << record.shape[d] << ((d + 1 < record.shape.size()) ? ", " : "");
+            }
+            std::cout << "} " << record.nbytes << " bytes " << record.name << std::endl;
+        }
+    }
+    else if (command == "text")
+    {
+        for (const auto& record : dump.records())
+        {
+            std::stringstream ss;
+            ss << prefix << std::setw(4) << std::setfill('0') << record.entry_id << '_' << record.name << ".txt";
+            std::ofstream ofs(ss.str());
+            if (!ofs)
+            {
+                std::cerr << "Failed to write " << ss.str() << std::endl;
+                return 1;
+            }
+            print(record, ofs);
+        }
+    }
+    else
+    {
+        usage();
+        return 1;
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
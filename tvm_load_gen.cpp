@@ -0,0 +1,479 @@
+// Open loop load generator: requests arrive at a target rate (Poisson or
+// constant inter-arrival times) whether or not earlier ones have finished,
+// and are served by an InferencePool (InferencePool.h) of one or more
+// runtime instances sharing the weights.  Reports latency percentiles,
+// achieved throughput and the queue depth over time, and with --ramp
+// raises the rate step by step to find the saturation point.
+//
+// Latency is measured from the time a request was scheduled to arrive, not
+// from when the generator got around to sending it, so a generator held up
+// by a full queue (--max-queue) does not hide the wait (coordinated omission
+// correction).  The service latency from the actual submit is reported too.
+
+#include "Benchmark.h"
+#include "BenchmarkArgs.h"
+#include "Device.h"
+#include "InferencePool.h"
+#include "ModelLoader.h"
+#include "Postprocess.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoadGenOptions
+{
+    std::string lib;
+    std::string graph{ "from_mxnet.json" };
+    std::string params{ "from_mxnet.params" };
+    std::string input{ "cat.bin" };
+    int instances{ 1 };
+    int threads{ 1 }; // TVM threads per instance
+    bool pin{ false };
+    bool poisson{ true };      // arrivals, false : constant rate
+    double rate{ 50.0 };       // requests per second
+    double ramp_factor{ 0.0 }; // > 1 : ramp from rate by this factor per step
+    double ramp_max{ 0.0 };    // highest rate of the ramp
+    double duration{ 10.0 };   // measured seconds per rate
+    double warmup{ 1.0 };      // unmeasured seconds before
+    int max_queue{ 256 };      // requests in flight before the generator waits
+    int interval_ms{ 100 };    // queue depth timeline resolution
+    double slo_ms{ 0.0 };      // p99 limit for the saturation point, 0 : none
+    double tolerance{ 0.05 };  // achieved below (1 - tolerance) * rate : saturated
+    unsigned seed{ 1 };
+    int expected{ 282 }; // expected top-1, -1 : no check
+    std::string json;
+};
+
+struct LoadSample
+{
+    double t_s{ 0.0 };       // since the start of the step
+    int queue_depth{ 0 };    // requests in flight
+    double completed{ 0.0 }; // per second over the interval
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("t_s", t_s);
+        writer->WriteObjectKeyValue("queue_depth", queue_depth);
+        writer->WriteObjectKeyValue("completed_per_s", completed);
+        writer->EndObject();
+    }
+};
+
+struct LoadResult
+{
+    double rate{ 0.0 };            // offered, requests per second
+    std::size_t requests{ 0 };     // measured
+    double throughput{ 0.0 };      // achieved, requests per second
+    double max_send_lag_ms{ 0.0 }; // generator behind schedule
+    int max_queue_depth{ 0 };
+    double mean_queue_depth{ 0.0 };
+    bool saturated{ false };
+    std::size_t top1_errors{ 0 };
+    LatencyStats latency; // scheduled arrival to result
+    LatencyStats service; // submit to result
+    std::vector<LoadSample> timeline;
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("rate", rate);
+        writer->WriteObjectKeyValue("requests", requests);
+        writer->WriteObjectKeyValue("throughput", throughput);
+        writer->WriteObjectKeyValue("max_send_lag_ms", max_send_lag_ms);
+        writer->WriteObjectKeyValue("max_queue_depth", max_queue_depth);
+        writer->WriteObjectKeyValue("mean_queue_depth", mean_queue_depth);
+        writer->WriteObjectKeyValue("saturated", static_cast<int>(saturated));
+        writer->WriteObjectKeyValue("top1_errors", top1_errors);
+        writer->WriteObjectKeyValue("latency", latency);
+        writer->WriteObjectKeyValue("service", service);
+        writer->WriteObjectKeyValue("timeline", timeline);
+        writer->EndObject();
+    }
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_load_gen /full/path/to/from_mxnet.so [options]\n"
+              << "  --graph FILE        graph JSON or binary graph (default from_mxnet.json)\n"
+              << "  --params FILE       parameters (default from_mxnet.params)\n"
+              << "  --input FILE        one input sample (default cat.bin)\n"
+              << "  --instances N       runtime instances, sharing the weights (default 1)\n"
+              << "  --threads N         TVM threads per instance (default 1)\n"
+              << "  --pin 0|1           bind each instance and its threads to its own cores (default 0)\n"
+              << "  --arrival MODE      poisson (default) or constant inter-arrival times\n"
+              << "  --rate R            requests per second (default 50), the first rate of a ramp\n"
+              << "  --ramp F,MAX        multiply the rate by F per step up to MAX, stop at saturation\n"
+              << "  --duration S        measured seconds per rate (default 10)\n"
+              << "  --warmup S          unmeasured seconds before (default 1)\n"
+              << "  --max-queue N       requests in flight before the generator waits (default 256)\n"
+              << "  --interval-ms N     queue depth timeline resolution (default 100)\n"
+              << "  --slo-ms X          p99 latency above X counts as saturated (default: no limit)\n"
+              << "  --tolerance X       throughput below (1 - X) * rate counts as saturated (default 0.05)\n"
+              << "  --seed N            arrival times seed (default 1)\n"
+              << "  --expect N          expected top-1 class, -1 to disable the check (default 282)\n"
+              << "  --json FILE         write the results and timelines as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, LoadGenOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.lib = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--graph")
+        {
+            opts.graph = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--instances")
+        {
+            opts.instances = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--threads")
+        {
+            opts.threads = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--pin")
+        {
+            opts.pin = (std::atoi(value) != 0);
+        }
+        else if (arg == "--arrival")
+        {
+            const std::string mode = value;
+            if (mode != "poisson" && mode != "constant")
+            {
+                std::cerr << "unknown arrival mode " << mode << std::endl;
+                return false;
+            }
+            opts.poisson = (mode == "poisson");
+        }
+        else if (arg == "--rate")
+        {
+            opts.rate = std::atof(value);
+        }
+        else if (arg == "--ramp")
+        {
+            std::stringstream ss(value);
+            char comma = 0;
+            if (!(ss >> opts.ramp_factor >> comma >> opts.ramp_max) || comma != ',' || opts.ramp_factor <= 1.0)
+            {
+                std::cerr << "--ramp expects F,MAX with F > 1" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--duration")
+        {
+            opts.duration = std::atof(value);
+        }
+        else if (arg == "--warmup")
+        {
+            opts.warmup = std::max(std::atof(value), 0.0);
+        }
+        else if (arg == "--max-queue")
+        {
+            opts.max_queue = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--interval-ms")
+        {
+            opts.interval_ms = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--slo-ms")
+        {
+            opts.slo_ms = std::max(std::atof(value), 0.0);
+        }
+        else if (arg == "--tolerance")
+        {
+            opts.tolerance = std::min(std::max(std::atof(value), 0.0), 1.0);
+        }
+        else if (arg == "--seed")
+        {
+            opts.seed = static_cast<unsigned>(std::atoi(value));
+        }
+        else if (arg == "--expect")
+        {
+            opts.expected = std::atoi(value);
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return opts.rate > 0.0 && opts.duration > 0.0;
+}
+
+// Scheduled arrival times in seconds from the start, warmup included
+static std::vector<double> arrival_times(const LoadGenOptions& opts, double rate, std::mt19937_64& rng)
+{
+    std::exponential_distribution<double> gap(rate);
+    std::vector<double> times;
+    const double end = opts.warmup + opts.duration;
+    for (double t = 0.0; t < end; t += opts.poisson ? gap(rng) : 1.0 / rate)
+    {
+        times.push_back(t);
+    }
+    return times;
+}
+
+static LoadResult run_rate(InferencePool& pool, const LoadGenOptions& opts, const std::vector<float>& input, double rate, std::mt19937_64& rng)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    const std::vector<double> schedule = arrival_times(opts, rate, rng);
+    const std::size_t n = schedule.size();
+    std::vector<double> latency(n, 0.0), service(n, 0.0), send_lag(n, 0.0), done_at(n, 0.0);
+    std::vector<int> top1(n, -1);
+
+    std::atomic<int> in_flight{ 0 };
+    std::atomic<std::size_t> completed{ 0 };
+    std::atomic<bool> sending{ true };
+    const auto start = Clock::now();
+
+    // Queue depth timeline, until every request has finished
+    LoadResult result;
+    std::thread monitor([&] {
+        std::size_t last = 0;
+        for (int k = 1; sending.load() || in_flight.load() > 0; k++)
+        {
+            std::this_thread::sleep_until(start + std::chrono::milliseconds(k * opts.interval_ms));
+            const std::size_t now_completed = completed.load();
+            LoadSample sample;
+            sample.t_s = k * opts.interval_ms * 1e-3;
+            sample.queue_depth = in_flight.load();
+            sample.completed = (now_completed - last) / (opts.interval_ms * 1e-3);
+            result.timeline.push_back(sample);
+            last = now_completed;
+        }
+    });
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+        const auto scheduled = start + std::chrono::duration_cast<Clock::duration>(Duration(schedule[i]));
+        std::this_thread::sleep_until(scheduled);
+        while (in_flight.load() >= opts.max_queue)
+        {
+            std::this_thread::yield();
+        }
+
+        const auto submitted = Clock::now();
+        send_lag[i] = Duration(submitted - scheduled).count();
+        in_flight++;
+        pool.Submit(input.data(), [&, i, scheduled, submitted](std::vector<float> output, std::exception_ptr error) {
+            const auto done = Clock::now();
+            latency[i] = Duration(done - scheduled).count();
+            service[i] = Duration(done - submitted).count();
+            done_at[i] = Duration(done - start).count();
+            if (!error)
+            {
+                top1[i] = top_k(output.data(), static_cast<int>(output.size()), 1).top1();
+            }
+            completed++;
+            in_flight--;
+        });
+    }
+    sending = false;
+    while (in_flight.load() > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    monitor.join();
+
+    // Measured: scheduled after the warmup
+    std::vector<double> measured_latency, measured_service;
+    double max_lag = 0.0, last_done = opts.warmup;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        if (schedule[i] < opts.warmup)
+        {
+            continue;
+        }
+        measured_latency.push_back(latency[i]);
+        measured_service.push_back(service[i]);
+        max_lag = std::max(max_lag, send_lag[i]);
+        last_done = std::max(last_done, done_at[i]);
+        result.top1_errors += (top1[i] < 0 || (opts.expected >= 0 && top1[i] != opts.expected)) ? 1 : 0;
+    }
+
+    result.rate = rate;
+    result.requests = measured_latency.size();
+    result.throughput = (last_done > opts.warmup) ? (result.requests / (last_done - opts.warmup)) : 0.0;
+    result.max_send_lag_ms = max_lag * 1e3;
+    result.latency = LatencyStats::compute(measured_latency);
+    result.service = LatencyStats::compute(measured_service);
+
+    double depth_sum = 0.0;
+    for (const auto& sample : result.timeline)
+    {
+        result.max_queue_depth = std::max(result.max_queue_depth, sample.queue_depth);
+        depth_sum += sample.queue_depth;
+    }
+    result.mean_queue_depth = result.timeline.empty() ? 0.0 : depth_sum / result.timeline.size();
+
+    result.saturated = (result.throughput < (1.0 - opts.tolerance) * rate) || (opts.slo_ms > 0.0 && result.latency.p99 > opts.slo_ms);
+    return result;
+}
+
+int main(int argc, char** argv) try
+{
+    LoadGenOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, opts.params, kDeviceType, 0);
+
+    // One instance per worker, all aliasing the weights of the first
+    std::vector<tvm::runtime::Module> instances{ model.mod };
+    for (int w = 1; w < opts.instances; w++)
+    {
+        instances.push_back(create_shared_graph_runtime(model.info, model.lib, kDeviceType, 0, model.mod, opts.params));
+    }
+
+    std::vector<float> input(element_count(model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)]));
+    read_input_file(opts.input, input);
+
+    InferencePoolOptions pool_opts;
+    pool_opts.workers = opts.instances;
+    pool_opts.threads_per_worker = opts.threads;
+    pool_opts.pin = opts.pin;
+    pool_opts.queue_capacity = static_cast<std::size_t>(opts.max_queue);
+    InferencePool pool(instances, model.info, kDeviceType, 0, pool_opts);
+
+    std::cout << "instances: " << opts.instances << " x " << opts.threads << " threads, arrivals: " << (opts.poisson ? "poisson" : "constant")
+              << ", " << opts.duration << " s per rate" << std::endl;
+    std::cout << std::setw(10) << "rate"
+              << std::setw(12) << "achieved"
+              << std::setw(10) << "p50_ms"
+              << std::setw(10) << "p90_ms"
+              << std::setw(10) << "p99_ms"
+              << std::setw(10) << "max_ms"
+              << std::setw(12) << "svc_p99_ms"
+              << std::setw(8) << "depth"
+              << std::setw(12) << "lag_ms" << std::endl;
+
+    std::mt19937_64 rng(opts.seed);
+    std::vector<LoadResult> results;
+    double saturation = 0.0; // highest rate sustained
+    for (double rate = opts.rate;; rate *= opts.ramp_factor)
+    {
+        LoadResult r = run_rate(pool, opts, input, rate, rng);
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(10) << r.rate
+                  << std::setw(12) << r.throughput
+                  << std::setw(10) << r.latency.p50
+                  << std::setw(10) << r.latency.p90
+                  << std::setw(10) << r.latency.p99
+                  << std::setw(10) << r.latency.max
+                  << std::setw(12) << r.service.p99
+                  << std::setw(8) << r.max_queue_depth
+                  << std::setw(12) << r.max_send_lag_ms
+                  << (r.saturated ? "  saturated" : "") << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+
+        results.push_back(r);
+        if (!r.saturated)
+        {
+            saturation = std::max(saturation, r.throughput);
+        }
+        if (r.saturated || opts.ramp_factor <= 1.0 || rate * opts.ramp_factor > opts.ramp_max)
+        {
+            break;
+        }
+    }
+
+    if (opts.ramp_factor > 1.0)
+    {
+        if (saturation > 0.0)
+        {
+            std::cout << "saturation point: " << saturation << " req/s";
+            if (opts.slo_ms > 0.0)
+            {
+                std::cout << " at p99 <= " << opts.slo_ms << " ms";
+            }
+            std::cout << (results.back().saturated ? "" : " (not reached, raise the ramp maximum)") << std::endl;
+        }
+        else
+        {
+            std::cout << "saturated at the first rate, lower --rate" << std::endl;
+        }
+    }
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("lib", opts.lib);
+        writer.WriteObjectKeyValue("device_type", kDeviceType);
+        writer.WriteObjectKeyValue("instances", opts.instances);
+        writer.WriteObjectKeyValue("threads_per_instance", opts.threads);
+        writer.WriteObjectKeyValue("arrival", std::string(opts.poisson ? "poisson" : "constant"));
+        writer.WriteObjectKeyValue("duration_s", opts.duration);
+        writer.WriteObjectKeyValue("slo_ms", opts.slo_ms);
+        writer.WriteObjectKeyValue("saturation_rate", saturation);
+        writer.WriteObjectKeyValue("results", results);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    for (const auto& r : results)
+    {
+        if (r.top1_errors)
+        {
+            std::cerr << "unexpected top-1 results" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
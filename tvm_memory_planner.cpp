@@ -0,0 +1,243 @@
+// Re-plan the storage_id assignment of a compiled graph for a smaller storage
+// pool, report current vs. planned vs. lower bound footprint, and write a
+// graph the stock runtime can load.  Optionally verify the planned graph
+// against the original one with the compiled library.
+
+#include "Device.h"
+#include "MemoryPlanner.h"
+#include "MemoryUsage.h"
+#include "ModelLoader.h"
+
+#include <dlpack/dlpack.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void usage()
+{
+    std::cerr << "usage: tvm_memory_planner from_mxnet.json [options]\n"
+              << "  --strategy S   best (default), greedy_by_size or best_fit\n"
+              << "  --align N      pool entry alignment in bytes (default 64)\n"
+              << "  --output FILE  write the re-planned graph (.json, or .graph for the binary format)\n"
+              << "  --json FILE    write the report as JSON\n"
+              << "  --verify LIB   run original and planned graph with LIB (from_mxnet.so, or system),\n"
+              << "                 from_mxnet.params and cat.bin and compare the outputs" << std::endl;
+}
+
+static void print_plan(const MemoryPlan& plan, std::size_t reference)
+{
+    std::cout << std::setw(16) << plan.strategy
+              << std::setw(14) << plan.total()
+              << std::setw(12) << std::fixed << std::setprecision(2) << to_mib(plan.total())
+              << std::setw(10) << plan.pool.size()
+              << std::setw(10) << (reference ? 100.0 * plan.total() / reference : 0.0) << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+// Run a graph once on cat.bin and return output 0
+static std::vector<float> run_graph(const GraphRuntimePrivateStuff& info, tvm::runtime::Module lib)
+{
+    const int device_id = 0;
+    tvm::runtime::Module mod = create_graph_runtime(info, lib, kDeviceType, device_id);
+    load_params(mod, "from_mxnet.params");
+
+    const auto& in = info.attrs_.shape[info.entry_id(info.input_nodes_.front(), 0)];
+    std::vector<float> input(element_count(in));
+    std::ifstream data_fin("cat.bin", std::ios::binary);
+    CHECK(data_fin) << "Failed to read input file cat.bin";
+    data_fin.read(reinterpret_cast<char*>(input.data()), input.size() * sizeof(float));
+
+    tvm::runtime::NDArray x = tvm::runtime::NDArray::Empty(in, DLDataType{ kDLFloat, 32, 1 }, DLContext{ static_cast<DLDeviceType>(kDeviceType), device_id });
+    TVMArrayCopyFromBytes(const_cast<DLTensor*>(x.operator->()), input.data(), input.size() * sizeof(float));
+    mod.GetFunction("set_input")("data", x);
+    mod.GetFunction("run")();
+
+    tvm::runtime::NDArray y = mod.GetFunction("get_output")(0);
+    std::vector<float> output(element_count(info.attrs_.shape[info.entry_id(info.outputs_.front())]));
+    TVMArrayCopyToBytes(const_cast<DLTensor*>(y.operator->()), output.data(), output.size() * sizeof(float));
+    return output;
+}
+
+int main(int argc, char** argv) try
+{
+    if (argc < 2)
+    {
+        usage();
+        return 1;
+    }
+
+    const std::string graph_file = argv[1];
+    std::string strategy = "best", output, json, verify;
+    std::size_t alignment = 64;
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--strategy")
+        {
+            strategy = value;
+        }
+        else if (arg == "--align")
+        {
+            alignment = static_cast<std::size_t>(std::max(std::atoi(value), 1));
+        }
+        else if (arg == "--output")
+        {
+            output = value;
+        }
+        else if (arg == "--json")
+        {
+            json = value;
+        }
+        else if (arg == "--verify")
+        {
+            verify = value;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    GraphRuntimePrivateStuff info;
+    load_graph_info(graph_file, info);
+
+    MemoryPlanner planner(info, alignment);
+    MemoryPlan current = planner.Current();
+    MemoryPlan greedy = planner.GreedyBySize();
+    MemoryPlan best_fit = planner.BestFit();
+    const std::size_t lower_bound = planner.LowerBound();
+
+    MemoryPlan plan;
+    if (strategy == "greedy_by_size")
+    {
+        plan = greedy;
+    }
+    else if (strategy == "best_fit")
+    {
+        plan = best_fit;
+    }
+    else if (strategy == "best")
+    {
+        plan = (best_fit.total() < greedy.total()) ? best_fit : greedy;
+    }
+    else
+    {
+        usage();
+        return 1;
+    }
+
+    CHECK(planner.Validate(plan)) << "invalid storage plan " << plan.strategy;
+
+    std::cout << "tensors: " << planner.num_tensors()
+              << ", inputs+params: " << planner.fixed_bytes() << " bytes"
+              << ", activations (unshared): " << planner.activation_bytes() << " bytes" << std::endl;
+    std::cout << std::setw(16) << "plan"
+              << std::setw(14) << "bytes"
+              << std::setw(12) << "MiB"
+              << std::setw(10) << "entries"
+              << std::setw(10) << "% current" << std::endl;
+    for (const auto* p : { &current, &greedy, &best_fit })
+    {
+        print_plan(*p, current.total());
+    }
+    std::cout << std::setw(16) << "lower_bound" << std::setw(14) << lower_bound
+              << std::setw(12) << std::fixed << std::setprecision(2) << to_mib(lower_bound) << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << "selected: " << plan.strategy << ", saves " << static_cast<int64_t>(current.total()) - static_cast<int64_t>(plan.total())
+              << " bytes" << std::endl;
+
+    GraphRuntimePrivateStuff planned = info;
+    MemoryPlanner::Apply(plan, planned);
+
+    if (!output.empty())
+    {
+        const bool binary = (output.size() > 6) && (output.compare(output.size() - 6, 6, ".graph") == 0);
+        bool ok = false;
+        if (binary)
+        {
+            ok = save_graph_binary(planned, output);
+        }
+        else
+        {
+            std::ofstream ofs(output);
+            if (ofs)
+            {
+                dmlc::JSONWriter writer(&ofs);
+                planned.Save(&writer);
+                ofs << std::endl;
+                ok = static_cast<bool>(ofs);
+            }
+        }
+
+        if (!ok)
+        {
+            std::cerr << "Failed to write graph " << output << std::endl;
+            return 1;
+        }
+        std::cout << "planned graph: " << output << std::endl;
+    }
+
+    if (!verify.empty())
+    {
+        tvm::runtime::Module lib = load_operator_library(verify);
+        auto reference = run_graph(info, lib);
+        auto result = run_graph(planned, lib);
+
+        double max_abs = 0.0;
+        for (std::size_t i = 0; i < reference.size(); i++)
+        {
+            max_abs = std::max(max_abs, static_cast<double>(std::fabs(reference[i] - result[i])));
+        }
+        std::cout << "verify: max abs difference " << max_abs << std::endl;
+        if (max_abs != 0.0)
+        {
+            std::cerr << "planned graph output differs from the original" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!json.empty())
+    {
+        std::ofstream ofs(json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("alignment", alignment);
+        writer.WriteObjectKeyValue("fixed_bytes", planner.fixed_bytes());
+        writer.WriteObjectKeyValue("activation_bytes", planner.activation_bytes());
+        writer.WriteObjectKeyValue("lower_bound_bytes", lower_bound);
+        writer.WriteObjectKeyValue("current", current);
+        writer.WriteObjectKeyValue("greedy_by_size", greedy);
+        writer.WriteObjectKeyValue("best_fit", best_fit);
+        writer.WriteObjectKeyValue("selected", plan.strategy);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
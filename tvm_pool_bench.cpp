@@ -0,0 +1,361 @@
+// Scaling benchmark for InferencePool (InferencePool.h): for 1..N cores, try
+// every split of the cores into workers x threads per worker (inter-request
+// vs. intra-op parallelism) and report throughput, latency percentiles and
+// speedup / efficiency against one core.  All instances share one copy of
+// the weights.
+
+#include "Benchmark.h"
+#include "BenchmarkArgs.h"
+#include "Device.h"
+#include "InferencePool.h"
+#include "MemoryUsage.h"
+#include "ModelLoader.h"
+#include "Postprocess.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PoolBenchOptions
+{
+    std::string lib;
+    std::string graph{ "from_mxnet.json" };
+    std::string params{ "from_mxnet.params" };
+    std::string input{ "cat.bin" };
+    std::vector<int> cores; // empty : 1, 2, 4, ... up to all cores
+    int requests{ 200 };    // timed requests per setting
+    int clients{ 0 };       // closed loop clients, 0 : 2 per worker
+    bool pin{ false };
+    WaitOptions wait;
+    int expected{ 282 }; // expected top-1, -1 : no check
+    std::string json;
+};
+
+struct PoolResult
+{
+    int cores{ 0 };
+    int workers{ 0 };
+    int threads_per_worker{ 0 };
+    double throughput{ 0.0 }; // requests per second
+    double speedup{ 0.0 };    // vs. 1 core (0 when 1 is not in --cores)
+    double efficiency{ 0.0 }; // speedup / cores
+    std::size_t top1_errors{ 0 };
+    LatencyStats latency;
+
+    void Save(dmlc::JSONWriter* writer) const
+    {
+        writer->BeginObject();
+        writer->WriteObjectKeyValue("cores", cores);
+        writer->WriteObjectKeyValue("workers", workers);
+        writer->WriteObjectKeyValue("threads_per_worker", threads_per_worker);
+        writer->WriteObjectKeyValue("throughput", throughput);
+        writer->WriteObjectKeyValue("speedup", speedup);
+        writer->WriteObjectKeyValue("efficiency", efficiency);
+        writer->WriteObjectKeyValue("top1_errors", top1_errors);
+        writer->WriteObjectKeyValue("latency", latency);
+        writer->EndObject();
+    }
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_pool_bench /full/path/to/from_mxnet.so [options]\n"
+              << "  --graph FILE     graph JSON or binary graph (default from_mxnet.json)\n"
+              << "  --params FILE    parameters (default from_mxnet.params)\n"
+              << "  --input FILE     one input sample (default cat.bin)\n"
+              << "  --cores LIST     comma separated core counts (default 1,2,4,... and all cores)\n"
+              << "  --requests N     timed requests per setting (default 200)\n"
+              << "  --clients N      closed loop clients (default 2 per worker)\n"
+              << "  --pin 0|1        bind each worker and its TVM threads to its own cores (default 0)\n"
+              << "  --spin N         polls of an empty request queue before a worker sleeps (default 256)\n"
+              << "  --yield 0|1      yield the core between polls (default 0)\n"
+              << "  --expect N       expected top-1 class, -1 to disable the check (default 282)\n"
+              << "  --json FILE      write the sweep as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, PoolBenchOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.lib = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--graph")
+        {
+            opts.graph = value;
+        }
+        else if (arg == "--params")
+        {
+            opts.params = value;
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--cores")
+        {
+            opts.cores = parse_list(value);
+        }
+        else if (arg == "--requests")
+        {
+            opts.requests = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--clients")
+        {
+            opts.clients = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--pin")
+        {
+            opts.pin = (std::atoi(value) != 0);
+        }
+        else if (arg == "--spin")
+        {
+            opts.wait.spin = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--yield")
+        {
+            opts.wait.yield = (std::atoi(value) != 0);
+        }
+        else if (arg == "--expect")
+        {
+            opts.expected = std::atoi(value);
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static PoolResult run_setting(const GraphModel& model, const std::vector<tvm::runtime::Module>& instances, const PoolBenchOptions& opts, const std::vector<float>& input, int workers, int threads)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    InferencePoolOptions pool_opts;
+    pool_opts.workers = workers;
+    pool_opts.threads_per_worker = threads;
+    pool_opts.pin = opts.pin;
+    pool_opts.wait = opts.wait;
+    InferencePool pool(instances, model.info, kDeviceType, 0, pool_opts);
+
+    const int clients = (opts.clients > 0) ? opts.clients : 2 * workers;
+    const int per_client = std::max(opts.requests / clients, 1);
+
+    // Untimed requests, so the workers create their TVM thread pools first
+    {
+        std::vector<std::future<std::vector<float>>> warmup;
+        for (int w = 0; w < 2 * workers; w++)
+        {
+            warmup.push_back(pool.Submit(input.data()));
+        }
+        for (auto& f : warmup)
+        {
+            f.get();
+        }
+    }
+
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::size_t> errors(clients, 0);
+    auto client = [&](int c) {
+        for (int i = 0; i < per_client; i++)
+        {
+            auto tic = Clock::now();
+            std::vector<float> output = pool.Submit(input.data()).get();
+            auto toc = Clock::now();
+            latencies[c].push_back(Duration(toc - tic).count());
+
+            const int top1 = top_k(output.data(), static_cast<int>(output.size()), 1).top1();
+            if (opts.expected >= 0 && top1 != opts.expected)
+            {
+                errors[c]++;
+            }
+        }
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> client_threads;
+    for (int c = 0; c < clients; c++)
+    {
+        client_threads.emplace_back(client, c);
+    }
+    for (auto& t : client_threads)
+    {
+        t.join();
+    }
+    auto stop = Clock::now();
+
+    PoolResult result;
+    result.cores = workers * threads;
+    result.workers = workers;
+    result.threads_per_worker = threads;
+
+    std::vector<double> samples;
+    for (int c = 0; c < clients; c++)
+    {
+        samples.insert(samples.end(), latencies[c].begin(), latencies[c].end());
+        result.top1_errors += errors[c];
+    }
+
+    const double wall = Duration(stop - start).count();
+    result.throughput = (wall > 0.0) ? (samples.size() / wall) : 0.0;
+    result.latency = LatencyStats::compute(samples);
+    return result;
+}
+
+int main(int argc, char** argv) try
+{
+    PoolBenchOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    const int all_cores = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    if (opts.cores.empty())
+    {
+        for (int c = 1; c < all_cores; c *= 2)
+        {
+            opts.cores.push_back(c);
+        }
+        opts.cores.push_back(all_cores);
+    }
+    const int max_cores = *std::max_element(opts.cores.begin(), opts.cores.end());
+
+    GraphModel model;
+    load_graph_model(model, opts.lib, opts.graph, opts.params, kDeviceType, 0);
+    const std::size_t rss_one = current_rss_bytes();
+
+    // One instance per possible worker, all aliasing the weights of the first
+    std::vector<tvm::runtime::Module> instances{ model.mod };
+    for (int w = 1; w < max_cores; w++)
+    {
+        instances.push_back(create_shared_graph_runtime(model.info, model.lib, kDeviceType, 0, model.mod, opts.params));
+    }
+    const std::size_t rss_all = current_rss_bytes();
+    std::cout << "instances: " << instances.size() << ", params: " << model.param_bytes << " bytes"
+              << ", rss 1 instance: " << to_mib(rss_one) << " MiB, rss " << instances.size() << " instances: " << to_mib(rss_all) << " MiB" << std::endl;
+
+    std::vector<float> input(element_count(model.info.attrs_.shape[model.info.entry_id(model.info.input_nodes_.front(), 0)]));
+    read_input_file(opts.input, input);
+
+    std::cout << std::setw(6) << "cores"
+              << std::setw(9) << "workers"
+              << std::setw(9) << "threads"
+              << std::setw(12) << "req/s"
+              << std::setw(10) << "speedup"
+              << std::setw(12) << "efficiency"
+              << std::setw(10) << "p50_ms"
+              << std::setw(10) << "p99_ms" << std::endl;
+
+    std::vector<PoolResult> results, best;
+    double base = 0.0;
+    for (auto cores : opts.cores)
+    {
+        std::size_t best_index = results.size();
+        for (int workers = 1; workers <= cores; workers++)
+        {
+            if (cores % workers)
+            {
+                continue;
+            }
+
+            auto r = run_setting(model, instances, opts, input, workers, cores / workers);
+            if (base == 0.0 && cores == 1)
+            {
+                base = r.throughput;
+            }
+            r.speedup = (base > 0.0) ? (r.throughput / base) : 0.0;
+            r.efficiency = r.speedup / cores;
+
+            std::cout << std::fixed << std::setprecision(2)
+                      << std::setw(6) << r.cores
+                      << std::setw(9) << r.workers
+                      << std::setw(9) << r.threads_per_worker
+                      << std::setw(12) << r.throughput
+                      << std::setw(10) << r.speedup
+                      << std::setw(12) << r.efficiency
+                      << std::setw(10) << r.latency.p50
+                      << std::setw(10) << r.latency.p99 << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+
+            if (best_index == results.size() || r.throughput > results[best_index].throughput)
+            {
+                best_index = results.size();
+            }
+            results.push_back(r);
+        }
+        best.push_back(results[best_index]);
+    }
+
+    std::cout << "best split per core count:" << std::endl;
+    for (const auto& r : best)
+    {
+        std::cout << "  " << r.cores << " cores: " << r.workers << " x " << r.threads_per_worker
+                  << " " << r.throughput << " req/s, speedup " << r.speedup << std::endl;
+    }
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("lib", opts.lib);
+        writer.WriteObjectKeyValue("device_type", kDeviceType);
+        writer.WriteObjectKeyValue("pin", static_cast<int>(opts.pin));
+        writer.WriteObjectKeyValue("spin", opts.wait.spin);
+        writer.WriteObjectKeyValue("yield", static_cast<int>(opts.wait.yield));
+        writer.WriteObjectKeyValue("rss_one_instance_bytes", rss_one);
+        writer.WriteObjectKeyValue("rss_all_instances_bytes", rss_all);
+        writer.WriteObjectKeyValue("results", results);
+        writer.WriteObjectKeyValue("best", best);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    for (const auto& r : results)
+    {
+        if (r.top1_errors)
+        {
+            std::cerr << "unexpected top-1 results" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
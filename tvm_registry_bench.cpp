@@ -0,0 +1,300 @@
+// Serve a stream of requests for many models through ModelRegistry
+// (ModelRegistry.h) under a memory budget and report the per model hits,
+// misses, evictions and load latency, the overall hit rate and the resident
+// bytes against the budget.  The models are listed in a manifest, one per
+// line: "name prefix" (prefix.so, prefix.json, prefix.params) or
+// "name lib graph params".
+
+#include "Benchmark.h"
+#include "DataType.h"
+#include "Device.h"
+#include "MemoryUsage.h"
+#include "ModelRegistry.h"
+
+#include <dlpack/dlpack.h>
+#include <tvm/runtime/module.h>
+#include <tvm/runtime/ndarray.h>
+#include <tvm/runtime/packed_func.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct RegistryBenchOptions
+{
+    std::string manifest;
+    std::size_t budget_mib{ 0 }; // 0 : unlimited
+    int requests{ 1000 };
+    double zipf{ 1.0 }; // 0 : uniform
+    int idle_ms{ 0 };
+    int threads{ 0 };
+    std::string input{ "cat.bin" };
+    unsigned seed{ 1 };
+    std::string json;
+};
+
+static void usage()
+{
+    std::cerr << "usage: tvm_registry_bench models.txt [options]\n"
+              << "  --budget-mib N     total memory budget of the resident models (default unlimited)\n"
+              << "  --requests N       requests, each for one model (default 1000)\n"
+              << "  --zipf S           Zipf exponent of the model popularity, 0 for uniform (default 1)\n"
+              << "  --idle-ms N        evict models unused for N ms (default never)\n"
+              << "  --threads N        TVM thread pool size, shared by all models (default: runtime choice)\n"
+              << "  --input FILE       input data, repeated to fill every model's input (default cat.bin)\n"
+              << "  --seed N           request stream seed (default 1)\n"
+              << "  --json FILE        write the report as JSON" << std::endl;
+}
+
+static bool parse_options(int argc, char** argv, RegistryBenchOptions& opts)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+
+    opts.manifest = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--budget-mib")
+        {
+            opts.budget_mib = static_cast<std::size_t>(std::max(std::atol(value), 0L));
+        }
+        else if (arg == "--requests")
+        {
+            opts.requests = std::max(std::atoi(value), 1);
+        }
+        else if (arg == "--zipf")
+        {
+            opts.zipf = std::max(std::atof(value), 0.0);
+        }
+        else if (arg == "--idle-ms")
+        {
+            opts.idle_ms = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--threads")
+        {
+            opts.threads = std::max(std::atoi(value), 0);
+        }
+        else if (arg == "--input")
+        {
+            opts.input = value;
+        }
+        else if (arg == "--seed")
+        {
+            opts.seed = static_cast<unsigned>(std::atoi(value));
+        }
+        else if (arg == "--json")
+        {
+            opts.json = value;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Input of the model's first input node: the input file repeated
+static tvm::runtime::NDArray make_input(const GraphModel& model, const std::vector<float>& data)
+{
+    const uint32_t eid = model.info.entry_id(model.info.input_nodes_.front(), 0);
+    const auto& shape = model.info.attrs_.shape[eid];
+    CHECK(model.info.attrs_.dltype[eid] == "float32") << "only float32 inputs are supported";
+
+    std::vector<float> values(element_count(shape));
+    for (std::size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = data[i % data.size()];
+    }
+
+    tvm::runtime::NDArray x = tvm::runtime::NDArray::Empty(shape, DLDataType{ kDLFloat, 32, 1 }, DLContext{ static_cast<DLDeviceType>(kDeviceType), 0 });
+    TVMArrayCopyFromBytes(const_cast<DLTensor*>(x.operator->()), values.data(), values.size() * sizeof(float));
+    return x;
+}
+
+int main(int argc, char** argv) try
+{
+    using Clock = std::chrono::high_resolution_clock;
+    using Duration = std::chrono::duration<double>;
+
+    RegistryBenchOptions opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    // One serving thread, so every model runs on its single TVM pool
+    if (opts.threads > 0)
+    {
+        setenv("TVM_NUM_THREADS", std::to_string(opts.threads).c_str(), 1);
+    }
+
+    std::vector<float> data;
+    {
+        std::ifstream ifs(opts.input, std::ios::binary | std::ios::ate);
+        if (!ifs || ifs.tellg() < static_cast<std::streamoff>(sizeof(float)))
+        {
+            std::cerr << "Failed to read input file " << opts.input << std::endl;
+            return 1;
+        }
+        data.resize(static_cast<std::size_t>(ifs.tellg()) / sizeof(float));
+        ifs.seekg(0);
+        ifs.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+    }
+
+    const std::vector<ModelSpec> specs = read_model_manifest(opts.manifest);
+    if (specs.empty())
+    {
+        std::cerr << "no models in " << opts.manifest << std::endl;
+        return 1;
+    }
+
+    ModelRegistryOptions registry_opts;
+    registry_opts.budget_bytes = opts.budget_mib << 20;
+    registry_opts.idle_timeout = std::chrono::milliseconds(opts.idle_ms);
+    ModelRegistry registry(registry_opts, kDeviceType, 0);
+
+    std::size_t footprint_sum = 0;
+    std::cout << std::setw(16) << "model" << std::setw(12) << "pool_MiB" << std::setw(12) << "lib_MiB" << std::setw(12) << "params_MiB" << std::endl;
+    for (const auto& spec : specs)
+    {
+        registry.Add(spec);
+        const ModelFootprint footprint = registry.Estimate(spec.name);
+        footprint_sum += footprint.total();
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(16) << spec.name
+                  << std::setw(12) << to_mib(footprint.pool_bytes)
+                  << std::setw(12) << to_mib(footprint.lib_bytes)
+                  << std::setw(12) << to_mib(footprint.param_file_bytes) << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+    std::cout << "all models: " << to_mib(footprint_sum) << " MiB, budget: ";
+    if (registry_opts.budget_bytes)
+    {
+        std::cout << opts.budget_mib << " MiB" << std::endl;
+    }
+    else
+    {
+        std::cout << "unlimited" << std::endl;
+    }
+
+    // Model i is requested with probability ~ 1 / (i + 1)^s, in manifest order
+    std::vector<double> weights;
+    for (std::size_t i = 0; i < specs.size(); i++)
+    {
+        weights.push_back(1.0 / std::pow(static_cast<double>(i + 1), opts.zipf));
+    }
+    std::mt19937 rng(opts.seed);
+    std::discrete_distribution<std::size_t> pick(weights.begin(), weights.end());
+
+    std::map<std::string, std::vector<double>> latencies; // per request, Get() to output
+    std::size_t peak_resident = 0;
+    auto start = Clock::now();
+    for (int r = 0; r < opts.requests; r++)
+    {
+        const std::string& name = specs[pick(rng)].name;
+        auto tic = Clock::now();
+        std::shared_ptr<GraphModel> model = registry.Get(name);
+        model->mod.GetFunction("set_input")(model->info.nodes_[model->info.input_nodes_.front()].name, make_input(*model, data));
+        model->mod.GetFunction("run")();
+        tvm::runtime::NDArray y = model->mod.GetFunction("get_output")(0);
+        std::vector<uint8_t> output(byte_size(y->dtype, std::vector<int64_t>(y->shape, y->shape + y->ndim)));
+        TVMArrayCopyToBytes(const_cast<DLTensor*>(y.operator->()), output.data(), output.size());
+        latencies[name].push_back(Duration(Clock::now() - tic).count());
+        peak_resident = std::max(peak_resident, registry.resident_bytes());
+    }
+    const double wall_s = Duration(Clock::now() - start).count();
+
+    const auto stats = registry.stats();
+    std::size_t hits = 0, misses = 0, evictions = 0;
+    std::cout << std::setw(16) << "model"
+              << std::setw(10) << "requests"
+              << std::setw(8) << "hits"
+              << std::setw(8) << "misses"
+              << std::setw(8) << "evicts"
+              << std::setw(12) << "load_ms"
+              << std::setw(10) << "p50_ms"
+              << std::setw(10) << "p99_ms" << std::endl;
+    for (const auto& spec : specs)
+    {
+        const ModelStats& s = stats.at(spec.name);
+        const LatencyStats load = LatencyStats::compute(s.load_times);
+        const LatencyStats request = LatencyStats::compute(latencies[spec.name]);
+        hits += s.hits;
+        misses += s.misses;
+        evictions += s.evictions;
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(16) << spec.name
+                  << std::setw(10) << latencies[spec.name].size()
+                  << std::setw(8) << s.hits
+                  << std::setw(8) << s.misses
+                  << std::setw(8) << s.evictions
+                  << std::setw(12) << load.mean
+                  << std::setw(10) << request.p50
+                  << std::setw(10) << request.p99 << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    const double hit_rate = static_cast<double>(hits) / std::max<std::size_t>(hits + misses, 1);
+    std::cout << "hit rate: " << 100.0 * hit_rate << " %, evictions: " << evictions << ", " << opts.requests / wall_s << " req/s"
+              << ", resident: " << to_mib(registry.resident_bytes()) << " MiB (peak " << to_mib(peak_resident) << " MiB)"
+              << ", peak rss: " << to_mib(peak_rss_bytes()) << " MiB" << std::endl;
+
+    if (!opts.json.empty())
+    {
+        std::ofstream ofs(opts.json);
+        if (!ofs)
+        {
+            std::cerr << "Failed to write json file " << opts.json << std::endl;
+            return 1;
+        }
+
+        std::map<std::string, LatencyStats> request_stats;
+        for (const auto& item : latencies)
+        {
+            request_stats[item.first] = LatencyStats::compute(item.second);
+        }
+
+        dmlc::JSONWriter writer(&ofs);
+        writer.BeginObject();
+        writer.WriteObjectKeyValue("manifest", opts.manifest);
+        writer.WriteObjectKeyValue("budget_bytes", registry_opts.budget_bytes);
+        writer.WriteObjectKeyValue("requests", opts.requests);
+        writer.WriteObjectKeyValue("zipf", opts.zipf);
+        writer.WriteObjectKeyValue("wall_s", wall_s);
+        writer.WriteObjectKeyValue("hit_rate", hit_rate);
+        writer.WriteObjectKeyValue("peak_resident_bytes", peak_resident);
+        writer.WriteObjectKeyValue("peak_rss_bytes", peak_rss_bytes());
+        writer.WriteObjectKeyValue("models", stats);
+        writer.WriteObjectKeyValue("request_latency", request_stats);
+        writer.EndObject();
+        ofs << std::endl;
+    }
+
+    return 0;
+}
+catch (const dmlc::Error& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
@@ -45,6 +45,9 @@
 #  include "../../src/runtime/graph/debug/graph_runtime_debug.cc"
 #endif
 
+// Local graph runtime extensions (tvm_cpp_test)
+#include "graph_runtime_ext.cc"
+
 #if defined(TVM_USE_RPC)
 #  include "../../src/runtime/rpc/rpc_session.cc"
 #  include "../../src/runtime/rpc/rpc_event_impl.cc"